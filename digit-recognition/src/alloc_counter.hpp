@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+
+// optional heap allocation counting for making sure that hot code paths (like
+// training steps) don't allocate any memory. define DIGIT_REC_COUNT_ALLOCATIONS
+// in the preprocessor definitions to replace the global operator new with one
+// that counts allocations (see main.cpp). otherwise, nothing is counted.
+namespace alloc_counter
+{
+
+    // number of heap allocations done by the current thread so far
+    inline thread_local uint64_t n_allocations = 0;
+
+}
@@ -0,0 +1,369 @@
+#include "app_benchmark.hpp"
+
+namespace benchmark
+{
+
+    using digit_rec::N_DIGIT_VALUES;
+
+    App::App(bool use_perf_counters)
+        : use_perf_counters(use_perf_counters), rng(SEED)
+    {}
+
+    void App::run()
+    {
+        generate_inputs();
+
+        if (use_perf_counters && !perf::Counters().any_available())
+        {
+            std::cout << "hardware performance counters aren't available, "
+                "only timings will be shown\n";
+            use_perf_counters = false;
+        }
+
+        print_header();
+
+        benchmark_network({ N_DIGIT_VALUES, 24, 16, 10 });
+        benchmark_static_network<digit_rec::StaticDigitNetwork<24, 16>>();
+        benchmark_network({ N_DIGIT_VALUES, 64, 64, 10 });
+        benchmark_static_network<digit_rec::StaticDigitNetwork<64, 64>>();
+        benchmark_random_transform();
+        benchmark_synthetic_digits();
+    }
+
+    void App::generate_inputs()
+    {
+        std::uniform_real_distribution<float> dist(0.f, 1.f);
+        std::uniform_int_distribution<size_t> label_dist(0, 9);
+
+        inputs.resize(N_INPUTS * N_DIGIT_VALUES);
+        labels.resize(N_INPUTS);
+        for (size_t i = 0; i < N_INPUTS; i++)
+        {
+            for (size_t j = 0; j < N_DIGIT_VALUES; j++)
+            {
+                inputs[i * N_DIGIT_VALUES + j] =
+                    dist(rng) < INPUT_DENSITY ? dist(rng) : 0.f;
+            }
+            labels[i] = label_dist(rng);
+        }
+    }
+
+    void App::benchmark_network(const std::vector<size_t>& layer_sizes)
+    {
+        std::string s_layer_sizes;
+        for (size_t i = 0; i < layer_sizes.size(); i++)
+        {
+            if (i != 0)
+                s_layer_sizes += ", ";
+            s_layer_sizes += std::to_string(layer_sizes[i]);
+        }
+
+        std::vector<std::function<float(float)>> activation_fns(
+            layer_sizes.size() - 1u,
+            neural::leaky_relu<float, .01f>
+        );
+        std::vector<std::function<float(float)>> activation_derivs(
+            layer_sizes.size() - 1u,
+            neural::leaky_relu_deriv<float, .01f>
+        );
+        activation_fns.back() = neural::tanh<float>;
+        activation_derivs.back() = neural::tanh_deriv<float>;
+
+        // forward pass
+        {
+            neural::Network<float, false> net(
+                layer_sizes,
+                activation_fns,
+                activation_derivs
+            );
+            net.randomize_xavier_normal(rng, -.1f, .1f);
+
+            auto net_input = net.input_values();
+            print_result(
+                std::format("forward_pass() [{}]", s_layer_sizes),
+                measure([&](size_t i)
+                    {
+                        auto in = input(i);
+                        std::copy(in.begin(), in.end(), net_input.begin());
+                        net.forward_pass();
+                    }
+                )
+            );
+        }
+
+        // forward pass with 16-bit weights and biases
+        for (auto format : { half::Format::Bf16, half::Format::Fp16 })
+        {
+            neural::Network<float, false> master_net(
+                layer_sizes,
+                activation_fns,
+                activation_derivs
+            );
+            master_net.randomize_xavier_normal(rng, -.1f, .1f);
+
+            neural::HalfNetwork<float> net(layer_sizes, activation_fns, format);
+            net.copy_parameters_from(master_net);
+
+            auto net_input = net.input_values();
+            print_result(
+                std::format(
+                    "HalfNetwork forward_pass() {} [{}]",
+                    half::Format_str[(size_t)format],
+                    s_layer_sizes
+                ),
+                measure([&](size_t i)
+                    {
+                        auto in = input(i);
+                        std::copy(in.begin(), in.end(), net_input.begin());
+                        net.forward_pass();
+                    }
+                )
+            );
+        }
+
+        // backward pass (this includes a forward pass)
+        {
+            neural::Network<float, true> net(
+                layer_sizes,
+                activation_fns,
+                activation_derivs
+            );
+            net.randomize_xavier_normal(rng, -.1f, .1f);
+
+            print_result(
+                std::format("backward_pass() [{}]", s_layer_sizes),
+                measure([&](size_t i)
+                    {
+                        net.backward_pass<false>(
+                            input(i),
+                            labels[i % N_INPUTS]
+                        );
+                    }
+                )
+            );
+        }
+    }
+
+    template<typename StaticNetType>
+    void App::benchmark_static_network()
+    {
+        std::string s_layer_sizes;
+        for (size_t i = 0; i < StaticNetType::N_LAYERS; i++)
+        {
+            if (i != 0)
+                s_layer_sizes += ", ";
+            s_layer_sizes += std::to_string(StaticNetType::LAYER_SIZES[i]);
+        }
+
+        // initialize the parameters the same way as a regular network
+        std::vector<std::function<float(float)>> activation_fns(
+            StaticNetType::N_LAYERS - 1u,
+            neural::leaky_relu<float, .01f>
+        );
+        neural::Network<float, false> init_net(
+            std::vector<size_t>(
+                StaticNetType::LAYER_SIZES.begin(),
+                StaticNetType::LAYER_SIZES.end()
+            ),
+            activation_fns,
+            activation_fns
+        );
+        init_net.randomize_xavier_normal(rng, -.1f, .1f);
+
+        auto net = std::make_unique<StaticNetType>();
+        net->copy_parameters_from(init_net);
+
+        auto net_input = net->input_values();
+        print_result(
+            std::format("StaticNetwork forward_pass() [{}]", s_layer_sizes),
+            measure([&](size_t i)
+                {
+                    auto in = input(i);
+                    std::copy(in.begin(), in.end(), net_input.begin());
+                    net->forward_pass();
+                }
+            )
+        );
+
+        print_result(
+            std::format(
+                "StaticNetwork forward_backward() [{}]",
+                s_layer_sizes
+            ),
+            measure([&](size_t i)
+                {
+                    net->template forward_backward<false>(
+                        std::span<const float, StaticNetType::INPUT_SIZE>(
+                            input(i).data(),
+                            StaticNetType::INPUT_SIZE
+                        ),
+                        labels[i % N_INPUTS]
+                    );
+                }
+            )
+        );
+    }
+
+    void App::benchmark_random_transform()
+    {
+        // the inputs as 8-bit images, like the digit samples
+        std::vector<uint8_t> src_digits(N_INPUTS * N_DIGIT_VALUES);
+        for (size_t i = 0; i < src_digits.size(); i++)
+        {
+            src_digits[i] = (uint8_t)std::round(inputs[i] * 255.f);
+        }
+
+        std::array<float, N_DIGIT_VALUES> dst_digit;
+        digit_rec::TransformParams params;
+        const digit_rec::RandomTransforms random_transforms;
+
+        print_result(
+            "apply_transforms()",
+            measure([&](size_t i)
+                {
+                    const uint8_t* src =
+                        src_digits.data() + (i % N_INPUTS) * N_DIGIT_VALUES;
+                    float* dst = dst_digit.data();
+                    random_transforms.sample(rng, { &params, 1 });
+                    digit_rec::apply_transforms(
+                        { &src, 1 },
+                        { &params, 1 },
+                        { &dst, 1 }
+                    );
+                }
+            )
+        );
+    }
+
+    void App::benchmark_synthetic_digits()
+    {
+        digit_rec::SyntheticDigits synthetic_digits;
+        std::array<float, N_DIGIT_VALUES> dst_digit;
+
+        print_result(
+            "SyntheticDigits::generate()",
+            measure([&](size_t i)
+                {
+                    synthetic_digits.generate(
+                        rng,
+                        (uint32_t)(i % 10u),
+                        dst_digit.data()
+                    );
+                }
+            )
+        );
+    }
+
+    template<typename Fn>
+    App::Result App::measure(Fn&& fn)
+    {
+        for (size_t i = 0; i < N_WARMUP_ITERATIONS; i++)
+        {
+            fn(i);
+        }
+
+        Result result;
+
+        // the counters are only opened here so that they don't count
+        // anything outside the measured runs.
+        std::optional<perf::Counters> counters;
+        if (use_perf_counters)
+        {
+            counters.emplace();
+            counters->start();
+        }
+
+        const auto start_time = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < N_ITERATIONS; i++)
+        {
+            fn(i);
+        }
+        const auto end_time = std::chrono::steady_clock::now();
+
+        if (counters)
+        {
+            result.counters = counters->stop();
+        }
+
+        result.ns_per_sample = std::chrono::duration<double, std::nano>(
+            end_time - start_time
+        ).count() / (double)N_ITERATIONS;
+
+        return result;
+    }
+
+    void App::print_header()
+    {
+        std::cout << std::format("{:<56}{:>12}", "benchmark", "ns/sample");
+        if (use_perf_counters)
+        {
+            std::cout << std::format(
+                "{:>8}{:>14}{:>14}{:>14}",
+                "IPC",
+                "L1D miss/smp",
+                "LLC miss/smp",
+                "br miss/smp"
+            );
+        }
+        std::cout << '\n';
+    }
+
+    void App::print_result(std::string_view name, const Result& result)
+    {
+        std::cout << std::format(
+            "{:<56}{:>12.1f}",
+            name,
+            result.ns_per_sample
+        );
+
+        if (use_perf_counters)
+        {
+            const auto& c = result.counters;
+
+            if (c.has(perf::Counter::Cycles)
+                && c.has(perf::Counter::Instructions)
+                && c[perf::Counter::Cycles] > 0)
+            {
+                std::cout << std::format(
+                    "{:>8.2f}",
+                    (double)c[perf::Counter::Instructions]
+                    / (double)c[perf::Counter::Cycles]
+                );
+            }
+            else
+            {
+                std::cout << std::format("{:>8}", "-");
+            }
+
+            for (auto counter : {
+                perf::Counter::L1dMisses,
+                perf::Counter::LlcMisses,
+                perf::Counter::BranchMisses
+                })
+            {
+                if (c.has(counter))
+                {
+                    std::cout << std::format(
+                        "{:>14.2f}",
+                        (double)c[counter] / (double)N_ITERATIONS
+                    );
+                }
+                else
+                {
+                    std::cout << std::format("{:>14}", "-");
+                }
+            }
+        }
+
+        std::cout << '\n';
+    }
+
+    std::span<const float> App::input(size_t idx) const
+    {
+        return std::span<const float>(
+            inputs.data() + (idx % N_INPUTS) * N_DIGIT_VALUES,
+            N_DIGIT_VALUES
+        );
+    }
+
+}
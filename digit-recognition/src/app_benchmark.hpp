@@ -0,0 +1,83 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <format>
+#include <optional>
+#include <array>
+#include <vector>
+#include <span>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <cstdint>
+
+#include "neural.hpp"
+#include "half_network.hpp"
+#include "perf_counters.hpp"
+#include "app_digit_rec.hpp"
+
+// micro-benchmarks for the neural network kernels and the data augmentation,
+// printed as a table to the standard output. this doesn't need the MNIST
+// dataset, it uses synthetic inputs with roughly the same number of nonzero
+// pixels as MNIST digits instead.
+namespace benchmark
+{
+
+    class App
+    {
+    public:
+        // if use_perf_counters is true, hardware performance counters are read
+        // around every benchmark (Linux only).
+        App(bool use_perf_counters);
+
+        void run();
+
+    private:
+        static constexpr uint32_t SEED = 7654321u;
+
+        // number of distinct inputs the benchmarks cycle through
+        static constexpr size_t N_INPUTS = 256;
+
+        // fraction of the pixels in a synthetic input that aren't 0
+        static constexpr float INPUT_DENSITY = .19f;
+
+        static constexpr size_t N_WARMUP_ITERATIONS = 1000;
+        static constexpr size_t N_ITERATIONS = 20000;
+
+        struct Result
+        {
+            double ns_per_sample = 0.;
+            perf::Readings counters;
+        };
+
+        bool use_perf_counters;
+        std::mt19937 rng;
+
+        std::vector<float> inputs;
+        std::vector<size_t> labels;
+
+        void generate_inputs();
+
+        void benchmark_network(const std::vector<size_t>& layer_sizes);
+
+        template<typename StaticNetType>
+        void benchmark_static_network();
+        void benchmark_random_transform();
+        void benchmark_synthetic_digits();
+
+        // run fn(i) N_WARMUP_ITERATIONS times, then measure N_ITERATIONS more
+        // runs.
+        template<typename Fn>
+        Result measure(Fn&& fn);
+
+        void print_header();
+        void print_result(std::string_view name, const Result& result);
+
+        std::span<const float> input(size_t idx) const;
+
+    };
+
+}
@@ -54,14 +54,879 @@ namespace digit_rec
         ));
     }
 
+    void load_digit_samples(
+        std::string_view images_path,
+        std::string_view labels_path,
+        std::vector<DigitSample>& out_samples
+    )
+    {
+        auto stream_images = stream::open_binary_file(images_path);
+        auto stream_labels = stream::open_binary_file(labels_path);
+
+        int32_t magic_images = stream::read_bigend<int32_t>(stream_images);
+        if (magic_images != 2051u)
+        {
+            throw std::runtime_error(
+                "invalid magic number, make sure your files aren't corrupted"
+            );
+        }
+
+        int32_t magic_labels = stream::read_bigend<int32_t>(stream_labels);
+        if (magic_labels != 2049u)
+        {
+            throw std::runtime_error(
+                "invalid magic number, make sure your files aren't corrupted"
+            );
+        }
+
+        int32_t n_items = stream::read_bigend<int32_t>(stream_images);
+        int32_t n_items_labels = stream::read_bigend<int32_t>(stream_labels);
+        if (n_items != n_items_labels)
+        {
+            throw std::runtime_error(
+                "item counts don't match in images and labels"
+            );
+        }
+
+        int32_t image_width = stream::read_bigend<int32_t>(stream_images);
+        int32_t image_height = stream::read_bigend<int32_t>(stream_images);
+        if (image_width != DIGIT_WIDTH || image_height != DIGIT_HEIGHT)
+        {
+            throw std::runtime_error(std::format(
+                "invalid image dimensions {}x{}, expected {}x{}",
+                image_width, image_height, DIGIT_WIDTH, DIGIT_HEIGHT
+            ));
+        }
+
+        size_t prev_size = out_samples.size();
+        out_samples.resize(prev_size + n_items);
+        for (size_t i = prev_size; i < out_samples.size(); i++)
+        {
+            stream::read<uint8_t>(
+                stream_images,
+                out_samples[i].values.data(),
+                N_DIGIT_VALUES
+            );
+            out_samples[i].label = stream::read<uint8_t>(stream_labels);
+        }
+    }
+
+    void save_digit_samples(
+        std::string_view images_path,
+        std::string_view labels_path,
+        const std::vector<DigitSample>& samples
+    )
+    {
+        std::ofstream stream_images(
+            std::filesystem::path(images_path),
+            std::ios::out | std::ios::binary | std::ios::trunc
+        );
+        std::ofstream stream_labels(
+            std::filesystem::path(labels_path),
+            std::ios::out | std::ios::binary | std::ios::trunc
+        );
+        if (!stream_images || !stream_labels)
+        {
+            throw std::runtime_error(std::format(
+                "couldn't open \"{}\" or \"{}\" for writing",
+                images_path,
+                labels_path
+            ));
+        }
+
+        stream::write_bigend<int32_t>(stream_images, 2051);
+        stream::write_bigend<int32_t>(stream_labels, 2049);
+
+        stream::write_bigend<int32_t>(stream_images, (int32_t)samples.size());
+        stream::write_bigend<int32_t>(stream_labels, (int32_t)samples.size());
+
+        stream::write_bigend<int32_t>(stream_images, (int32_t)DIGIT_WIDTH);
+        stream::write_bigend<int32_t>(stream_images, (int32_t)DIGIT_HEIGHT);
+
+        for (const auto& samp : samples)
+        {
+            stream::write<uint8_t>(
+                stream_images,
+                samp.values.data(),
+                N_DIGIT_VALUES
+            );
+            const uint8_t label = (uint8_t)samp.label;
+            stream::write<uint8_t>(stream_labels, &label, 1u);
+        }
+    }
+
+    std::optional<std::string> parse_layer_sizes(
+        std::string_view s,
+        std::vector<size_t>& out_layer_sizes
+    )
+    {
+        std::vector<int64_t> layer_sizes_i64;
+        for (auto& elem : str::split(std::string(s), ","))
+        {
+            str::trim_inplace(elem);
+            try
+            {
+                layer_sizes_i64.push_back(std::stoll(elem));
+            }
+            catch (const std::exception&)
+            {
+                return
+                    "Layer sizes must be a list of positive integers "
+                    "separated by commas.";
+            }
+        }
+
+        std::vector<size_t> layer_sizes;
+        for (auto layer_size_i64 : layer_sizes_i64)
+        {
+            if (layer_size_i64 < 0)
+            {
+                return "Layer sizes can't be negative.";
+            }
+            else if (layer_size_i64 < 1)
+            {
+                return "A layer must contain at least 1 node / neuron.";
+            }
+            layer_sizes.push_back((size_t)layer_size_i64);
+        }
+
+        if (layer_sizes.size() < 2u)
+        {
+            return "There should be at least 2 layers (input and output).";
+        }
+        if (layer_sizes.size() > 10u)
+        {
+            return "Too many layers.";
+        }
+
+        if (layer_sizes[0] != N_DIGIT_VALUES)
+        {
+            return std::format(
+                "The size of the first layer (input) must always be {}.",
+                N_DIGIT_VALUES
+            );
+        }
+        if (layer_sizes.back() != 10)
+        {
+            return "The size of the last layer (output) must always be 10.";
+        }
+
+        for (size_t i = 1; i < layer_sizes.size() - 1u; i++)
+        {
+            if (layer_sizes[i] > 64)
+            {
+                return "The maximum size for a hidden layer is 64.";
+            }
+        }
+
+        out_layer_sizes = std::move(layer_sizes);
+        return std::nullopt;
+    }
+
+    void make_activation_fns(
+        size_t n_layers,
+        ActivationFunc hidden_activation,
+        ActivationFunc output_activation,
+        std::vector<std::function<float(float)>>& out_activation_fns,
+        std::vector<std::function<float(float)>>& out_activation_derivs
+    )
+    {
+        out_activation_fns.clear();
+        out_activation_derivs.clear();
+
+        // hidden layer activation functions
+        if (n_layers > 2u)
+        {
+            std::function<float(float)> func;
+            std::function<float(float)> deriv;
+            switch (hidden_activation)
+            {
+            case digit_rec::ActivationFunc::Relu:
+                func = neural::relu<float>;
+                deriv = neural::relu_deriv<float>;
+                break;
+            case digit_rec::ActivationFunc::LeakyRelu:
+                func = neural::leaky_relu<float, .01f>;
+                deriv = neural::leaky_relu_deriv<float, .01f>;
+                break;
+            case digit_rec::ActivationFunc::Tanh:
+                func = neural::tanh<float>;
+                deriv = neural::tanh_deriv<float>;
+                break;
+            default:
+                break;
+            }
+
+            for (size_t i = 0; i < n_layers - 2u; i++)
+            {
+                out_activation_fns.push_back(func);
+                out_activation_derivs.push_back(deriv);
+            }
+        }
+
+        // output layer activation function
+        switch (output_activation)
+        {
+        case digit_rec::ActivationFunc::Relu:
+            out_activation_fns.push_back(neural::relu<float>);
+            out_activation_derivs.push_back(neural::relu_deriv<float>);
+            break;
+        case digit_rec::ActivationFunc::LeakyRelu:
+            out_activation_fns.push_back(neural::leaky_relu<float, .01f>);
+            out_activation_derivs.push_back(
+                neural::leaky_relu_deriv<float, .01f>
+            );
+            break;
+        case digit_rec::ActivationFunc::Tanh:
+            out_activation_fns.push_back(neural::tanh<float>);
+            out_activation_derivs.push_back(neural::tanh_deriv<float>);
+            break;
+        default:
+            break;
+        }
+    }
+
+    RandomTransforms::RandomTransforms(uint32_t seed)
+        : displacement_fields(N_DISPLACEMENT_FIELDS * 2u * N_DIGIT_VALUES)
+    {
+        static constexpr int32_t W = (int32_t)DIGIT_WIDTH;
+        static constexpr int32_t H = (int32_t)DIGIT_HEIGHT;
+
+        // gaussian kernel for smoothing the fields. it doesn't need to be
+        // normalized since the fields are normalized at the end.
+        static constexpr int32_t RADIUS = (int32_t)(3.f * DISPLACEMENT_SIGMA);
+        std::array<float, 2 * RADIUS + 1> kernel;
+        for (int32_t k = -RADIUS; k <= RADIUS; k++)
+        {
+            kernel[k + RADIUS] = std::exp(
+                -.5f * (float)(k * k)
+                / (DISPLACEMENT_SIGMA * DISPLACEMENT_SIGMA)
+            );
+        }
+
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> dist(-1.f, 1.f);
+
+        std::vector<float> noise(N_DIGIT_VALUES);
+        std::vector<float> blurred_rows(N_DIGIT_VALUES);
+        for (size_t f = 0; f < N_DISPLACEMENT_FIELDS; f++)
+        {
+            float* field =
+                displacement_fields.data() + f * 2u * N_DIGIT_VALUES;
+
+            // random offsets for every axis, blurred horizontally and then
+            // vertically (clamping to the edges of the image)
+            for (size_t axis = 0; axis < 2u; axis++)
+            {
+                for (auto& v : noise)
+                {
+                    v = dist(rng);
+                }
+
+                for (int32_t y = 0; y < H; y++)
+                {
+                    for (int32_t x = 0; x < W; x++)
+                    {
+                        float sum = 0.f;
+                        for (int32_t k = -RADIUS; k <= RADIUS; k++)
+                        {
+                            const int32_t sx = std::clamp(x + k, 0, W - 1);
+                            sum += kernel[k + RADIUS] * noise[y * W + sx];
+                        }
+                        blurred_rows[y * W + x] = sum;
+                    }
+                }
+
+                for (int32_t y = 0; y < H; y++)
+                {
+                    for (int32_t x = 0; x < W; x++)
+                    {
+                        float sum = 0.f;
+                        for (int32_t k = -RADIUS; k <= RADIUS; k++)
+                        {
+                            const int32_t sy = std::clamp(y + k, 0, H - 1);
+                            sum += kernel[k + RADIUS]
+                                * blurred_rows[sy * W + x];
+                        }
+                        field[(y * W + x) * 2 + axis] = sum;
+                    }
+                }
+            }
+
+            // make the longest offset 1 pixel long
+            float max_len_sq = 0.f;
+            for (size_t i = 0; i < N_DIGIT_VALUES; i++)
+            {
+                max_len_sq = std::max(
+                    max_len_sq,
+                    field[i * 2u] * field[i * 2u]
+                    + field[i * 2u + 1u] * field[i * 2u + 1u]
+                );
+            }
+            if (max_len_sq > 0.f)
+            {
+                const float inv_len = 1.f / std::sqrt(max_len_sq);
+                for (size_t i = 0; i < 2u * N_DIGIT_VALUES; i++)
+                {
+                    field[i] *= inv_len;
+                }
+            }
+        }
+    }
+
+    void apply_transforms(
+        std::span<const uint8_t* const> src_digits,
+        std::span<const TransformParams> params,
+        std::span<float* const> dst_digits
+    )
+    {
+        if (params.size() != src_digits.size()
+            || dst_digits.size() != src_digits.size())
+        {
+            throw std::invalid_argument(
+                "the number of sources, parameters, and destinations must "
+                "match"
+            );
+        }
+
+        static constexpr float U8_TO_FLOAT = 1.f / 255.f;
+        static constexpr int32_t W = (int32_t)DIGIT_WIDTH;
+        static constexpr int32_t H = (int32_t)DIGIT_HEIGHT;
+
+        // larger than any distance of a sampled coordinate outside the image
+        static constexpr int32_t FLOOR_BIAS = 4 * std::max(W, H);
+
+        for (size_t d = 0; d < src_digits.size(); d++)
+        {
+            const uint8_t* src = src_digits[d];
+            float* dst = dst_digits[d];
+            const TransformParams& p = params[d];
+
+            const float value_scale = U8_TO_FLOAT * p.gain;
+            if (!p.resample)
+            {
+                for (size_t i = 0; i < N_DIGIT_VALUES; i++)
+                {
+                    dst[i] = (float)src[i] * value_scale;
+                }
+            }
+            else
+            {
+                // source pixel, or 0 outside the image
+                auto fetch = [src](int32_t x, int32_t y) -> float
+                    {
+                        if (x < 0 || x >= W || y < 0 || y >= H)
+                        {
+                            return 0.f;
+                        }
+                        return (float)src[y * W + x];
+                    };
+
+                const float* disp = p.displacement;
+                const float disp_scale = p.displacement_scale;
+
+                for (int32_t y = 0; y < H; y++)
+                {
+                    float coord_x = p.xy * (float)y + p.x0;
+                    float coord_y = p.yy * (float)y + p.y0;
+                    for (int32_t x = 0; x < W; x++)
+                    {
+                        float sample_x = coord_x;
+                        float sample_y = coord_y;
+                        if (disp)
+                        {
+                            const size_t i = (size_t)(y * W + x) * 2u;
+                            sample_x += disp_scale * disp[i];
+                            sample_y += disp_scale * disp[i + 1u];
+                        }
+
+                        // sample from src with bilinear interpolation. the
+                        // coordinates are moved to positive numbers so that
+                        // truncating them is the same as std::floor().
+                        const int32_t ix =
+                            (int32_t)(sample_x + FLOOR_BIAS) - FLOOR_BIAS;
+                        const int32_t iy =
+                            (int32_t)(sample_y + FLOOR_BIAS) - FLOOR_BIAS;
+                        const float fx = (float)ix;
+                        const float fy = (float)iy;
+
+                        float tl, tr, bl, br;
+                        if (ix >= 0 && ix < W - 1 && iy >= 0 && iy < H - 1)
+                        {
+                            const uint8_t* s = src + iy * W + ix;
+                            tl = (float)s[0];
+                            tr = (float)s[1];
+                            bl = (float)s[W];
+                            br = (float)s[W + 1];
+                        }
+                        else
+                        {
+                            tl = fetch(ix, iy);
+                            tr = fetch(ix + 1, iy);
+                            bl = fetch(ix, iy + 1);
+                            br = fetch(ix + 1, iy + 1);
+                        }
+
+                        const float horiz_mix = sample_x - fx;
+                        dst[y * W + x] = value_scale * math::mix(
+                            math::mix(tl, tr, horiz_mix),
+                            math::mix(bl, br, horiz_mix),
+                            sample_y - fy
+                        );
+
+                        coord_x += p.xx;
+                        coord_y += p.yx;
+                    }
+                }
+            }
+
+            // thicken or thin the strokes by mixing every pixel with the
+            // highest or lowest value in its 4-neighborhood
+            if (p.thickness != 0.f)
+            {
+                float orig[N_DIGIT_VALUES];
+                std::copy(dst, dst + N_DIGIT_VALUES, orig);
+
+                const bool thicken = p.thickness > 0.f;
+                const float amount = std::abs(p.thickness);
+                for (int32_t y = 0; y < H; y++)
+                {
+                    for (int32_t x = 0; x < W; x++)
+                    {
+                        const int32_t i = y * W + x;
+                        float v = orig[i];
+                        float ext = v;
+                        auto visit = [&](int32_t j)
+                            {
+                                ext = thicken
+                                    ? std::max(ext, orig[j])
+                                    : std::min(ext, orig[j]);
+                            };
+                        if (x > 0)
+                            visit(i - 1);
+                        if (x < W - 1)
+                            visit(i + 1);
+                        if (y > 0)
+                            visit(i - W);
+                        if (y < H - 1)
+                            visit(i + W);
+
+                        dst[i] = v + amount * (ext - v);
+                    }
+                }
+            }
+
+            // values can only go above 1 with a higher contrast
+            if (p.gain > 1.f)
+            {
+                for (size_t i = 0; i < N_DIGIT_VALUES; i++)
+                {
+                    dst[i] = std::min(dst[i], 1.f);
+                }
+            }
+
+            // add noise to some of the pixels
+            for (size_t i = 0; i < p.n_noisy_pixels; i++)
+            {
+                float& pixel = dst[p.noise_idx[i]];
+                pixel = std::clamp(pixel + p.noise[i], 0.f, 1.f);
+            }
+        }
+    }
+
+    void load_training_batch(
+        const std::vector<DigitSample>& samples,
+        std::mt19937& rng_pick_sample,
+        std::mt19937& rng_random_transforms,
+        const RandomTransforms* random_transforms,
+        float* input_data,
+        std::span<neural::LabeledInput<float>> out_batch,
+        const SyntheticDigits* synthetic_digits,
+        float synthetic_ratio
+    )
+    {
+        TRACE_SCOPE("Load Batch");
+
+        // the batch is loaded in chunks so that the source images and the
+        // transformations fit on the stack. params stays at the defaults
+        // (only converting the values) if random_transforms isn't given.
+        static constexpr size_t CHUNK_SIZE = 32;
+        std::array<const uint8_t*, CHUNK_SIZE> src_digits;
+        std::array<float*, CHUNK_SIZE> dst_digits;
+        std::array<TransformParams, CHUNK_SIZE> params;
+        std::array<size_t, CHUNK_SIZE> synthetic_idx;
+
+        std::uniform_int_distribution<size_t> idx_dist(0, samples.size() - 1u);
+        std::uniform_real_distribution<float> synthetic_dist(0.f, 1.f);
+
+        // rng_pick_sample is only used for picking synthetic digits when
+        // synthetic_ratio is above 0 so that runs without them don't change.
+        const bool use_synthetic = synthetic_digits && synthetic_ratio > 0.f;
+
+        for (size_t chunk_begin = 0;
+            chunk_begin < out_batch.size();
+            chunk_begin += CHUNK_SIZE)
+        {
+            const size_t chunk_end =
+                std::min(chunk_begin + CHUNK_SIZE, out_batch.size());
+
+            // randomly pick digit samples from the dataset, or synthetic
+            // digits instead
+            size_t n_picked = 0;
+            size_t n_synthetic = 0;
+            {
+                PROFILE_SCOPE(PickSample);
+                for (size_t i = chunk_begin; i < chunk_end; i++)
+                {
+                    if (use_synthetic
+                        && synthetic_dist(rng_pick_sample) < synthetic_ratio)
+                    {
+                        synthetic_idx[n_synthetic++] = i;
+                        continue;
+                    }
+
+                    const auto& samp = samples[idx_dist(rng_pick_sample)];
+                    src_digits[n_picked] = samp.values.data();
+                    dst_digits[n_picked] = input_data + i * N_DIGIT_VALUES;
+                    out_batch[i].label = samp.label;
+                    n_picked++;
+                }
+            }
+
+            if (n_synthetic > 0u)
+            {
+                PROFILE_SCOPE(SynthesizeDigit);
+                TRACE_SCOPE("Synthesize");
+                for (size_t k = 0; k < n_synthetic; k++)
+                {
+                    const size_t i = synthetic_idx[k];
+                    out_batch[i].label = synthetic_digits->generate(
+                        rng_random_transforms,
+                        input_data + i * N_DIGIT_VALUES
+                    );
+                }
+            }
+
+            // update input data, randomly transforming it if needed
+            const std::span<TransformParams> chunk_params(
+                params.data(),
+                n_picked
+            );
+            if (random_transforms)
+            {
+                PROFILE_SCOPE(RandomTransform);
+                TRACE_SCOPE("Augment");
+                random_transforms->sample(rng_random_transforms, chunk_params);
+                apply_transforms(
+                    std::span(src_digits.data(), n_picked),
+                    chunk_params,
+                    std::span(dst_digits.data(), n_picked)
+                );
+            }
+            else
+            {
+                PROFILE_SCOPE(ConvertInput);
+                apply_transforms(
+                    std::span(src_digits.data(), n_picked),
+                    chunk_params,
+                    std::span(dst_digits.data(), n_picked)
+                );
+            }
+        }
+    }
+
+    PixelRect draw_stroke_segment(
+        float* image,
+        float start_u,
+        float start_v,
+        float end_u,
+        float end_v,
+        float inner_radius,
+        float outer_radius
+    )
+    {
+        static constexpr float DIGIT_HALF_WIDTH = .5f * (float)DIGIT_WIDTH;
+        static constexpr float DIGIT_HALF_HEIGHT = .5f * (float)DIGIT_HEIGHT;
+
+        static constexpr float DIGIT_MAX_DIM =
+            (float)std::max(DIGIT_WIDTH, DIGIT_HEIGHT);
+        static constexpr float DIGIT_MAX_DIM_INV = 1.f / DIGIT_MAX_DIM;
+
+        // pixel coordinates of the stroke's bounding box. a pixel's UV
+        // coordinates are at its center.
+        static constexpr float UV_TO_PIXELS = .5f * DIGIT_MAX_DIM;
+        const PixelRect bounds{
+            std::max(
+                (int32_t)std::floor(
+                    (std::min(start_u, end_u) - outer_radius)
+                    * UV_TO_PIXELS + DIGIT_HALF_WIDTH - .5f
+                ),
+                0
+            ),
+            std::max(
+                (int32_t)std::floor(
+                    (std::min(start_v, end_v) - outer_radius)
+                    * UV_TO_PIXELS + DIGIT_HALF_HEIGHT - .5f
+                ),
+                0
+            ),
+            std::min(
+                (int32_t)std::ceil(
+                    (std::max(start_u, end_u) + outer_radius)
+                    * UV_TO_PIXELS + DIGIT_HALF_WIDTH - .5f
+                ) + 1,
+                (int32_t)DIGIT_WIDTH
+            ),
+            std::min(
+                (int32_t)std::ceil(
+                    (std::max(start_v, end_v) + outer_radius)
+                    * UV_TO_PIXELS + DIGIT_HALF_HEIGHT - .5f
+                ) + 1,
+                (int32_t)DIGIT_HEIGHT
+            )
+        };
+
+        // draw line segment using signed distance fields
+        // see https://iquilezles.org/articles/distfunctions2d/
+        PixelRect changed;
+        for (int32_t y = bounds.min_y; y < bounds.max_y; y++)
+        {
+            for (int32_t x = bounds.min_x; x < bounds.max_x; x++)
+            {
+                // UV coordinates from -1 to +1. (0, 0) is the center.
+                float u = (float)x + .5f - DIGIT_HALF_WIDTH;
+                float v = (float)y + .5f - DIGIT_HALF_HEIGHT;
+                u *= DIGIT_MAX_DIM_INV * 2.f;
+                v *= DIGIT_MAX_DIM_INV * 2.f;
+
+                // distance of UV from the line segment
+                float dist = math::dist_segment(
+                    u, v,
+                    start_u, start_v,
+                    end_u, end_v
+                );
+
+                // target value for this pixel, which gets brighter as UV gets
+                // closer to the line segment.
+                float target_v = math::remap01(
+                    dist,
+                    outer_radius,
+                    inner_radius
+                );
+                target_v *= target_v;
+
+                // take the maximum of the current and target values
+                float& pixel = image[y * DIGIT_WIDTH + x];
+                if (target_v > pixel)
+                {
+                    pixel = target_v;
+                    changed.add({ x, y, x + 1, y + 1 });
+                }
+            }
+        }
+        return changed;
+    }
+
+    App::App()
+    {
+        sprintf_s(
+            val_layer_sizes,
+            sizeof(val_layer_sizes) / sizeof(char),
+            "%zu, 24, 16, 10",
+            N_DIGIT_VALUES
+        );
+    }
+
     void App::run()
     {
+        TRACE_THREAD_NAME("Main");
+
         init();
         while (!glfwWindowShouldClose(window))
         {
-            loop();
+            loop();
+        }
+        cleanup();
+    }
+
+    void App::run_headless(uint64_t duration_seconds, uint32_t n_threads)
+    {
+        TRACE_THREAD_NAME("Main");
+
+        load_digit_samples(TRAIN_IMAGES_PATH, TRAIN_LABELS_PATH, train_samples);
+        load_digit_samples(TEST_IMAGES_PATH, TEST_LABELS_PATH, test_samples);
+        if (train_samples.size() < 100u || test_samples.size() < 100u)
+        {
+            throw std::runtime_error(std::format(
+                "the number of training or test samples is extremely low "
+                "(training samples: {}, test samples: {})",
+                train_samples.size(),
+                test_samples.size()
+            ));
+        }
+
+        val_n_worker_threads = std::max(n_threads, 1u);
+        val_batch_size = std::max(val_batch_size, val_n_worker_threads);
+
+        auto result = prepare_for_training();
+        if (result.has_value())
+        {
+            throw std::runtime_error(result.value());
         }
-        cleanup();
+
+        std::cout << std::format(
+            "training {} with a batch size of {} on {} thread(s) (seed: {})\n",
+            val_layer_sizes,
+            val_batch_size,
+            val_n_worker_threads,
+            val_seed
+        );
+
+        const auto start_time = std::chrono::steady_clock::now();
+        start_training_thread(true);
+
+        // print new metrics samples as they come in
+        std::vector<metrics::Sample> samples;
+        uint64_t last_reported_step = 0;
+        bool reported_anything = false;
+        while (duration_seconds == 0
+            || std::chrono::steady_clock::now() - start_time
+            < std::chrono::seconds(duration_seconds))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(250));
+
+            metrics_history.read(samples);
+            for (const auto& samp : samples)
+            {
+                if (reported_anything && samp.step <= last_reported_step)
+                {
+                    continue;
+                }
+                reported_anything = true;
+                last_reported_step = samp.step;
+
+                std::cout << std::format(
+                    "step {:>10} | {:>8.1f} s | accuracy {:>5.1f}%",
+                    samp.step,
+                    samp.wall_time,
+                    samp.accuracy * 100.f
+                );
+                if (!std::isnan(samp.training_accuracy))
+                {
+                    std::cout << std::format(
+                        " | training accuracy {:>5.1f}% | training cost {:.4f}",
+                        samp.training_accuracy * 100.f,
+                        samp.training_cost
+                    );
+                }
+                std::cout << std::format(
+                    " | {:.0f} steps/s | {:.0f} samples/s | {:.2f} GFLOP/s"
+                    " | eval {:.0f} ms\n",
+                    samp.steps_per_second,
+                    samp.samples_per_second,
+                    samp.gflops,
+                    samp.eval_seconds * 1000.f
+                );
+            }
+
+            // print the stage timings as a single line of JSON
+            if constexpr (profiler::ENABLED)
+            {
+                const auto totals = profiler::totals();
+
+                std::string json = "{\"profile\":{";
+                for (size_t i = 0; i < profiler::N_STAGES; i++)
+                {
+                    if (i != 0)
+                        json += ",";
+                    json += std::format(
+                        "\"{}\":{{\"ns\":{},\"calls\":{}}}",
+                        profiler::Stage_id[i],
+                        totals[i].nanoseconds,
+                        totals[i].n_calls
+                    );
+                }
+                json += "}}";
+
+                std::cout << json << '\n';
+            }
+        }
+
+        stop_training_thread();
+
+        if constexpr (trace::ENABLED)
+        {
+            trace::write_json(TRACE_PATH);
+            std::cout << std::format("trace written to {}\n", TRACE_PATH);
+        }
+    }
+
+    void App::run_synthesize(uint64_t n_samples, uint32_t n_threads)
+    {
+        TRACE_THREAD_NAME("Main");
+
+        // number of samples generated by one task, each with its own random
+        // number generator so that the output doesn't depend on n_threads
+        static constexpr size_t GRAIN_SIZE = 4096;
+
+        n_threads = std::max(n_threads, 1u);
+        std::cout << std::format(
+            "synthesizing {} digits on {} thread(s) (seed: {})\n",
+            n_samples,
+            n_threads,
+            val_seed
+        );
+
+        std::vector<DigitSample> samples(n_samples);
+        tasks::Pool pool(n_threads);
+
+        const auto start_time = std::chrono::steady_clock::now();
+        tasks::parallel_for(
+            pool,
+            0,
+            samples.size(),
+            GRAIN_SIZE,
+            [this, &samples](size_t begin, size_t end)
+            {
+                std::mt19937 rng(val_seed + (uint32_t)(begin / GRAIN_SIZE));
+                float image[N_DIGIT_VALUES];
+                for (size_t i = begin; i < end; i++)
+                {
+                    auto& samp = samples[i];
+                    samp.label = synthetic_digits.generate(
+                        rng,
+                        image
+                    );
+                    for (size_t j = 0; j < N_DIGIT_VALUES; j++)
+                    {
+                        samp.values[j] = (uint8_t)std::round(
+                            std::clamp(image[j], 0.f, 1.f) * 255.f
+                        );
+                    }
+                }
+            }
+        );
+        const double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start_time
+        ).count();
+
+        std::cout << std::format(
+            "synthesized {} digits in {:.3f} s ({:.2f} million per minute)\n",
+            n_samples,
+            seconds,
+            seconds > 0. ? (double)n_samples / seconds * 60. / 1e6 : 0.
+        );
+
+        save_digit_samples(
+            SYNTHETIC_IMAGES_PATH,
+            SYNTHETIC_LABELS_PATH,
+            samples
+        );
+        std::cout << std::format(
+            "saved to {} and {}\n",
+            SYNTHETIC_IMAGES_PATH,
+            SYNTHETIC_LABELS_PATH
+        );
     }
 
     void App::init()
@@ -106,6 +971,7 @@ namespace digit_rec
 
     void App::loop()
     {
+        TRACE_SCOPE("Frame");
         draw_ui();
     }
 
@@ -241,6 +1107,12 @@ namespace digit_rec
             throw std::runtime_error("failed to create window");
         }
 
+        // follow the cursor between the frames for drawing. this must be
+        // set before ImGui installs its callbacks so that they're chained.
+        glfwSetWindowUserPointer(window, this);
+        glfwSetCursorPosCallback(window, cursor_pos_callback);
+        drawboard_cursor_path.reserve(MAX_CURSOR_PATH_SIZE);
+
         // make the window's context current and enable VSync
         glfwMakeContextCurrent(window);
         glfwSwapInterval(1);
@@ -389,17 +1261,6 @@ namespace digit_rec
 
         ImGui::NewLine();
 
-        static bool init_val_layer_sizes = false;
-        if (!init_val_layer_sizes)
-        {
-            init_val_layer_sizes = true;
-            sprintf_s(
-                val_layer_sizes,
-                sizeof(val_layer_sizes) / sizeof(char),
-                "%zu, 24, 16, 10",
-                N_DIGIT_VALUES
-            );
-        }
         ImGui::SameLine(column_0_start);
         ImGui::SetNextItemWidth(column_width);
         ImGui::InputText("##layersizes", val_layer_sizes, 64);
@@ -499,6 +1360,153 @@ namespace digit_rec
             &val_random_transform
         );
 
+        ImGui::SameLine(column_1_start);
+        ImGui::SetNextItemWidth(column_width);
+        ImGui::Checkbox(
+            "Record Training Metrics",
+            &val_record_training_metrics
+        );
+
+        ImGui::NewLine();
+        ImGui::NewLine();
+
+        //
+
+        ImGui::SameLine(column_0_start);
+        ImGui::SetNextItemWidth(column_width);
+        ImGui::Text("Inference Precision");
+        draw_info_icon_at_end_of_current_line();
+        if (ImGui::IsItemHovered())
+        {
+            ImGui::SetTooltip(
+                "Format of the weights and biases used for evaluating the "
+                "accuracy\nand the drawboard. Training always uses FP32."
+            );
+        }
+
+        ImGui::SameLine(column_1_start);
+        ImGui::SetNextItemWidth(column_width);
+        ImGui::Text("Worker Threads");
+        draw_info_icon_at_end_of_current_line();
+        if (ImGui::IsItemHovered())
+        {
+            ImGui::SetTooltip(
+                "Number of threads shared by training and evaluation. They're "
+                "pinned to CPUs\nspread over the NUMA nodes. With more than "
+                "1 thread, every batch is split\nbetween them and each NUMA "
+                "node (if there's more than one) gets its own\ncopy of the "
+                "dataset. The specialized networks are only used with 1 "
+                "thread."
+            );
+        }
+
+        ImGui::NewLine();
+
+        ImGui::SameLine(column_0_start);
+        ImGui::SetNextItemWidth(column_width);
+        ImGui::Combo(
+            "##inferenceprecision",
+            reinterpret_cast<int*>(&val_inference_precision),
+            InferencePrecision_str,
+            sizeof(InferencePrecision_str) / sizeof(InferencePrecision_str[0])
+        );
+
+        const uint32_t min_worker_threads = 1u;
+        const uint32_t max_worker_threads =
+            std::max(std::thread::hardware_concurrency(), 1u);
+
+        ImGui::SameLine(column_1_start);
+        ImGui::SetNextItemWidth(column_width);
+        ImGui::DragScalar(
+            "##workerthreads",
+            ImGuiDataType_U32,
+            &val_n_worker_threads,
+            .1f,
+            &min_worker_threads,
+            &max_worker_threads,
+            nullptr,
+            ImGuiSliderFlags_AlwaysClamp
+        );
+
+        ImGui::NewLine();
+
+        ImGui::SameLine(column_0_start);
+        ImGui::SetNextItemWidth(column_width);
+        ImGui::Text("Ensemble Mode");
+        draw_info_icon_at_end_of_current_line();
+        if (ImGui::IsItemHovered())
+        {
+            ImGui::SetTooltip(
+                "How the drawboard combines the outputs of the networks in "
+                "the ensemble\n(see Add to Ensemble): the average of their "
+                "outputs, or the fraction of\nthe networks that predict each "
+                "digit."
+            );
+        }
+
+        ImGui::SameLine(column_1_start);
+        ImGui::SetNextItemWidth(column_width);
+        ImGui::Text("Early Exits");
+        draw_info_icon_at_end_of_current_line();
+        if (ImGui::IsItemHovered())
+        {
+            ImGui::SetTooltip(
+                "Train a small classifier on every hidden layer along with "
+                "the network. The\ndrawboard and the evaluation then stop at "
+                "the first layer that's confident\nenough (FP32 only). "
+                "Training is single threaded and doesn't use the\n"
+                "specialized networks with this on."
+            );
+        }
+
+        ImGui::NewLine();
+
+        ImGui::SameLine(column_0_start);
+        ImGui::SetNextItemWidth(column_width);
+        ImGui::Combo(
+            "##ensemblemode",
+            reinterpret_cast<int*>(&val_ensemble_mode),
+            EnsembleMode_str,
+            sizeof(EnsembleMode_str) / sizeof(EnsembleMode_str[0])
+        );
+
+        ImGui::SameLine(column_1_start);
+        ImGui::SetNextItemWidth(column_width);
+        ImGui::Checkbox("Train Exit Heads", &val_early_exit);
+
+        ImGui::NewLine();
+        ImGui::NewLine();
+
+        //
+
+        ImGui::SameLine(column_0_start);
+        ImGui::SetNextItemWidth(column_width);
+        ImGui::Text("Synthetic Digits");
+        draw_info_icon_at_end_of_current_line();
+        if (ImGui::IsItemHovered())
+        {
+            ImGui::SetTooltip(
+                "Fraction of the training samples that are drawn with random "
+                "brush strokes\ninstead of being picked from the dataset, "
+                "using the same brush as the\ndrawboard. The test samples "
+                "always come from the dataset."
+            );
+        }
+
+        ImGui::NewLine();
+
+        ImGui::SameLine(column_0_start);
+        ImGui::SetNextItemWidth(column_width);
+        ImGui::DragFloat(
+            "##syntheticratio",
+            &val_synthetic_ratio,
+            .005f,
+            0.f,
+            1.f,
+            "%.3f",
+            ImGuiSliderFlags_AlwaysClamp
+        );
+
         //
 
         static std::string error_text = "";
@@ -591,14 +1599,30 @@ namespace digit_rec
             1.f - 2.f * WINDOW_PAD
         );
 
+        // copy the metrics written by the training thread
+        metrics_history.read(ui_metrics);
+
+        metrics::Sample latest_metrics;
+        const bool has_metrics = metrics_history.latest(latest_metrics);
+
         ImGui::SameLine(content_start);
-        if (accuracy_history.empty())
+        if (!has_metrics)
         {
             ImGui::Text("Accuracy: -");
         }
         else
         {
-            ImGui::Text("Accuracy: %.1f%%", accuracy_history.back() * 100.f);
+            ImGui::Text("Accuracy: %.1f%%", latest_metrics.accuracy * 100.f);
+        }
+
+        if (has_metrics && !std::isnan(latest_metrics.training_accuracy))
+        {
+            ImGui::SameLine();
+            ImGui::TextDisabled(
+                "(Training: %.1f%%, Cost: %.3f)",
+                latest_metrics.training_accuracy * 100.f,
+                latest_metrics.training_cost
+            );
         }
 
         draw_info_icon_at_end_of_current_line();
@@ -608,49 +1632,251 @@ namespace digit_rec
 
         //
 
+        update_live_throughput();
+
+        const float samples_per_second =
+            ui_steps_per_second * (float)val_batch_size;
+        const float gflops = samples_per_second
+            * (float)net->training_flops_per_sample() * 1e-9f;
+
+        ImGui::SameLine(content_start);
+        ImGui::TextDisabled(
+            "%.0f steps/s  |  %.0f samples/s  |  %.2f GFLOP/s  |  Eval: %s",
+            ui_steps_per_second,
+            samples_per_second,
+            gflops,
+            has_metrics
+            ? std::format("{:.0f} ms", latest_metrics.eval_seconds * 1000.f)
+            .c_str()
+            : "-"
+        );
+
+        ImGui::NewLine();
+
+        //
+
+        ImGui::SameLine(content_start);
+        ImGui::Text("Plot Against");
+
+        ImGui::SameLine(content_start + content_width * .5f);
+        ImGui::SetNextItemWidth(content_width * .5f);
+        ImGui::Combo(
+            "##plotaxis",
+            reinterpret_cast<int*>(&val_plot_axis),
+            PlotAxis_str,
+            sizeof(PlotAxis_str) / sizeof(PlotAxis_str[0])
+        );
+
+        ImGui::NewLine();
+
+        //
+
+        update_accuracy_plot();
+
         ImGui::SameLine(content_start);
         ImGui::SetNextItemWidth(content_width);
         ImGui::PlotLines(
             "##accuracyplot",
-            accuracy_history.data(),
-            (int)accuracy_history.size(),
+            ui_accuracy_plot.data(),
+            (int)ui_accuracy_plot.size(),
             0,
             (const char*)0,
             std::numeric_limits<float>::max(),
             std::numeric_limits<float>::max(),
-            ImVec2{ content_width, scaled(.485f) }
+            ImVec2{
+                content_width,
+                scaled(profiler::ENABLED ? .18f : .405f)
+            }
+        );
+
+        if constexpr (profiler::ENABLED)
+        {
+            layout_profiler_breakdown();
+        }
+
+        //
+
+        const float footer_height = scaled(.1f);
+        ImGui::SetNextWindowPos(
+            { 0.f, ImGui::GetWindowHeight() - footer_height }
+        );
+        ImGui::BeginChild(
+            "##footer_training",
+            { ImGui::GetWindowWidth(), footer_height },
+            0,
+            ImGuiWindowFlags_NoBackground
+            | ImGuiWindowFlags_NoCollapse
+            | ImGuiWindowFlags_NoSavedSettings
+        );
+        {
+            const float button_width = trace::ENABLED
+                ? content_width / 2.f - scaled(COLUMN_SPACING) * .5f
+                : content_width;
+
+            ImGui::SameLine(content_start);
+            if (ImGui::Button(
+                "Stop",
+                {
+                    button_width,
+                    scaled(.1f)
+                }
+            ))
+            {
+                stop_training_thread();
+                reset_drawboard();
+                ui_mode = UiMode::Drawboard;
+            }
+
+            if constexpr (trace::ENABLED)
+            {
+                ImGui::SameLine(0.f, scaled(COLUMN_SPACING));
+                if (ImGui::Button(
+                    "Save Trace",
+                    {
+                        button_width,
+                        scaled(.1f)
+                    }
+                ))
+                {
+                    try
+                    {
+                        trace::write_json(TRACE_PATH);
+                    }
+                    catch (const std::exception& e)
+                    {
+                        std::cerr << e.what() << '\n';
+                    }
+                }
+            }
+        }
+        ImGui::EndChild();
+    }
+
+    void App::update_live_throughput()
+    {
+        const auto now = std::chrono::steady_clock::now();
+        const auto elapsed = now - ui_throughput_last_time;
+        if (elapsed < std::chrono::milliseconds(THROUGHPUT_INTERVAL_MS))
+        {
+            return;
+        }
+
+        const uint64_t step = n_training_steps;
+        ui_steps_per_second = (float)(step - ui_throughput_last_step)
+            / std::chrono::duration<float>(elapsed).count();
+
+        ui_throughput_last_step = step;
+        ui_throughput_last_time = now;
+    }
+
+    void App::update_accuracy_plot()
+    {
+        const size_t n = ui_metrics.size();
+        ui_accuracy_plot.resize(n);
+
+        if (val_plot_axis == PlotAxis::Evaluation || n < 2u)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                ui_accuracy_plot[i] = ui_metrics[i].accuracy;
+            }
+            return;
+        }
+
+        auto x_of = [this](const metrics::Sample& samp)
+            {
+                if (val_plot_axis == PlotAxis::SamplesSeen)
+                    return (double)samp.samples_seen;
+                return (double)samp.wall_time;
+            };
+
+        // the samples aren't evenly spaced along this axis, but PlotLines()
+        // needs evenly spaced values, so we'll resample the accuracy at n
+        // evenly spaced points with linear interpolation.
+        const double x_first = x_of(ui_metrics.front());
+        const double x_last = x_of(ui_metrics.back());
+
+        size_t seg = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            const double x =
+                x_first + (x_last - x_first) * (double)i / (double)(n - 1u);
+
+            // x only increases, so the segment containing it never moves
+            // backwards.
+            while (seg + 2u < n && x_of(ui_metrics[seg + 1u]) < x)
+            {
+                seg++;
+            }
+
+            const double x0 = x_of(ui_metrics[seg]);
+            const double x1 = x_of(ui_metrics[seg + 1u]);
+            const double t = x1 > x0
+                ? std::clamp((x - x0) / (x1 - x0), 0., 1.)
+                : 1.;
+
+            ui_accuracy_plot[i] = math::mix(
+                ui_metrics[seg].accuracy,
+                ui_metrics[seg + 1u].accuracy,
+                (float)t
+            );
+        }
+    }
+
+    void App::layout_profiler_breakdown()
+    {
+        const float content_start = scaled(WINDOW_PAD);
+        const float content_width = scaled(
+            1.f - 2.f * WINDOW_PAD
         );
 
-        //
+        const auto totals = profiler::totals();
 
-        const float footer_height = scaled(.1f);
-        ImGui::SetNextWindowPos(
-            { 0.f, ImGui::GetWindowHeight() - footer_height }
-        );
-        ImGui::BeginChild(
-            "##footer_training",
-            { ImGui::GetWindowWidth(), footer_height },
-            0,
-            ImGuiWindowFlags_NoBackground
-            | ImGuiWindowFlags_NoCollapse
-            | ImGuiWindowFlags_NoSavedSettings
-        );
+        uint64_t total_ns = 0;
+        for (const auto& stage_totals : totals)
         {
-            ImGui::SameLine(content_start);
-            if (ImGui::Button(
-                "Stop",
-                {
-                    content_width,
-                    scaled(.1f)
-                }
-            ))
-            {
-                stop_training_thread();
-                reset_drawboard();
-                ui_mode = UiMode::Drawboard;
-            }
+            total_ns += stage_totals.nanoseconds;
         }
-        ImGui::EndChild();
+
+        // 2 stages per row, each with a name, a share of the total time, and
+        // the average time per call.
+        ImGui::SameLine(content_start);
+        if (!ImGui::BeginTable(
+            "##profiler",
+            6,
+            ImGuiTableFlags_SizingStretchProp,
+            { content_width, 0.f }
+        ))
+        {
+            return;
+        }
+
+        for (size_t i = 0; i < profiler::N_STAGES; i++)
+        {
+            const auto& stage_totals = totals[i];
+
+            ImGui::TableNextColumn();
+            ImGui::Text(profiler::Stage_str[i]);
+
+            ImGui::TableNextColumn();
+            ImGui::TextDisabled(
+                "%.1f%%",
+                total_ns > 0
+                ? 100.f * (float)stage_totals.nanoseconds / (float)total_ns
+                : 0.f
+            );
+
+            ImGui::TableNextColumn();
+            ImGui::TextDisabled(
+                "%.2f us",
+                stage_totals.n_calls > 0
+                ? 1e-3f * (float)stage_totals.nanoseconds
+                / (float)stage_totals.n_calls
+                : 0.f
+            );
+        }
+
+        ImGui::EndTable();
     }
 
     void App::layout_drawboard()
@@ -660,6 +1886,13 @@ namespace digit_rec
             1.f - 2.f * WINDOW_PAD
         );
 
+        // pick up newer weights and biases from the training thread (if any)
+        // and reevaluate the drawboard with them.
+        if (load_latest_snapshot(drawboard_net, drawboard_net_version))
+        {
+            network_evaluate_drawboard();
+        }
+
         ImGui::SameLine(content_start);
         if (network_guess_type == NetworkGuessType::Unknown)
         {
@@ -698,13 +1931,15 @@ namespace digit_rec
         }
         else
         {
-            bool actually_drew_something = false;
-            handle_drawboard_drawing(actually_drew_something);
+            PixelRect dirty_rect;
+            handle_drawboard_drawing(dirty_rect);
 
             // if the drawboard changed, evaluate the network and check the
             // predicted digit label.
-            if (actually_drew_something)
+            if (!dirty_rect.empty())
             {
+                update_drawboard_texture(dirty_rect);
+                drawboard_inference_dirty_rect.add(dirty_rect);
                 network_evaluate_drawboard();
                 update_network_guess_text();
             }
@@ -732,14 +1967,16 @@ namespace digit_rec
             | ImGuiWindowFlags_NoSavedSettings
         );
         {
-            auto net_output = net->output_values();
             for (size_t i = 0; i < 10; i++)
             {
+                float net_output =
+                    drawboard_net ? drawboard_output_values()[i] : 0.f;
+
                 ImGui::Text("%zu", i);
 
                 ImGui::SameLine(scaled(.03f));
                 ImGui::ProgressBar(
-                    std::clamp(net_output[i], 0.f, 1.f),
+                    std::clamp(net_output, 0.f, 1.f),
                     {
                         .65f * ImGui::GetWindowWidth(),
                         ImGui::GetItemRectSize().y
@@ -771,12 +2008,21 @@ namespace digit_rec
             if (ImGui::Button(
                 "Reset",
                 {
-                    content_width / 3.f - scaled(COLUMN_SPACING),
+                    content_width / 4.f - scaled(COLUMN_SPACING),
                     scaled(.1f)
                 }
             ))
             {
                 net = nullptr;
+                net_arena.release();
+                net_snapshots.reset();
+                exit_heads = nullptr;
+                drawboard_net = nullptr;
+                drawboard_half_net = nullptr;
+                drawboard_exit_heads = nullptr;
+                drawboard_incremental = nullptr;
+                drawboard_ensemble = nullptr;
+                eval_nets.clear();
                 ui_mode = UiMode::Settings;
             }
 
@@ -784,7 +2030,7 @@ namespace digit_rec
             if (ImGui::Button(
                 "Pick Test Sample",
                 {
-                    content_width / 3.f - scaled(COLUMN_SPACING),
+                    content_width / 4.f - scaled(COLUMN_SPACING),
                     scaled(.1f)
                 }
             ))
@@ -794,347 +2040,139 @@ namespace digit_rec
 
             ImGui::SameLine(0.f, scaled(COLUMN_SPACING));
             if (ImGui::Button(
-                "Train More",
+                std::format(
+                    "Add to Ensemble ({})",
+                    ensemble_members.size()
+                ).c_str(),
                 {
-                    content_width / 3.f - scaled(COLUMN_SPACING),
+                    content_width / 4.f - scaled(COLUMN_SPACING),
                     scaled(.1f)
                 }
             ))
             {
-                start_training_thread(false);
-                ui_mode = UiMode::Training;
+                add_drawboard_net_to_ensemble();
+                network_evaluate_drawboard();
+                update_network_guess_text();
             }
-        }
-        ImGui::EndChild();
-    }
-
-    void App::load_digit_samples(
-        std::string_view images_path,
-        std::string_view labels_path,
-        std::vector<DigitSample>& out_samples
-    )
-    {
-        auto stream_images = stream::open_binary_file(images_path);
-        auto stream_labels = stream::open_binary_file(labels_path);
-
-        int32_t magic_images = stream::read_bigend<int32_t>(stream_images);
-        if (magic_images != 2051u)
-        {
-            throw std::runtime_error(
-                "invalid magic number, make sure your files aren't corrupted"
-            );
-        }
-
-        int32_t magic_labels = stream::read_bigend<int32_t>(stream_labels);
-        if (magic_labels != 2049u)
-        {
-            throw std::runtime_error(
-                "invalid magic number, make sure your files aren't corrupted"
-            );
-        }
-
-        int32_t n_items = stream::read_bigend<int32_t>(stream_images);
-        int32_t n_items_labels = stream::read_bigend<int32_t>(stream_labels);
-        if (n_items != n_items_labels)
-        {
-            throw std::runtime_error(
-                "item counts don't match in images and labels"
-            );
-        }
-
-        int32_t image_width = stream::read_bigend<int32_t>(stream_images);
-        int32_t image_height = stream::read_bigend<int32_t>(stream_images);
-        if (image_width != DIGIT_WIDTH || image_height != DIGIT_HEIGHT)
-        {
-            throw std::runtime_error(std::format(
-                "invalid image dimensions {}x{}, expected {}x{}",
-                image_width, image_height, DIGIT_WIDTH, DIGIT_HEIGHT
-            ));
-        }
-
-        size_t prev_size = out_samples.size();
-        out_samples.resize(prev_size + n_items);
-        for (size_t i = prev_size; i < out_samples.size(); i++)
-        {
-            stream::read<uint8_t>(
-                stream_images,
-                out_samples[i].values.data(),
-                N_DIGIT_VALUES
-            );
-            out_samples[i].label = stream::read<uint8_t>(stream_labels);
-        }
-    }
-
-    // read digit sample data from src_digit and render a randomly transformed
-    // version of it into dst_digit. both arrays are expected to contain at
-    // least N_DIGIT_VALUES values.
-    template<typename RandomEngine>
-    void apply_random_transform(
-        RandomEngine& engine,
-        float* src_digit,
-        float* dst_digit,
-
-        // defines whether src_digit and dst_digit contain the exact same data,
-        // so that we can optimize out some copies if needed.
-        bool src_dst_are_equal
-    )
-    {
-        std::uniform_real_distribution<float> dist(0.f, 1.f);
-
-        // only transform half of the images, because bilinear interpolation
-        // blurs everything out and we'd like to still have some sharp samples.
-        if (dist(engine) < .5f)
-        {
-            static constexpr float HALF_WIDTH = .5f * (float)DIGIT_WIDTH;
-            static constexpr float HALF_HEIGHT = .5f * (float)DIGIT_HEIGHT;
-
-            static constexpr float MAX_DIM =
-                (float)std::max(DIGIT_WIDTH, DIGIT_HEIGHT);
-            static constexpr float MAX_DIM_INV = 1.f / MAX_DIM;
-
-            static constexpr float DEG2RAD = .0174532925199f;
-
-            const float scale = .9f + .2f * dist(engine);
-            const float inv_scale = 1.f / scale;
-
-            const float rotation = (-2.f + 4.f * dist(engine)) * DEG2RAD;
-            const float sin_a = std::sin(rotation);
-            const float cos_a = std::cos(rotation);
-
-            const float offset_x = -.16f + .32f * dist(engine);
-            const float offset_y = -.16f + .32f * dist(engine);
-
-            for (int32_t y = 0; y < DIGIT_HEIGHT; y++)
+            if (ImGui::IsItemHovered())
             {
-                for (int32_t x = 0; x < DIGIT_WIDTH; x++)
+                if (ImGui::IsMouseClicked(ImGuiMouseButton_Right))
                 {
-                    // UV coordinates from -1 to +1. (0, 0) is the center.
-                    float u = (float)x + .5f - HALF_WIDTH;
-                    float v = (float)y + .5f - HALF_HEIGHT;
-                    u *= MAX_DIM_INV * 2.f;
-                    v *= MAX_DIM_INV * 2.f;
-
-                    // offset (third transformation)
-                    u -= offset_x;
-                    v -= offset_y;
-
-                    // rotate (second transformation)
-                    float u2 = (u * cos_a) + (v * sin_a);
-                    float v2 = (v * cos_a) - (u * sin_a);
-
-                    // scale (first transformation)
-                    u2 *= inv_scale;
-                    v2 *= inv_scale;
-
-                    // (find an intuition for why the order is reversed)
-
-                    // calculatae the final coordinates we need to sample
-                    float coord_x = u2 * .5f * MAX_DIM + HALF_WIDTH;
-                    float coord_y = v2 * .5f * MAX_DIM + HALF_HEIGHT;
-
-                    // sample from src_digit with bilinear interpolation
-
-                    int32_t icoord_tl_x = (int32_t)std::floor(coord_x - .5f);
-                    int32_t icoord_tl_y = (int32_t)std::floor(coord_y - .5f);
-
-                    int32_t icoord_tr_x = icoord_tl_x + 1;
-                    int32_t icoord_tr_y = icoord_tl_y;
-
-                    int32_t icoord_bl_x = icoord_tl_x;
-                    int32_t icoord_bl_y = icoord_tl_y + 1;
-
-                    int32_t icoord_br_x = icoord_tr_x;
-                    int32_t icoord_br_y = icoord_bl_y;
-
-                    float tl = 0.f, tr = 0.f, bl = 0.f, br = 0.f;
-                    if (icoord_tl_x >= 0 && icoord_tl_x < DIGIT_WIDTH
-                        && icoord_tl_y >= 0 && icoord_tl_y < DIGIT_HEIGHT)
-                    {
-                        tl = src_digit[icoord_tl_y * DIGIT_WIDTH + icoord_tl_x];
-                    }
-                    if (icoord_tr_x >= 0 && icoord_tr_x < DIGIT_WIDTH
-                        && icoord_tr_y >= 0 && icoord_tr_y < DIGIT_HEIGHT)
-                    {
-                        tr = src_digit[icoord_tr_y * DIGIT_WIDTH + icoord_tr_x];
-                    }
-                    if (icoord_bl_x >= 0 && icoord_bl_x < DIGIT_WIDTH
-                        && icoord_bl_y >= 0 && icoord_bl_y < DIGIT_HEIGHT)
-                    {
-                        bl = src_digit[icoord_bl_y * DIGIT_WIDTH + icoord_bl_x];
-                    }
-                    if (icoord_br_x >= 0 && icoord_br_x < DIGIT_WIDTH
-                        && icoord_br_y >= 0 && icoord_br_y < DIGIT_HEIGHT)
-                    {
-                        br = src_digit[icoord_br_y * DIGIT_WIDTH + icoord_br_x];
-                    }
-
-                    float horiz_mix = coord_x - ((float)icoord_tl_x + .5f);
-                    dst_digit[y * DIGIT_WIDTH + x] = math::mix(
-                        math::mix(tl, tr, horiz_mix),
-                        math::mix(bl, br, horiz_mix),
-                        coord_y - ((float)icoord_tl_y + .5f)
-                    );
+                    ensemble_members.clear();
+                    drawboard_net_in_ensemble = false;
+                    drawboard_ensemble = nullptr;
+                    network_evaluate_drawboard();
+                    update_network_guess_text();
                 }
-            }
-        }
-        else if (!src_dst_are_equal)
-        {
-            std::copy(
-                src_digit,
-                src_digit + N_DIGIT_VALUES,
-                dst_digit
-            );
-        }
-
-        // randomly add noise to some of the pixels
-        std::uniform_int_distribution<size_t> idx_dist(0, N_DIGIT_VALUES - 1u);
-        for (size_t i = 0; i < 5; i++)
-        {
-            size_t idx = idx_dist(engine);
-            float noise = -.5f + dist(engine);
-
-            dst_digit[idx] = std::clamp(
-                dst_digit[idx] + noise,
-                0.f,
-                1.f
-            );
-        }
-    }
-
-    std::optional<std::string> App::prepare_for_training()
-    {
-        // parse and verify layer sizes
-
-        std::vector<int64_t> layer_sizes_i64;
-        for (auto& s : str::split(val_layer_sizes, ","))
-        {
-            str::trim_inplace(s);
-            try
-            {
-                layer_sizes_i64.push_back(std::stoll(s));
-            }
-            catch (const std::exception&)
-            {
-                return
-                    "Layer sizes must be a list of positive integers "
-                    "separated by commas.";
-            }
-        }
-
-        std::vector<size_t> layer_sizes;
-        for (auto layer_size_i64 : layer_sizes_i64)
-        {
-            if (layer_size_i64 < 0)
-            {
-                return "Layer sizes can't be negative.";
-            }
-            else if (layer_size_i64 < 1)
-            {
-                return "A layer must contain at least 1 node / neuron.";
-            }
-            layer_sizes.push_back((size_t)layer_size_i64);
-        }
-
-        if (layer_sizes.size() < 2u)
-        {
-            return "There should be at least 2 layers (input and output).";
-        }
-        if (layer_sizes.size() > 10u)
-        {
-            return "Too many layers.";
-        }
 
-        if (layer_sizes[0] != N_DIGIT_VALUES)
-        {
-            return std::format(
-                "The size of the first layer (input) must always be {}.",
-                N_DIGIT_VALUES
-            );
-        }
-        if (layer_sizes.back() != 10)
-        {
-            return "The size of the last layer (output) must always be 10.";
-        }
-
-        for (size_t i = 1; i < layer_sizes.size() - 1u; i++)
-        {
-            if (layer_sizes[i] > 64)
-            {
-                return "The maximum size for a hidden layer is 64.";
-            }
-        }
-
-        // activation functions and their derivatives
-        std::vector<std::function<float(float)>> activation_fns;
-        std::vector<std::function<float(float)>> activation_derivs;
-
-        // hidden layer activation functions
-        if (layer_sizes.size() > 2u)
-        {
-            std::function<float(float)> func;
-            std::function<float(float)> deriv;
-            switch (val_hidden_activation)
-            {
-            case digit_rec::ActivationFunc::Relu:
-                func = neural::relu<float>;
-                deriv = neural::relu_deriv<float>;
-                break;
-            case digit_rec::ActivationFunc::LeakyRelu:
-                func = neural::leaky_relu<float, .01f>;
-                deriv = neural::leaky_relu_deriv<float, .01f>;
-                break;
-            case digit_rec::ActivationFunc::Tanh:
-                func = neural::tanh<float>;
-                deriv = neural::tanh_deriv<float>;
-                break;
-            default:
-                break;
+                ImGui::SetTooltip(
+                    "Save a copy of this network. The drawboard evaluates the "
+                    "saved networks\ntogether with the current one and "
+                    "combines their outputs. Reset and\ntrain with another "
+                    "seed to add more. Right click to clear."
+                );
             }
 
-            for (size_t i = 0; i < layer_sizes.size() - 2u; i++)
+            ImGui::SameLine(0.f, scaled(COLUMN_SPACING));
+            if (ImGui::Button(
+                "Train More",
+                {
+                    content_width / 4.f - scaled(COLUMN_SPACING),
+                    scaled(.1f)
+                }
+            ))
             {
-                activation_fns.push_back(func);
-                activation_derivs.push_back(deriv);
+                start_training_thread(false);
+                ui_mode = UiMode::Training;
             }
         }
-
-        // output layer activation function
-        switch (val_output_activation)
-        {
-        case digit_rec::ActivationFunc::Relu:
-            activation_fns.push_back(neural::relu<float>);
-            activation_derivs.push_back(neural::relu_deriv<float>);
-            break;
-        case digit_rec::ActivationFunc::LeakyRelu:
-            activation_fns.push_back(neural::leaky_relu<float, .01f>);
-            activation_derivs.push_back(neural::leaky_relu_deriv<float, .01f>);
-            break;
-        case digit_rec::ActivationFunc::Tanh:
-            activation_fns.push_back(neural::tanh<float>);
-            activation_derivs.push_back(neural::tanh_deriv<float>);
-            break;
-        default:
-            break;
+        ImGui::EndChild();
+    }
+
+    std::optional<std::string> App::prepare_for_training()
+    {
+        std::vector<size_t> layer_sizes;
+        if (auto error = parse_layer_sizes(val_layer_sizes, layer_sizes))
+        {
+            return error;
         }
 
-        // recreate neural network
+        std::vector<std::function<float(float)>> activation_fns;
+        std::vector<std::function<float(float)>> activation_derivs;
+        make_activation_fns(
+            layer_sizes.size(),
+            val_hidden_activation,
+            val_output_activation,
+            activation_fns,
+            activation_derivs
+        );
+
+        // recreate neural network. the old one has to go before its memory
+        // is released.
+        net = nullptr;
+        net_arena.release();
         net = std::make_unique<neural::Network<float, true>>(
             layer_sizes,
             activation_fns,
-            activation_derivs
+            activation_derivs,
+            &net_arena
         );
 
         // initialize network with random weights and biases
         std::mt19937 rng_initialization(val_seed);
         net->randomize_xavier_normal(rng_initialization, -.01f, .01f);
 
+        // exit heads need at least one hidden layer
+        exit_heads = nullptr;
+        if (val_early_exit && layer_sizes.size() > 2u)
+        {
+            exit_heads = std::make_unique<neural::ExitHeads<float, true>>(*net);
+            exit_heads->randomize(rng_initialization);
+        }
+        {
+            std::scoped_lock lock(early_exit_mutex);
+            early_exit_fractions.clear();
+        }
+
+        // forget the old network's snapshots and publish the new one
+        net_snapshots.reset();
+        drawboard_net = nullptr;
+        drawboard_half_net = nullptr;
+        drawboard_exit_heads = nullptr;
+        drawboard_incremental = nullptr;
+        drawboard_ensemble = nullptr;
+        net_snapshots.publish(*net);
+
+        // the ensemble's evaluation runs on the worker threads as well
+        ensemble_accuracy_job = nullptr;
+        ensemble_accuracy_restart = false;
+        ensemble_accuracy_ready = false;
+
+        // (re)create the worker threads if needed, the training thread isn't
+        // running, so nothing is using them.
+        if (!task_pool || task_pool->n_workers() != val_n_worker_threads)
+        {
+            task_pool = std::make_unique<tasks::Pool>(val_n_worker_threads);
+        }
+        eval_nets.clear();
+        eval_nets.resize(task_pool->n_workers());
+
         // reset accuracy history and the number of training steps
-        accuracy_history.clear();
+        metrics_history.clear();
         n_training_steps = 0;
+        training_time_before_start = {};
+        profiler::reset();
 
         // seed the RNGs
         rng_train_pick_sample.seed(val_seed);
         rng_train_random_transforms.seed(val_seed);
+        training_worker_rngs.resize(val_n_worker_threads);
+        for (uint32_t i = 0; i < val_n_worker_threads; i++)
+        {
+            std::seed_seq seq{ val_seed, i };
+            training_worker_rngs[i].pick_sample.seed(seq);
+            training_worker_rngs[i].random_transforms.seed(seq);
+        }
         rng_drawboard_pick_test_sample.seed(val_seed);
         rng_drawboard_random_test_sample_random_transforms.seed(val_seed);
 
@@ -1144,104 +2182,310 @@ namespace digit_rec
     void App::start_training_thread(bool recalculate_accuracy_at_beginning)
     {
         last_accuracy_calc_time = std::chrono::high_resolution_clock::now();
+        training_start_time = std::chrono::steady_clock::now();
+        last_metrics_step = n_training_steps;
+        last_metrics_time = training_start_time;
+        ui_steps_per_second = 0.f;
+        ui_throughput_last_step = n_training_steps;
+        ui_throughput_last_time = training_start_time;
+
+        // the network is about to change, so it won't be the same as the
+        // ensemble member it was copied into anymore
+        drawboard_net_in_ensemble = false;
+        drawboard_ensemble = nullptr;
+
         training_thread = std::make_unique<std::jthread>(
             [this, recalculate_accuracy_at_beginning](std::stop_token stoken)
             {
-                // number of floats in a single training example which contains
-                // input data + expected output data.
-                static constexpr size_t TRAINING_DATA_SIZE =
-                    N_DIGIT_VALUES + 10u;
+                TRACE_THREAD_NAME("Training");
 
-                std::vector<float> training_data(
-                    (size_t)val_batch_size * TRAINING_DATA_SIZE
-                );
+                // the exit heads are trained on the forward passes of net
+                // itself
+                if (exit_heads)
+                {
+                    run_training_loop(
+                        stoken,
+                        *net,
+                        recalculate_accuracy_at_beginning
+                    );
+                    return;
+                }
 
-                std::vector<std::span<float>> spans(val_batch_size);
-                for (size_t i = 0; i < val_batch_size; i++)
+                if (task_pool->n_workers() > 1u)
                 {
-                    spans[i] = std::span<float>(
-                        training_data.data() + (i * TRAINING_DATA_SIZE),
-                        TRAINING_DATA_SIZE
+                    run_parallel_training_loop(
+                        stoken,
+                        recalculate_accuracy_at_beginning
                     );
+                    return;
                 }
 
-                std::uniform_int_distribution<size_t> idx_dist(
-                    0,
-                    train_samples.size() - 1u
-                );
+                // use a specialized network if there's one for the current
+                // settings, it trains about 1.4x to 2x as fast.
+                if (!run_static_training_loop<
+                    StaticDigitNetwork<24, 16>,
+                    StaticDigitNetwork<32, 32>,
+                    StaticDigitNetwork<64, 64>,
+                    StaticDigitNetwork<64>
+                >(stoken, recalculate_accuracy_at_beginning))
+                {
+                    run_training_loop(
+                        stoken,
+                        *net,
+                        recalculate_accuracy_at_beginning
+                    );
+                }
+            }
+        );
+    }
+
+    template<typename... StaticNetTypes>
+    bool App::run_static_training_loop(
+        std::stop_token stoken,
+        bool recalculate_accuracy_at_beginning
+    )
+    {
+        // see StaticDigitNetwork
+        if (val_hidden_activation != ActivationFunc::LeakyRelu
+            || val_output_activation != ActivationFunc::Tanh)
+        {
+            return false;
+        }
 
-                if (recalculate_accuracy_at_beginning)
+        auto try_run = [&]<typename StaticNetType>()
+            {
+                if (!StaticNetType::matches(*net))
                 {
-                    recalculate_accuracy_and_add_to_history();
+                    return false;
                 }
 
-                while (!stoken.stop_requested())
+                auto static_net = std::make_unique<StaticNetType>();
+                static_net->copy_parameters_from(*net);
+
+                run_training_loop(
+                    stoken,
+                    *static_net,
+                    recalculate_accuracy_at_beginning
+                );
+                return true;
+            };
+
+        return (try_run.template operator()<StaticNetTypes>() || ...);
+    }
+
+    void App::run_parallel_training_loop(
+        std::stop_token stoken,
+        bool recalculate_accuracy_at_beginning
+    )
+    {
+        // copy the dataset to every NUMA node only if there's more than one,
+        // the workers fill the copies in
+        const bool node_local_samples = numa::topology().size() > 1u;
+        neural::ParallelTrainer<float>::NodeInitFn init_node = nullptr;
+        if (node_local_samples)
+        {
+            node_train_samples.resize(numa::topology().size());
+            init_node = [this](size_t node_idx)
                 {
-                    // training step
-                    for (size_t i = 0; i < val_batch_size; i++)
-                    {
-                        // pointer to input data for this training example
-                        float* input_data =
-                            training_data.data() + (i * TRAINING_DATA_SIZE);
-
-                        // pointer to expected output data for this example
-                        float* output_data =
-                            training_data.data()
-                            + (i * TRAINING_DATA_SIZE)
-                            + N_DIGIT_VALUES;
-
-                        // randomly pick a digit sample from the dataset
-                        const auto& samp =
-                            train_samples[idx_dist(rng_train_pick_sample)];
-
-                        // update input data
-                        for (size_t i = 0; i < N_DIGIT_VALUES; i++)
-                        {
-                            input_data[i] = (float)samp.values[i] / 255.f;
-                        }
+                    node_train_samples[node_idx] = train_samples;
+                };
+        }
 
-                        // randomly transform input data if needed
-                        if (val_random_transform)
-                        {
-                            float digit_data_copy[N_DIGIT_VALUES];
-                            std::copy(
-                                input_data,
-                                input_data + N_DIGIT_VALUES,
-                                digit_data_copy
-                            );
-
-                            apply_random_transform(
-                                rng_train_random_transforms,
-                                digit_data_copy,
-                                input_data,
-                                true
-                            );
-                        }
+        neural::ParallelTrainer<float> trainer(
+            *net,
+            val_batch_size,
+            *task_pool,
+            init_node,
+            [this, node_local_samples](
+                size_t worker_idx,
+                size_t node_idx,
+                std::span<float> inputs,
+                std::span<neural::LabeledInput<float>> samples
+                )
+            {
+                WorkerRngs& rngs = training_worker_rngs[worker_idx];
+                load_training_batch(
+                    node_local_samples
+                    ? node_train_samples[node_idx]
+                    : train_samples,
+                    rngs.pick_sample,
+                    rngs.random_transforms,
+                    val_random_transform ? &random_transforms : nullptr,
+                    inputs.data(),
+                    samples,
+                    &synthetic_digits,
+                    val_synthetic_ratio
+                );
+            }
+        );
+        n_training_numa_nodes = trainer.n_nodes();
 
-                        // update expected output data
-                        for (uint32_t i = 0; i < 10; i++)
-                        {
-                            output_data[i] = (i == samp.label) ? 1.f : 0.f;
-                        }
+        run_training_loop(stoken, trainer, recalculate_accuracy_at_beginning);
+
+        n_training_numa_nodes = 0;
+        node_train_samples.clear();
+    }
+
+    template<typename NetType>
+    void App::run_training_loop(
+        std::stop_token stoken,
+        NetType& train_net,
+        bool recalculate_accuracy_at_beginning
+    )
+    {
+        static constexpr bool is_parallel =
+            std::is_same_v<NetType, neural::ParallelTrainer<float>>;
+
+        training_with_static_network =
+            !std::is_same_v<NetType, neural::Network<float, true>>
+            && !is_parallel;
+
+        // input data for every training example in the batch. the
+        // expected outputs aren't stored anywhere, we only pass the
+        // digit labels to the network.
+        std::vector<float> training_data(
+            (size_t)val_batch_size * N_DIGIT_VALUES
+        );
+
+        std::vector<neural::LabeledInput<float>> batch(val_batch_size);
+        for (size_t i = 0; i < val_batch_size; i++)
+        {
+            batch[i].input =
+                training_data.data() + (i * N_DIGIT_VALUES);
+        }
+
+        // net only contains the latest weights and biases if it's the one being
+        // trained, otherwise they need to be copied from train_net before net
+        // is used.
+        auto update_net = [&]()
+            {
+                if constexpr (!std::is_same_v<
+                    NetType,
+                    neural::Network<float, true>
+                >)
+                {
+                    train_net.copy_parameters_to(*net);
+                }
+            };
+
+        // training metrics since the last accuracy recalculation
+        neural::BatchStats<float> training_stats;
+
+        // the last time we published a snapshot of the network
+        auto last_snapshot_time = std::chrono::steady_clock::now();
+
+        if (recalculate_accuracy_at_beginning)
+        {
+            update_net();
+            recalculate_accuracy_and_add_to_history(training_stats);
+        }
+
+        while (!stoken.stop_requested())
+        {
+            TRACE_SCOPE("Training Step");
+
+#ifdef DIGIT_REC_COUNT_ALLOCATIONS
+            const uint64_t n_allocations_before =
+                alloc_counter::n_allocations;
+#endif
+
+            // training step
+            if constexpr (is_parallel)
+            {
+                // the workers load their own samples
+                TRACE_SCOPE("Train Batch");
+                training_stats.add(train_net.train(val_learning_rate));
+            }
+            else
+            {
+                load_training_batch(
+                    train_samples,
+                    rng_train_pick_sample,
+                    rng_train_random_transforms,
+                    val_random_transform ? &random_transforms : nullptr,
+                    training_data.data(),
+                    batch,
+                    &synthetic_digits,
+                    val_synthetic_ratio
+                );
+
+                TRACE_SCOPE("Train Batch");
+                if constexpr (std::is_same_v<
+                    NetType,
+                    neural::Network<float, true>
+                >)
+                {
+                    if (exit_heads)
+                    {
+                        training_stats.add(exit_heads->train(
+                            train_net,
+                            batch,
+                            val_learning_rate
+                        ));
                     }
-                    net->train(spans, val_learning_rate);
-                    n_training_steps++;
-
-                    // recalculate the accuracy if needed
-                    auto elapsed_ms =
-                        std::chrono::duration_cast<std::chrono::milliseconds>(
-                            std::chrono::high_resolution_clock::now()
-                            - last_accuracy_calc_time
-                        ).count();
-                    if (elapsed_ms > 1500)
+                    else
                     {
-                        recalculate_accuracy_and_add_to_history();
-                        last_accuracy_calc_time =
-                            std::chrono::high_resolution_clock::now();
+                        training_stats.add(
+                            train_net.train(batch, val_learning_rate)
+                        );
                     }
                 }
+                else
+                {
+                    training_stats.add(
+                        train_net.train(batch, val_learning_rate)
+                    );
+                }
             }
-        );
+            n_training_steps++;
+
+#ifdef DIGIT_REC_COUNT_ALLOCATIONS
+            // training steps must not allocate memory, everything they
+            // need is allocated before the loop.
+            if (alloc_counter::n_allocations != n_allocations_before)
+            {
+                throw std::logic_error(std::format(
+                    "a training step did {} heap allocation(s)",
+                    alloc_counter::n_allocations - n_allocations_before
+                ));
+            }
+#endif
+
+            // publish a snapshot of the network if needed
+            if (std::chrono::steady_clock::now() - last_snapshot_time
+                > std::chrono::milliseconds(SNAPSHOT_INTERVAL_MS))
+            {
+                PROFILE_SCOPE(PublishSnapshot);
+                TRACE_SCOPE("Publish Snapshot");
+                update_net();
+                net_snapshots.publish(*net);
+                last_snapshot_time = std::chrono::steady_clock::now();
+            }
+
+            // recalculate the accuracy if needed
+            auto elapsed_ms =
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::high_resolution_clock::now()
+                    - last_accuracy_calc_time
+                ).count();
+            if (elapsed_ms > 1500)
+            {
+                // make this thread's timings visible to other threads
+                profiler::flush();
+
+                update_net();
+                recalculate_accuracy_and_add_to_history(training_stats);
+                training_stats = {};
+
+                last_accuracy_calc_time =
+                    std::chrono::high_resolution_clock::now();
+            }
+        }
+
+        // make sure the final weights and biases are in net and published
+        update_net();
+        net_snapshots.publish(*net);
+        profiler::flush();
     }
 
     void App::stop_training_thread()
@@ -1250,56 +2494,223 @@ namespace digit_rec
         {
             training_thread->request_stop();
             training_thread->join();
+            training_thread = nullptr;
+
+            training_time_before_start +=
+                std::chrono::steady_clock::now() - training_start_time;
         }
     }
 
-    void App::recalculate_accuracy_and_add_to_history()
+    void App::recalculate_accuracy_and_add_to_history(
+        const neural::BatchStats<float>& training_stats
+    )
     {
-        auto net_input = net->input_values();
-        auto net_output = net->output_values();
+        TRACE_SCOPE("Evaluation");
+
+        const auto eval_start_time = std::chrono::steady_clock::now();
+
+        // evaluate the latest weights and biases
+        net_snapshots.publish(*net);
 
         static constexpr size_t n_tests = 4000;
-        size_t n_correct_predict = 0;
+        std::atomic_size_t n_correct_predict = 0;
+
+        // HalfNetwork can't stop in the middle of a forward pass
+        const bool early_exit = exit_heads
+            && val_inference_precision == InferencePrecision::Fp32;
+        EarlyExitCounts early_exit_counts;
+        if (early_exit)
+        {
+            early_exit_counts.n_exits =
+                std::vector<std::atomic_size_t>(net->n_layers());
+        }
+
+        // the tests are split between the workers in fixed ranges that use
+        // their own random numbers, so the results don't depend on the number
+        // of workers.
+        static constexpr size_t n_tests_per_task = 250;
+        tasks::parallel_for(
+            *task_pool,
+            0,
+            n_tests,
+            n_tests_per_task,
+            [&](size_t begin, size_t end)
+            {
+                n_correct_predict += evaluate_tests(
+                    begin,
+                    end,
+                    early_exit ? &early_exit_counts : nullptr
+                );
+
+                // make this worker's timings visible to other threads
+                profiler::flush();
+            }
+        );
+
+        // add everything to the history
+        const auto now = std::chrono::steady_clock::now();
+        const uint64_t step = n_training_steps;
+
+        metrics::Sample sample;
+        sample.step = step;
+        sample.samples_seen = step * val_batch_size;
+        sample.wall_time = std::chrono::duration<float>(
+            training_time_before_start + (now - training_start_time)
+        ).count();
+        sample.accuracy = (float)n_correct_predict / (float)n_tests;
+
+        if (val_record_training_metrics && training_stats.n_samples > 0)
+        {
+            sample.training_accuracy = training_stats.accuracy();
+            sample.training_cost = training_stats.average_cost();
+        }
+
+        const float seconds_since_last_sample =
+            std::chrono::duration<float>(now - last_metrics_time).count();
+        if (seconds_since_last_sample > 0.f)
+        {
+            sample.steps_per_second =
+                (float)(step - last_metrics_step) / seconds_since_last_sample;
+            sample.samples_per_second =
+                sample.steps_per_second * (float)val_batch_size;
+            sample.gflops = sample.samples_per_second
+                * (float)net->training_flops_per_sample() * 1e-9f;
+        }
+        sample.eval_seconds =
+            std::chrono::duration<float>(now - eval_start_time).count();
+
+        if (early_exit)
+        {
+            sample.early_exit_accuracy =
+                (float)early_exit_counts.n_correct / (float)n_tests;
+
+            uint64_t total_cost = 0;
+            std::vector<float> fractions(net->n_layers() - 1u);
+            for (size_t l = 1u; l < net->n_layers(); l++)
+            {
+                const size_t n_exits = early_exit_counts.n_exits[l];
+                total_cost += n_exits * exit_heads->exit_cost(l);
+                fractions[l - 1u] = (float)n_exits / (float)n_tests;
+            }
+            sample.early_exit_compute = (float)(
+                (double)total_cost
+                / ((double)n_tests * (double)exit_heads->forward_pass_cost())
+                );
+
+            std::scoped_lock lock(early_exit_mutex);
+            early_exit_fractions = std::move(fractions);
+        }
+        last_metrics_step = step;
+        last_metrics_time = now;
+
+        metrics_history.push(sample);
+    }
+
+    size_t App::evaluate_tests(
+        size_t begin,
+        size_t end,
+        EarlyExitCounts* early_exit_counts
+    )
+    {
+        PROFILE_SCOPE(Evaluation);
+
+        EvalNetworks& nets = eval_nets[task_pool->current_worker()];
+        const bool net_updated =
+            load_latest_snapshot(nets.net, nets.net_version);
+        load_half_network(nets.net, net_updated, nets.half_net);
+
+        // the training thread is waiting for us, so exit_heads won't change
+        // while we copy it
+        if (early_exit_counts)
+        {
+            if (!nets.exit_heads)
+            {
+                nets.exit_heads =
+                    std::make_unique<neural::ExitHeads<float, false>>(
+                        *nets.net
+                    );
+            }
+            nets.exit_heads->copy_parameters_from(*exit_heads);
+        }
 
-        std::mt19937 rng_pick_sample(val_seed);
+        auto net_input = nets.half_net
+            ? nets.half_net->input_values()
+            : nets.net->input_values();
+        auto net_output = nets.half_net
+            ? nets.half_net->output_values()
+            : nets.net->output_values();
+
+        std::seed_seq seq{ val_seed, (uint32_t)begin };
+        std::mt19937 rng_pick_sample(seq);
         std::uniform_int_distribution<size_t> sizet_dist(
             0,
             test_samples.size() - 1u
         );
 
-        std::mt19937 rng_random_transforms(val_seed);
+        std::mt19937 rng_random_transforms(seq);
 
-        for (size_t i = 0; i < n_tests; i++)
+        size_t n_correct = 0;
+        for (size_t i = begin; i < end; i++)
         {
             // pick a random sample from the test dataset
             const auto& samp = test_samples[sizet_dist(rng_pick_sample)];
 
-            // feed it to the network
-            for (size_t i = 0; i < N_DIGIT_VALUES; i++)
-            {
-                net_input[i] = (float)samp.values[i] / 255.f;
-            }
-
-            // randomly transform the input data if needed
+            // feed it to the network, randomly transformed if needed
+            const uint8_t* src_digit = samp.values.data();
+            float* dst_digit = net_input.data();
+            TransformParams params;
             if (val_random_transform)
             {
-                float digit_data_copy[N_DIGIT_VALUES];
-                std::copy(
-                    net_input.data(),
-                    net_input.data() + N_DIGIT_VALUES,
-                    digit_data_copy
-                );
-
-                apply_random_transform(
+                random_transforms.sample(
                     rng_random_transforms,
-                    digit_data_copy,
-                    net_input.data(),
-                    true
+                    { &params, 1 },
+                    TransformStrength::Mild
                 );
             }
+            apply_transforms(
+                { &src_digit, 1 },
+                { &params, 1 },
+                { &dst_digit, 1 }
+            );
 
             // perform a forward pass
-            net->forward_pass();
+            if (nets.half_net)
+            {
+                nets.half_net->forward_pass();
+            }
+            else if (early_exit_counts)
+            {
+                // predict with early exits, then finish the forward pass so
+                // that the accuracy of the whole network is still measured
+                const size_t exit_layer = nets.exit_heads->forward_pass(
+                    *nets.net,
+                    EARLY_EXIT_THRESHOLD
+                );
+                early_exit_counts->n_exits[exit_layer]++;
+
+                auto exit_output = nets.exit_heads->output_values();
+                uint32_t exit_label = 0;
+                for (uint32_t i = 1; i < 10; i++)
+                {
+                    if (exit_output[i] > exit_output[exit_label])
+                    {
+                        exit_label = i;
+                    }
+                }
+                if (exit_label == samp.label)
+                {
+                    early_exit_counts->n_correct++;
+                }
+
+                for (size_t l = exit_layer + 1u; l < nets.net->n_layers(); l++)
+                {
+                    nets.net->forward_layer(l);
+                }
+            }
+            else
+            {
+                nets.net->forward_pass();
+            }
 
             // see what the network predicted
             uint32_t predicted_label = 0;
@@ -1316,13 +2727,76 @@ namespace digit_rec
             // see if the prediction is correct
             if (predicted_label == samp.label)
             {
-                n_correct_predict++;
+                n_correct++;
             }
         }
+        return n_correct;
+    }
 
-        accuracy_history.push_back(
-            (float)n_correct_predict / (float)n_tests
-        );
+    bool App::load_latest_snapshot(
+        std::unique_ptr<neural::Network<float, false>>& target,
+        uint64_t& target_version
+    )
+    {
+        const uint64_t version = net_snapshots.version();
+        if (target && version == target_version)
+        {
+            return false;
+        }
+
+        auto snapshot = net_snapshots.latest();
+        if (!snapshot)
+        {
+            return false;
+        }
+
+        if (!target || target->layer_sizes() != snapshot->layer_sizes())
+        {
+            target = std::make_unique<neural::Network<float, false>>(
+                snapshot->layer_sizes(),
+                snapshot->activation_fns(),
+                snapshot->activation_derivs()
+            );
+        }
+        target->copy_parameters_from(*snapshot);
+        target_version = version;
+
+        return true;
+    }
+
+    void App::load_half_network(
+        std::unique_ptr<neural::Network<float, false>>& source,
+        bool source_updated,
+        std::unique_ptr<neural::HalfNetwork<float>>& target
+    )
+    {
+        if (!source || val_inference_precision == InferencePrecision::Fp32)
+        {
+            target = nullptr;
+            return;
+        }
+
+        const half::Format format =
+            val_inference_precision == InferencePrecision::Bf16
+            ? half::Format::Bf16
+            : half::Format::Fp16;
+
+        if (!target
+            || target->format() != format
+            || target->layer_sizes() != source->layer_sizes())
+        {
+            target = std::make_unique<neural::HalfNetwork<float>>(
+                source->layer_sizes(),
+                source->activation_fns(),
+                format
+            );
+            source_updated = true;
+        }
+
+        if (source_updated)
+        {
+            target->copy_parameters_from(*source);
+        }
     }
 
     void App::network_summary_tooltip()
@@ -1364,24 +2838,176 @@ namespace digit_rec
         ImGui::SameLine();
         ImGui::Text("%u", val_seed);
 
-        bold_text("Randomly Transform Images:");
-        ImGui::SameLine();
-        ImGui::Text("%s", val_random_transform ? "Yes" : "No");
+        bold_text("Randomly Transform Images:");
+        ImGui::SameLine();
+        ImGui::Text("%s", val_random_transform ? "Yes" : "No");
+
+        bold_text("Synthetic Digits:");
+        ImGui::SameLine();
+        ImGui::Text("%.1f%%", 100.f * val_synthetic_ratio);
+
+        ImGui::NewLine();
+        bold_text("Training Steps:");
+        ImGui::SameLine();
+        ImGui::Text("%llu", n_training_steps.load());
+
+        bold_text("Specialized Network:");
+        ImGui::SameLine();
+        ImGui::Text(
+            "%s",
+            training_with_static_network ? "Yes" : "No"
+        );
+
+        bold_text("Worker Threads:");
+        ImGui::SameLine();
+        if (n_training_numa_nodes > 0)
+        {
+            ImGui::Text(
+                "%u (%zu NUMA node%s)",
+                val_n_worker_threads,
+                n_training_numa_nodes.load(),
+                n_training_numa_nodes > 1 ? "s" : ""
+            );
+        }
+        else
+        {
+            ImGui::Text("%u", val_n_worker_threads);
+        }
+
+        bold_text("Inference Precision:");
+        ImGui::SameLine();
+        ImGui::Text(
+            "%s (%.1f KiB of parameters)",
+            InferencePrecision_str[(size_t)val_inference_precision],
+            (float)(
+                net->n_parameters()
+                * (val_inference_precision == InferencePrecision::Fp32
+                    ? sizeof(float)
+                    : sizeof(uint16_t))
+                ) / 1024.f
+        );
+
+        bold_text("Ensemble:");
+        ImGui::SameLine();
+        if (drawboard_ensemble && ensemble_accuracy_ready)
+        {
+            ImGui::Text(
+                "%zu networks, %s (%.1f%% test accuracy)",
+                drawboard_ensemble->n_models(),
+                EnsembleMode_str[(size_t)drawboard_ensemble->mode()],
+                ensemble_accuracy * 100.f
+            );
+        }
+        else if (drawboard_ensemble)
+        {
+            ImGui::Text(
+                "%zu networks, %s (evaluating the test accuracy...)",
+                drawboard_ensemble->n_models(),
+                EnsembleMode_str[(size_t)drawboard_ensemble->mode()]
+            );
+        }
+        else if (!ensemble_members.empty())
+        {
+            ImGui::Text(
+                "%zu saved networks (not used, they don't match this one)",
+                ensemble_members.size()
+            );
+        }
+        else
+        {
+            ImGui::Text("-");
+        }
+
+        metrics::Sample latest_metrics;
+        const bool has_metrics = metrics_history.latest(latest_metrics);
+
+        if (exit_heads)
+        {
+            bold_text("Early Exits:");
+            ImGui::SameLine();
+            if (!has_metrics || std::isnan(latest_metrics.early_exit_accuracy))
+            {
+                ImGui::Text("-");
+            }
+            else
+            {
+                ImGui::Text(
+                    "%.1f%% accuracy with %.0f%% of the compute",
+                    latest_metrics.early_exit_accuracy * 100.f,
+                    latest_metrics.early_exit_compute * 100.f
+                );
+            }
+
+            std::string s_exit_fractions;
+            {
+                std::scoped_lock lock(early_exit_mutex);
+                for (size_t i = 0; i < early_exit_fractions.size(); i++)
+                {
+                    if (i != 0)
+                        s_exit_fractions += ", ";
+                    s_exit_fractions += std::format(
+                        "{}: {:.1f}%",
+                        i + 1u,
+                        early_exit_fractions[i] * 100.f
+                    );
+                }
+            }
+            bold_text("Exit Layers:");
+            ImGui::SameLine();
+            ImGui::Text(
+                "%s",
+                s_exit_fractions.empty() ? "-" : s_exit_fractions.c_str()
+            );
 
-        ImGui::NewLine();
-        bold_text("Training Steps:");
-        ImGui::SameLine();
-        ImGui::Text("%llu", n_training_steps.load());
+            if (drawboard_exit_layer > 0)
+            {
+                bold_text("Drawboard Exit Layer:");
+                ImGui::SameLine();
+                ImGui::Text(
+                    "%zu of %zu",
+                    drawboard_exit_layer,
+                    net->n_layers() - 1u
+                );
+            }
+        }
 
         bold_text("Accuracy:");
         ImGui::SameLine();
-        if (accuracy_history.empty())
+        if (!has_metrics)
         {
             ImGui::Text("-");
         }
         else
         {
-            ImGui::Text("%.1f%%", accuracy_history.back() * 100.f);
+            ImGui::Text("%.1f%%", latest_metrics.accuracy * 100.f);
+        }
+
+        if (val_record_training_metrics)
+        {
+            bold_text("Training Accuracy:");
+            ImGui::SameLine();
+            if (!has_metrics || std::isnan(latest_metrics.training_accuracy))
+            {
+                ImGui::Text("-");
+            }
+            else
+            {
+                ImGui::Text(
+                    "%.1f%%",
+                    latest_metrics.training_accuracy * 100.f
+                );
+            }
+
+            bold_text("Training Cost:");
+            ImGui::SameLine();
+            if (!has_metrics || std::isnan(latest_metrics.training_cost))
+            {
+                ImGui::Text("-");
+            }
+            else
+            {
+                ImGui::Text("%.4f", latest_metrics.training_cost);
+            }
         }
 
 
@@ -1480,11 +3106,19 @@ namespace digit_rec
         {
             v = 0.f;
         }
+        drawboard_inference_dirty_rect = DIGIT_RECT;
         update_drawboard_texture();
     }
 
     void App::init_drawboard_texture()
     {
+        for (size_t i = 0; i < GAMMA_LUT_SIZE; i++)
+        {
+            const float v = (float)i / (float)(GAMMA_LUT_SIZE - 1u);
+            drawboard_gamma_lut[i] =
+                (uint8_t)(std::pow(v, 1.f / 2.2f) * 255.f + .5f);
+        }
+
         // create an OpenGL texture for the drawboard
         glGenTextures(1, &drawboard_texture);
         glBindTexture(GL_TEXTURE_2D, drawboard_texture);
@@ -1492,36 +3126,91 @@ namespace digit_rec
         // filtering parameters
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    }
 
-    void App::update_drawboard_texture()
-    {
-        // drawboard_image stores luminance values but ImGui wants RGB values,
-        // so we'll handle that here. We'll also handle the OETF (so-called
-        // gamma correction).
-        std::array<float, 3u * N_DIGIT_VALUES> image_rgb{};
-        for (size_t i = 0; i < N_DIGIT_VALUES; i++)
+        // store one channel and show it as gray (swizzling needs OpenGL 3.3,
+        // we only ask for 3.2).
+        GLenum internal_format = GL_RGB8;
+        GLenum format = GL_RGB;
+        drawboard_texture_channels = 3;
+        if (GLEW_VERSION_3_3 || GLEW_ARB_texture_swizzle)
         {
-            float v = std::pow(drawboard_image[i], 1.f / 2.2f);
-            image_rgb[i * 3u + 0u] = v;
-            image_rgb[i * 3u + 1u] = v;
-            image_rgb[i * 3u + 2u] = v;
+            static constexpr GLint swizzle[] = {
+                GL_RED, GL_RED, GL_RED, GL_ONE
+            };
+            glTexParameteriv(
+                GL_TEXTURE_2D,
+                GL_TEXTURE_SWIZZLE_RGBA,
+                swizzle
+            );
+
+            internal_format = GL_R8;
+            format = GL_RED;
+            drawboard_texture_channels = 1;
         }
 
-        // upload RGB image data to the GPU
-        glBindTexture(GL_TEXTURE_2D, drawboard_texture);
+        // allocate the texture once, the drawboard only updates parts of it
+        drawboard_texture_pixels.fill(0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
         glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
         glTexImage2D(
             GL_TEXTURE_2D,
             0,
-            GL_RGB,
+            internal_format,
             DIGIT_WIDTH,
             DIGIT_HEIGHT,
             0,
-            GL_RGB,
-            GL_FLOAT,
-            image_rgb.data()
+            format,
+            GL_UNSIGNED_BYTE,
+            drawboard_texture_pixels.data()
+        );
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+
+    void App::update_drawboard_texture(const PixelRect& rect)
+    {
+        if (rect.empty())
+        {
+            return;
+        }
+
+        // drawboard_image stores linear luminance values, so we'll handle the
+        // OETF here with the lookup table. only the pixels in rect have
+        // changed.
+        const size_t n_channels = drawboard_texture_channels;
+        for (int32_t y = rect.min_y; y < rect.max_y; y++)
+        {
+            for (int32_t x = rect.min_x; x < rect.max_x; x++)
+            {
+                const size_t i = y * DIGIT_WIDTH + x;
+                const float v = std::clamp(drawboard_image[i], 0.f, 1.f);
+                const uint8_t encoded = drawboard_gamma_lut[
+                    (size_t)(v * (float)(GAMMA_LUT_SIZE - 1u) + .5f)
+                ];
+                for (size_t c = 0; c < n_channels; c++)
+                {
+                    drawboard_texture_pixels[i * n_channels + c] = encoded;
+                }
+            }
+        }
+
+        // upload the rectangle straight out of the full image
+        glBindTexture(GL_TEXTURE_2D, drawboard_texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, DIGIT_WIDTH);
+        glTexSubImage2D(
+            GL_TEXTURE_2D,
+            0,
+            rect.min_x,
+            rect.min_y,
+            rect.width(),
+            rect.height(),
+            n_channels == 1u ? GL_RED : GL_RGB,
+            GL_UNSIGNED_BYTE,
+            drawboard_texture_pixels.data()
+            + (rect.min_y * DIGIT_WIDTH + rect.min_x) * n_channels
         );
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
     }
 
     void App::cleanup_drawboard()
@@ -1529,9 +3218,18 @@ namespace digit_rec
         glDeleteTextures(1, &drawboard_texture);
     }
 
-    void App::handle_drawboard_drawing(bool& out_actually_drew_something)
+    void App::cursor_pos_callback(GLFWwindow* window, double x, double y)
+    {
+        App* app = (App*)glfwGetWindowUserPointer(window);
+        if (app->drawboard_cursor_path.size() < MAX_CURSOR_PATH_SIZE)
+        {
+            app->drawboard_cursor_path.push_back({ (float)x, (float)y });
+        }
+    }
+
+    void App::handle_drawboard_drawing(PixelRect& out_dirty_rect)
     {
-        out_actually_drew_something = false;
+        out_dirty_rect = {};
 
         const float cursor_x = io->MousePos.x;
         const float cursor_y = io->MousePos.y;
@@ -1547,6 +3245,7 @@ namespace digit_rec
             || (
                 cursor_x == drawboard_last_cursor_x
                 && cursor_y == drawboard_last_cursor_y
+                && drawboard_cursor_path.empty()
                 )
             )
         {
@@ -1554,6 +3253,7 @@ namespace digit_rec
             drawboard_last_mouse_down = mouse_down;
             drawboard_last_cursor_x = cursor_x;
             drawboard_last_cursor_y = cursor_y;
+            drawboard_cursor_path.clear();
             return;
         }
 
@@ -1576,87 +3276,430 @@ namespace digit_rec
         const float img_center_x = img_left + img_half_width;
         const float img_center_y = img_top + img_half_height;
 
-        static constexpr float DIGIT_HALF_WIDTH = .5f * (float)DIGIT_WIDTH;
-        static constexpr float DIGIT_HALF_HEIGHT = .5f * (float)DIGIT_HEIGHT;
+        // the stroke goes through every cursor position since the last frame
+        // and ends at the current one. all the segments are drawn before
+        // anything else is updated.
+        drawboard_cursor_path.push_back({ cursor_x, cursor_y });
 
-        static constexpr float DIGIT_MAX_DIM =
-            (float)std::max(DIGIT_WIDTH, DIGIT_HEIGHT);
-        static constexpr float DIGIT_MAX_DIM_INV = 1.f / DIGIT_MAX_DIM;
+        ImVec2 start{ drawboard_last_cursor_x, drawboard_last_cursor_y };
+        for (const ImVec2& end : drawboard_cursor_path)
+        {
+            if (end.x == start.x && end.y == start.y)
+            {
+                continue;
+            }
 
-        // all UV coordinates below are from -1 to +1. (0, 0) is the center.
+            // UV coordinates of the starting point and the end point of the
+            // line segment that we're about to draw. they're from -1 to +1,
+            // and (0, 0) is the center.
+            out_dirty_rect.add(draw_stroke_segment(
+                drawboard_image.data(),
+                (start.x - img_center_x) * img_max_dim_inv * 2.f,
+                (start.y - img_center_y) * img_max_dim_inv * 2.f,
+                (end.x - img_center_x) * img_max_dim_inv * 2.f,
+                (end.y - img_center_y) * img_max_dim_inv * 2.f
+            ));
+            start = end;
+        }
+        drawboard_cursor_path.clear();
 
-        // UV coordinates of the starting point and the end point of the line
-        // segment that we're about to draw.
-        float start_u = drawboard_last_cursor_x - img_center_x;
-        float start_v = drawboard_last_cursor_y - img_center_y;
-        float end_u = cursor_x - img_center_x;
-        float end_v = cursor_y - img_center_y;
-        start_u *= img_max_dim_inv * 2.f;
-        start_v *= img_max_dim_inv * 2.f;
-        end_u *= img_max_dim_inv * 2.f;
-        end_v *= img_max_dim_inv * 2.f;
+        // update last values
+        drawboard_last_mouse_down = mouse_down;
+        drawboard_last_cursor_x = cursor_x;
+        drawboard_last_cursor_y = cursor_y;
+    }
 
-        // draw line segment using signed distance fields
-        // see https://iquilezles.org/articles/distfunctions2d/
-        for (int32_t y = 0; y < DIGIT_HEIGHT; y++)
+    void App::network_evaluate_drawboard()
+    {
+        TRACE_SCOPE("Drawboard Inference");
+
+        const bool drawboard_net_updated =
+            load_latest_snapshot(drawboard_net, drawboard_net_version);
+        load_half_network(
+            drawboard_net,
+            drawboard_net_updated,
+            drawboard_half_net
+        );
+        if (!drawboard_net)
+        {
+            return;
+        }
+
+        drawboard_exit_layer = 0;
+
+        update_drawboard_ensemble();
+        if (drawboard_ensemble)
         {
-            for (int32_t x = 0; x < DIGIT_WIDTH; x++)
+            drawboard_ensemble->forward_pass(drawboard_image.data());
+            drawboard_inference_dirty_rect = DIGIT_RECT;
+            return;
+        }
+
+        if (drawboard_half_net)
+        {
+            auto net_input = drawboard_half_net->input_values();
+            for (size_t i = 0; i < N_DIGIT_VALUES; i++)
             {
-                // UV coordinates from -1 to +1. (0, 0) is the center.
-                float u = (float)x + .5f - DIGIT_HALF_WIDTH;
-                float v = (float)y + .5f - DIGIT_HALF_HEIGHT;
-                u *= DIGIT_MAX_DIM_INV * 2.f;
-                v *= DIGIT_MAX_DIM_INV * 2.f;
+                net_input[i] = drawboard_image[i];
+            }
+            drawboard_half_net->forward_pass();
+            drawboard_inference_dirty_rect = DIGIT_RECT;
+            return;
+        }
 
-                // distance of UV from the line segment
-                float dist = math::dist_segment(
-                    u, v,
-                    start_u, start_v,
-                    end_u, end_v
+        // training isn't running in the drawboard view, so exit_heads can be
+        // copied directly
+        if (!exit_heads)
+        {
+            drawboard_exit_heads = nullptr;
+        }
+        else if (!drawboard_exit_heads
+            || drawboard_exit_heads_version != drawboard_net_version)
+        {
+            drawboard_exit_heads =
+                std::make_unique<neural::ExitHeads<float, false>>(
+                    *drawboard_net
                 );
+            drawboard_exit_heads->copy_parameters_from(*exit_heads);
+            drawboard_exit_heads_version = drawboard_net_version;
+        }
 
-                // target value for this pixel, which gets brighter as UV gets
-                // closer to the line segment.
-                float target_v = math::remap01(dist, .15f, .05f);
-                target_v *= target_v;
-
-                // current value of this pixel
-                float curr_v = drawboard_image[y * DIGIT_WIDTH + x];
+        drawboard_update_first_layer();
+        if (drawboard_exit_heads)
+        {
+            drawboard_exit_layer = drawboard_exit_heads->forward_pass(
+                *drawboard_net,
+                EARLY_EXIT_THRESHOLD,
+                2u
+            );
+        }
+        else
+        {
+            for (size_t l = 2u; l < drawboard_net->n_layers(); l++)
+            {
+                drawboard_net->forward_layer(l);
+            }
+        }
+    }
 
-                // take the maximum of the current and target values
-                float final_v = std::max(curr_v, target_v);
+    void App::drawboard_update_first_layer()
+    {
+        // drawboard_net may have been recreated with the new weights and
+        // biases
+        if (!drawboard_incremental
+            || drawboard_incremental_version != drawboard_net_version
+            || &drawboard_incremental->network() != drawboard_net.get())
+        {
+            drawboard_incremental = std::make_unique<
+                neural::IncrementalForwardPass<float, false>
+            >(*drawboard_net);
+            drawboard_incremental_version = drawboard_net_version;
+            drawboard_inference_dirty_rect = DIGIT_RECT;
+        }
 
-                // update the drawboard image
-                drawboard_image[y * DIGIT_WIDTH + x] = final_v;
+        const PixelRect& rect = drawboard_inference_dirty_rect;
+        if (rect == DIGIT_RECT)
+        {
+            auto net_input = drawboard_net->input_values();
+            for (size_t i = 0; i < N_DIGIT_VALUES; i++)
+            {
+                net_input[i] = drawboard_image[i];
+            }
+            drawboard_incremental->invalidate();
+        }
+        else
+        {
+            // the pixels in the rectangle that didn't change are skipped
+            for (int32_t y = rect.min_y; y < rect.max_y; y++)
+            {
+                for (int32_t x = rect.min_x; x < rect.max_x; x++)
+                {
+                    const size_t i = y * DIGIT_WIDTH + x;
+                    drawboard_incremental->set_input(i, drawboard_image[i]);
+                }
             }
         }
+        drawboard_inference_dirty_rect = {};
 
-        // update last values
-        drawboard_last_mouse_down = mouse_down;
-        drawboard_last_cursor_x = cursor_x;
-        drawboard_last_cursor_y = cursor_y;
+        drawboard_incremental->update_first_layer();
+    }
 
-        // update the texture
-        update_drawboard_texture();
+    std::span<float> App::drawboard_output_values()
+    {
+        if (drawboard_ensemble)
+        {
+            return drawboard_ensemble->output_values(0);
+        }
+        if (drawboard_exit_layer > 0)
+        {
+            return drawboard_exit_heads->output_values();
+        }
+        return drawboard_half_net
+            ? drawboard_half_net->output_values()
+            : drawboard_net->output_values();
+    }
+
+    void App::add_drawboard_net_to_ensemble()
+    {
+        if (!drawboard_net)
+        {
+            return;
+        }
+
+        if (!ensemble_members.empty()
+            && (ensemble_members[0]->layer_sizes()
+                != drawboard_net->layer_sizes()
+                || ensemble_hidden_activation != val_hidden_activation
+                || ensemble_output_activation != val_output_activation))
+        {
+            ensemble_members.clear();
+        }
+
+        auto member = std::make_unique<neural::Network<float, false>>(
+            drawboard_net->layer_sizes(),
+            drawboard_net->activation_fns(),
+            drawboard_net->activation_derivs()
+        );
+        member->copy_parameters_from(*drawboard_net);
+        ensemble_members.push_back(std::move(member));
+
+        ensemble_hidden_activation = val_hidden_activation;
+        ensemble_output_activation = val_output_activation;
 
-        out_actually_drew_something = true;
+        drawboard_net_in_ensemble = true;
+        drawboard_ensemble = nullptr;
     }
 
-    void App::network_evaluate_drawboard()
+    void App::update_drawboard_ensemble()
+    {
+        // a single network isn't much of an ensemble
+        const size_t n_models = n_ensemble_models();
+        if (n_models < 2u
+            || !drawboard_net
+            || ensemble_members[0]->layer_sizes()
+            != drawboard_net->layer_sizes()
+            || ensemble_hidden_activation != val_hidden_activation
+            || ensemble_output_activation != val_output_activation)
+        {
+            drawboard_ensemble = nullptr;
+            return;
+        }
+
+        // the ensemble is reset whenever the members change. drawboard_net
+        // changes whenever it's loaded from a newer snapshot.
+        bool changed = false;
+        if (!drawboard_ensemble)
+        {
+            drawboard_ensemble = std::make_unique<neural::Ensemble<float>>(
+                drawboard_net->layer_sizes(),
+                drawboard_net->activation_fns(),
+                drawboard_net->activation_derivs(),
+                n_models,
+                1u
+            );
+            load_ensemble_models(*drawboard_ensemble);
+            drawboard_ensemble_version = drawboard_net_version;
+            changed = true;
+        }
+        else if (drawboard_ensemble_version != drawboard_net_version)
+        {
+            load_ensemble_models(*drawboard_ensemble);
+            drawboard_ensemble_version = drawboard_net_version;
+            changed = true;
+        }
+
+        if (changed || drawboard_ensemble->mode() != val_ensemble_mode)
+        {
+            drawboard_ensemble->set_mode(val_ensemble_mode);
+            start_ensemble_accuracy_job();
+        }
+
+        update_ensemble_accuracy();
+    }
+
+    void App::start_ensemble_accuracy_job()
+    {
+        ensemble_accuracy_ready = false;
+
+        // waiting for the old job here would block the UI, so it finishes
+        // first and its result is thrown away.
+        if (ensemble_accuracy_job)
+        {
+            ensemble_accuracy_restart = true;
+            return;
+        }
+
+        if (!task_pool || test_samples.empty())
+        {
+            ensemble_accuracy = 0.f;
+            ensemble_accuracy_ready = true;
+            return;
+        }
+
+        auto job = std::make_unique<EnsembleAccuracyJob>();
+        auto add_model = [&](const neural::Network<float, false>& model)
+            {
+                auto copy = std::make_unique<neural::Network<float, false>>(
+                    model.layer_sizes(),
+                    model.activation_fns(),
+                    model.activation_derivs()
+                );
+                copy->copy_parameters_from(model);
+                job->models.push_back(std::move(copy));
+            };
+        for (const auto& member : ensemble_members)
+        {
+            add_model(*member);
+        }
+        if (!drawboard_net_in_ensemble)
+        {
+            add_model(*drawboard_net);
+        }
+        job->mode = drawboard_ensemble->mode();
+
+        EnsembleAccuracyJob* job_ptr = job.get();
+        job->fn = [this, job_ptr]()
+            {
+                try
+                {
+                    job_ptr->accuracy = evaluate_ensemble_accuracy(*job_ptr);
+                }
+                catch (...)
+                {
+                    // rethrown by update_ensemble_accuracy()
+                    job_ptr->done = true;
+                    throw;
+                }
+                job_ptr->done = true;
+            };
+        job->group = std::make_unique<tasks::TaskGroup>(*task_pool);
+        job->group->run(job->fn);
+
+        ensemble_accuracy_job = std::move(job);
+    }
+
+    void App::update_ensemble_accuracy()
+    {
+        if (!ensemble_accuracy_job || !ensemble_accuracy_job->done)
+        {
+            return;
+        }
+
+        // fn already returned, so this only waits for the pool to finish up
+        // the task and rethrows its exception, if any.
+        ensemble_accuracy_job->group->wait();
+        ensemble_accuracy = ensemble_accuracy_job->accuracy;
+        ensemble_accuracy_job = nullptr;
+
+        if (ensemble_accuracy_restart)
+        {
+            ensemble_accuracy_restart = false;
+            start_ensemble_accuracy_job();
+        }
+        else
+        {
+            ensemble_accuracy_ready = true;
+        }
+    }
+
+    size_t App::n_ensemble_models() const
+    {
+        return ensemble_members.size() + (drawboard_net_in_ensemble ? 0u : 1u);
+    }
+
+    void App::load_ensemble_models(neural::Ensemble<float>& ensemble)
     {
-        auto net_input = net->input_values();
-        for (size_t i = 0; i < N_DIGIT_VALUES; i++)
+        for (size_t i = 0; i < ensemble_members.size(); i++)
+        {
+            ensemble.set_model(i, *ensemble_members[i]);
+        }
+        if (!drawboard_net_in_ensemble)
         {
-            net_input[i] = drawboard_image[i];
+            ensemble.set_model(ensemble_members.size(), *drawboard_net);
         }
-        net->forward_pass();
+    }
+
+    float App::evaluate_ensemble_accuracy(const EnsembleAccuracyJob& job)
+    {
+        TRACE_SCOPE("Ensemble Evaluation");
+
+        // every task evaluates its share of the test dataset with its own
+        // copy of the ensemble
+        static constexpr size_t n_tests_per_task = 500;
+        std::atomic_size_t n_correct_predict = 0;
+        tasks::parallel_for(
+            *task_pool,
+            0,
+            test_samples.size(),
+            n_tests_per_task,
+            [&](size_t begin, size_t end)
+            {
+                PROFILE_SCOPE(Evaluation);
+
+                const auto& first_model = *job.models[0];
+                neural::Ensemble<float> ensemble(
+                    first_model.layer_sizes(),
+                    first_model.activation_fns(),
+                    first_model.activation_derivs(),
+                    job.models.size(),
+                    ENSEMBLE_BATCH_SIZE,
+                    job.mode
+                );
+                for (size_t m = 0; m < job.models.size(); m++)
+                {
+                    ensemble.set_model(m, *job.models[m]);
+                }
+
+                std::vector<float> inputs(
+                    ENSEMBLE_BATCH_SIZE * N_DIGIT_VALUES
+                );
+                std::array<const float*, ENSEMBLE_BATCH_SIZE> input_ptrs;
+                for (size_t i = 0; i < ENSEMBLE_BATCH_SIZE; i++)
+                {
+                    input_ptrs[i] = inputs.data() + i * N_DIGIT_VALUES;
+                }
+
+                size_t n_correct = 0;
+                for (size_t i = begin; i < end; i += ENSEMBLE_BATCH_SIZE)
+                {
+                    const size_t n = std::min(ENSEMBLE_BATCH_SIZE, end - i);
+                    for (size_t j = 0; j < n; j++)
+                    {
+                        const auto& samp = test_samples[i + j];
+                        for (size_t k = 0; k < N_DIGIT_VALUES; k++)
+                        {
+                            inputs[j * N_DIGIT_VALUES + k] =
+                                (float)samp.values[k] / 255.f;
+                        }
+                    }
+
+                    ensemble.forward_pass(
+                        std::span<const float* const>(input_ptrs.data(), n)
+                    );
+                    for (size_t j = 0; j < n; j++)
+                    {
+                        if (ensemble.predicted_label(j)
+                            == test_samples[i + j].label)
+                        {
+                            n_correct++;
+                        }
+                    }
+                }
+                n_correct_predict += n_correct;
+
+                // make this worker's timings visible to other threads
+                profiler::flush();
+            }
+        );
+
+        return (float)n_correct_predict / (float)test_samples.size();
     }
 
     void App::update_network_guess_text(int32_t correct_label)
     {
         network_guess_type = NetworkGuessType::Unknown;
 
-        if (!net)
+        if (!drawboard_net)
         {
             network_guess_text = "No neural network";
             return;
@@ -1664,7 +3707,7 @@ namespace digit_rec
 
         std::array<float, 3> top_three_values{};
         auto top_three_idx = find_top_three_indexes(
-            net->output_values(),
+            drawboard_output_values(),
             top_three_values
         );
 
@@ -1746,30 +3789,21 @@ namespace digit_rec
         const auto& samp =
             test_samples[idx_dist(rng_drawboard_pick_test_sample)];
 
-        // feed it to the network
-        for (size_t i = 0; i < N_DIGIT_VALUES; i++)
-        {
-            drawboard_image[i] = (float)samp.values[i] / 255.f;
-        }
-
-        // randomly transform the image if needed
+        // feed it to the network, randomly transformed if needed
+        const uint8_t* src_digit = samp.values.data();
+        float* dst_digit = drawboard_image.data();
+        TransformParams params;
         if (val_random_transform)
         {
-            float digit_data_copy[N_DIGIT_VALUES];
-            std::copy(
-                drawboard_image.data(),
-                drawboard_image.data() + N_DIGIT_VALUES,
-                digit_data_copy
-            );
-
-            apply_random_transform(
+            random_transforms.sample(
                 rng_drawboard_random_test_sample_random_transforms,
-                digit_data_copy,
-                drawboard_image.data(),
-                true
+                { &params, 1 },
+                TransformStrength::Mild
             );
         }
+        apply_transforms({ &src_digit, 1 }, { &params, 1 }, { &dst_digit, 1 });
 
+        drawboard_inference_dirty_rect = DIGIT_RECT;
         update_drawboard_texture();
         network_evaluate_drawboard();
         update_network_guess_text((int32_t)samp.label);
@@ -13,8 +13,10 @@
 #include <functional>
 #include <thread>
 #include <atomic>
+#include <mutex>
 #include <chrono>
 #include <limits>
+#include <type_traits>
 #include <algorithm>
 #include <random>
 #include <stdexcept>
@@ -32,10 +34,22 @@
 #include "GLFW/glfw3.h"
 
 #include "neural.hpp"
+#include "static_network.hpp"
+#include "half_network.hpp"
+#include "ensemble.hpp"
+#include "early_exit.hpp"
+#include "incremental_network.hpp"
+#include "parallel_trainer.hpp"
+#include "task_pool.hpp"
 #include "endian.hpp"
 #include "stream.hpp"
 #include "str.hpp"
 #include "math.hpp"
+#include "alloc_counter.hpp"
+#include "metrics.hpp"
+#include "profiler.hpp"
+#include "trace.hpp"
+#include "synthetic_digits.hpp"
 
 namespace digit_rec
 {
@@ -70,10 +84,39 @@ namespace digit_rec
     static constexpr auto TEST_IMAGES_PATH = "./MNIST/t10k-images.idx3-ubyte";
     static constexpr auto TEST_LABELS_PATH = "./MNIST/t10k-labels.idx1-ubyte";
 
+    // where App::run_synthesize() saves the synthetic digits
+    static constexpr auto SYNTHETIC_IMAGES_PATH =
+        "./synthetic-images.idx3-ubyte";
+    static constexpr auto SYNTHETIC_LABELS_PATH =
+        "./synthetic-labels.idx1-ubyte";
+
+    // where timeline traces are saved (only if DIGIT_REC_TRACE is defined)
+    static constexpr auto TRACE_PATH = "./trace.json";
+
+    // how often the training thread publishes a snapshot of the network's
+    // weights and biases for other threads to use (in milliseconds)
+    static constexpr int64_t SNAPSHOT_INTERVAL_MS = 100;
+
     static constexpr size_t DIGIT_WIDTH = 28;
     static constexpr size_t DIGIT_HEIGHT = 28;
     static constexpr size_t N_DIGIT_VALUES = DIGIT_WIDTH * DIGIT_HEIGHT;
 
+    // network with a compile-time topology for the given hidden layer sizes,
+    // using leaky ReLU in the hidden layers and tanh in the output layer (the
+    // default settings). training automatically uses one of these instead of
+    // neural::Network when the settings match (see start_training_thread()).
+    template<size_t... hidden_layer_sizes>
+    using StaticDigitNetwork = neural::StaticNetwork<
+        float,
+        neural::leaky_relu<float, .01f>,
+        neural::leaky_relu_deriv<float, .01f>,
+        neural::tanh<float>,
+        neural::tanh_deriv<float>,
+        N_DIGIT_VALUES,
+        hidden_layer_sizes...,
+        10
+    >;
+
     struct DigitSample
     {
         // pixel values for a digit stored in a row major format
@@ -83,6 +126,196 @@ namespace digit_rec
         uint32_t label;
     };
 
+    // maximum number of pixels that get random noise in a transformed digit
+    static constexpr size_t MAX_NOISY_PIXELS = 5;
+
+    // a transformation of a digit image (see apply_transforms()). the
+    // default parameters only convert the pixel values to floats from 0 to 1.
+    struct TransformParams
+    {
+        // whether the image is resampled with the affine mapping and the
+        // displacement field below.
+        bool resample = false;
+
+        // pixel coordinates in the source image for the pixel (x, y) of the
+        // transformed image, where (0, 0) is the center of the top left
+        // pixel: (xx * x + xy * y + x0, yx * x + yy * y + y0)
+        float xx = 1.f;
+        float xy = 0.f;
+        float x0 = 0.f;
+        float yx = 0.f;
+        float yy = 1.f;
+        float y0 = 0.f;
+
+        // optional (x, y) offsets in pixels for every pixel of the
+        // transformed image, multiplied by displacement_scale and added to
+        // the coordinates above (elastic distortion)
+        const float* displacement = nullptr;
+        float displacement_scale = 0.f;
+
+        // multiplier for the pixel values (contrast)
+        float gain = 1.f;
+
+        // how much to thicken (above 0) or thin (below 0) the strokes, from
+        // -1 to +1. every pixel is mixed with the highest or lowest value
+        // around it by this amount.
+        float thickness = 0.f;
+
+        // pixels that get noise added to them at the end
+        uint32_t n_noisy_pixels = 0;
+        std::array<uint16_t, MAX_NOISY_PIXELS> noise_idx{};
+        std::array<float, MAX_NOISY_PIXELS> noise{};
+    };
+
+    // how strongly RandomTransforms changes the images
+    enum class TransformStrength
+    {
+        // only slight scaling, rotation, and movement, and noise in a few
+        // pixels. this is used for the test accuracy so that it stays
+        // comparable with older runs.
+        Mild,
+
+        // everything, for training
+        Full
+    };
+
+    // random transformations of digit images for training. half of the
+    // images are slightly scaled, rotated, sheared, moved, and elastically
+    // distorted (bilinear interpolation blurs everything out and we'd like to
+    // still have some sharp samples), some of them get thicker or thinner
+    // strokes, and all of them get a random contrast and noise in a few
+    // pixels (see TransformStrength).
+    // * elastic distortion uses smoothed random displacement fields, which
+    //   are expensive to make, so a pool of them is made in the constructor
+    //   and every sample only picks one with a random strength.
+    // * the sines and cosines are calculated here so that apply_transforms()
+    //   only does the sampling.
+    class RandomTransforms
+    {
+    public:
+        // number of displacement fields in the pool
+        static constexpr size_t N_DISPLACEMENT_FIELDS = 256;
+
+        // standard deviation of the gaussian blur that smooths the random
+        // displacement fields (in pixels)
+        static constexpr float DISPLACEMENT_SIGMA = 4.f;
+
+        // the strongest elastic distortion (in pixels)
+        static constexpr float MAX_DISPLACEMENT = 2.f;
+
+        RandomTransforms(uint32_t seed = 0);
+
+        RandomTransforms(const RandomTransforms&) = delete;
+        RandomTransforms& operator=(const RandomTransforms&) = delete;
+
+        // fill out_params with random transformations. the parameters
+        // point to displacement fields in this object, so it must outlive
+        // them.
+        template<typename RandomEngine>
+        void sample(
+            RandomEngine& engine,
+            std::span<TransformParams> out_params,
+            TransformStrength strength = TransformStrength::Full
+        ) const
+        {
+            const bool full = strength == TransformStrength::Full;
+
+            static constexpr float HALF_WIDTH = .5f * (float)DIGIT_WIDTH;
+            static constexpr float HALF_HEIGHT = .5f * (float)DIGIT_HEIGHT;
+
+            // pixels per unit of UV coordinates (from -1 to +1)
+            static constexpr float UV_TO_PIXELS =
+                .5f * (float)std::max(DIGIT_WIDTH, DIGIT_HEIGHT);
+
+            static constexpr float DEG2RAD = .0174532925199f;
+
+            std::uniform_real_distribution<float> dist(0.f, 1.f);
+            std::uniform_int_distribution<size_t> idx_dist(
+                0,
+                N_DIGIT_VALUES - 1u
+            );
+            std::uniform_int_distribution<size_t> field_dist(
+                0,
+                N_DISPLACEMENT_FIELDS - 1u
+            );
+
+            for (auto& params : out_params)
+            {
+                params = TransformParams{};
+                if (dist(engine) < .5f)
+                {
+                    const float scale = .9f + .2f * dist(engine);
+                    const float rotation =
+                        (-2.f + 4.f * dist(engine)) * DEG2RAD;
+                    const float shear =
+                        full ? -.15f + .3f * dist(engine) : 0.f;
+                    const float offset_x =
+                        (-.16f + .32f * dist(engine)) * UV_TO_PIXELS;
+                    const float offset_y =
+                        (-.16f + .32f * dist(engine)) * UV_TO_PIXELS;
+
+                    // shear, scale, rotate, and move around the center (in
+                    // this order when going from the source to the
+                    // transformed image, and the other way around here).
+                    const float c = std::cos(rotation) / scale;
+                    const float s = std::sin(rotation) / scale;
+                    const float a = c + shear * s;
+                    const float b = s - shear * c;
+                    const float cx = .5f - HALF_WIDTH - offset_x;
+                    const float cy = .5f - HALF_HEIGHT - offset_y;
+
+                    params.resample = true;
+                    params.xx = a;
+                    params.xy = b;
+                    params.x0 = a * cx + b * cy + HALF_WIDTH - .5f;
+                    params.yx = -s;
+                    params.yy = c;
+                    params.y0 = c * cy - s * cx + HALF_HEIGHT - .5f;
+
+                    if (full)
+                    {
+                        params.displacement = displacement_fields.data()
+                            + field_dist(engine) * 2u * N_DIGIT_VALUES;
+                        params.displacement_scale =
+                            MAX_DISPLACEMENT * (-1.f + 2.f * dist(engine));
+                    }
+                }
+
+                if (full)
+                {
+                    if (dist(engine) < .3f)
+                    {
+                        params.thickness = -1.f + 2.f * dist(engine);
+                    }
+                    params.gain = .75f + .5f * dist(engine);
+                }
+
+                params.n_noisy_pixels = MAX_NOISY_PIXELS;
+                for (size_t i = 0; i < MAX_NOISY_PIXELS; i++)
+                {
+                    params.noise_idx[i] = (uint16_t)idx_dist(engine);
+                    params.noise[i] = -.5f + dist(engine);
+                }
+            }
+        }
+
+    private:
+        // N_DISPLACEMENT_FIELDS fields with an (x, y) offset for every pixel.
+        // the longest offset in every field is 1 pixel long.
+        std::vector<float> displacement_fields;
+
+    };
+
+    // render the digit images in src_digits (N_DIGIT_VALUES 8-bit values
+    // each) transformed with the matching params into dst_digits
+    // (N_DIGIT_VALUES floats each). the sources are read directly, so they
+    // must not overlap the destinations. all spans must have the same size.
+    void apply_transforms(
+        std::span<const uint8_t* const> src_digits,
+        std::span<const TransformParams> params,
+        std::span<float* const> dst_digits
+    );
+
     enum class UiMode
     {
         Settings,
@@ -102,12 +335,184 @@ namespace digit_rec
         "Tanh"
     };
 
+    // how the weights and biases are stored for evaluating the accuracy and
+    // the drawboard. training always uses FP32.
+    enum class InferencePrecision : int
+    {
+        Fp32,
+        Bf16,
+        Fp16
+    };
+    static constexpr const char* InferencePrecision_str[] = {
+        "FP32",
+        "BF16",
+        "FP16"
+    };
+
+    // how the drawboard combines the outputs of the networks in the ensemble
+    // (see neural::EnsembleMode)
+    using neural::EnsembleMode;
+    static constexpr const char* EnsembleMode_str[] = {
+        "Average",
+        "Vote"
+    };
+
+    // what the horizontal axis of the accuracy plot represents
+    enum class PlotAxis : int
+    {
+        Evaluation,
+        SamplesSeen,
+        WallTime
+    };
+    static constexpr const char* PlotAxis_str[] = {
+        "Evaluations",
+        "Samples Seen",
+        "Wall Time"
+    };
+
+    // read digit samples in the MNIST (IDX) format and append them to
+    // out_samples.
+    void load_digit_samples(
+        std::string_view images_path,
+        std::string_view labels_path,
+        std::vector<DigitSample>& out_samples
+    );
+
+    // write digit samples in the MNIST (IDX) format, replacing the files if
+    // they exist.
+    void save_digit_samples(
+        std::string_view images_path,
+        std::string_view labels_path,
+        const std::vector<DigitSample>& samples
+    );
+
+    // parse and verify a comma separated list of layer sizes. returns
+    // std::nullopt on success, and an error message on failure.
+    std::optional<std::string> parse_layer_sizes(
+        std::string_view s,
+        std::vector<size_t>& out_layer_sizes
+    );
+
+    // activation functions and their derivatives for every layer (except the
+    // input layer) of a network with n_layers layers.
+    void make_activation_fns(
+        size_t n_layers,
+        ActivationFunc hidden_activation,
+        ActivationFunc output_activation,
+        std::vector<std::function<float(float)>>& out_activation_fns,
+        std::vector<std::function<float(float)>>& out_activation_derivs
+    );
+
+    // randomly pick a sample from samples for every element of out_batch,
+    // write its (randomly transformed, if random_transforms is given) input
+    // data to input_data (N_DIGIT_VALUES values per element), and set the
+    // label of the element. the input pointers of out_batch aren't used. if
+    // synthetic_digits is given, a synthetic digit is drawn instead with a
+    // probability of synthetic_ratio (see SyntheticDigits).
+    void load_training_batch(
+        const std::vector<DigitSample>& samples,
+        std::mt19937& rng_pick_sample,
+        std::mt19937& rng_random_transforms,
+        const RandomTransforms* random_transforms,
+        float* input_data,
+        std::span<neural::LabeledInput<float>> out_batch,
+        const SyntheticDigits* synthetic_digits = nullptr,
+        float synthetic_ratio = 0.f
+    );
+
+    // a rectangle of pixels in a digit image, from (min_x, min_y) up to but
+    // not including (max_x, max_y)
+    struct PixelRect
+    {
+        int32_t min_x = 0;
+        int32_t min_y = 0;
+        int32_t max_x = 0;
+        int32_t max_y = 0;
+
+        constexpr bool empty() const
+        {
+            return min_x >= max_x || min_y >= max_y;
+        }
+
+        constexpr int32_t width() const
+        {
+            return max_x - min_x;
+        }
+
+        constexpr int32_t height() const
+        {
+            return max_y - min_y;
+        }
+
+        // grow the rectangle to contain another one
+        constexpr void add(const PixelRect& other)
+        {
+            if (other.empty())
+                return;
+
+            if (empty())
+            {
+                *this = other;
+                return;
+            }
+
+            min_x = std::min(min_x, other.min_x);
+            min_y = std::min(min_y, other.min_y);
+            max_x = std::max(max_x, other.max_x);
+            max_y = std::max(max_y, other.max_y);
+        }
+
+        constexpr bool operator==(const PixelRect&) const = default;
+    };
+
+    // every pixel of a digit image
+    static constexpr PixelRect DIGIT_RECT{ 0, 0, DIGIT_WIDTH, DIGIT_HEIGHT };
+
+    // pixels at most STROKE_INNER_RADIUS away from the center of a brush
+    // stroke are fully bright, and the ones STROKE_OUTER_RADIUS away or more
+    // aren't touched (in UV coordinates, see draw_stroke_segment()).
+    static constexpr float STROKE_INNER_RADIUS = .05f;
+    static constexpr float STROKE_OUTER_RADIUS = .15f;
+
+    // draw a line segment of a brush stroke into a digit image with
+    // N_DIGIT_VALUES values. the coordinates are UV coordinates from -1 to +1
+    // where (0, 0) is the center of the image. pixels only get brighter, and
+    // only the ones in the bounding box of the stroke are visited. returns the
+    // rectangle of pixels that changed. the radii can be changed for thinner
+    // or thicker strokes.
+    PixelRect draw_stroke_segment(
+        float* image,
+        float start_u,
+        float start_v,
+        float end_u,
+        float end_v,
+        float inner_radius = STROKE_INNER_RADIUS,
+        float outer_radius = STROKE_OUTER_RADIUS
+    );
+
+    // how often the training view updates the live training speed (in
+    // milliseconds)
+    static constexpr int64_t THROUGHPUT_INTERVAL_MS = 500;
+
     class App
     {
     public:
-        App() = default;
+        App();
         void run();
 
+        // train without any UI using the default settings and print the
+        // training metrics to the standard output. training runs for
+        // duration_seconds or forever if duration_seconds is 0. if n_threads
+        // is more than 1, every batch is split between n_threads workers (see
+        // val_n_worker_threads), and the batch size is raised to n_threads if
+        // it's smaller.
+        void run_headless(uint64_t duration_seconds, uint32_t n_threads = 1);
+
+        // draw n_samples synthetic digits (see SyntheticDigits) on n_threads
+        // threads without any UI, print how fast they were generated, and
+        // save them to SYNTHETIC_IMAGES_PATH and SYNTHETIC_LABELS_PATH.
+        void run_synthesize(uint64_t n_samples, uint32_t n_threads = 1);
+
     private:
         void init();
         void loop();
@@ -129,37 +534,156 @@ namespace digit_rec
         uint32_t val_batch_size = 1;
         uint32_t val_seed = 12345678;
         bool val_random_transform = true;
+        bool val_record_training_metrics = true;
+        InferencePrecision val_inference_precision = InferencePrecision::Fp32;
+        uint32_t val_n_worker_threads = 1;
+        EnsembleMode val_ensemble_mode = EnsembleMode::Average;
+        bool val_early_exit = false;
+        float val_synthetic_ratio = 0.f;
 
         std::vector<DigitSample> train_samples;
         std::vector<DigitSample> test_samples;
+
+        // used if val_random_transform is on
+        RandomTransforms random_transforms;
+
+        // mixed into the training samples with a probability of
+        // val_synthetic_ratio
+        SyntheticDigits synthetic_digits;
+
+        // memory for the weights, biases, gradients, and scratch buffers of
+        // net. this must be declared before net so that it outlives it.
+        arena::Arena net_arena{ arena::Options{ .huge_pages = true } };
         std::unique_ptr<neural::Network<float, true>> net = nullptr;
 
+        // snapshots of the weights and biases in net, published periodically
+        // by the training thread. other threads must only use net through
+        // these snapshots while training is running.
+        neural::SnapshotChannel<float> net_snapshots;
+
+        // classifiers on the hidden layers of net, trained together with it
+        // if val_early_exit was on (see neural::ExitHeads). only the training
+        // thread uses them while training is running, other threads get
+        // copies while the training thread is waiting for them to evaluate
+        // the accuracy.
+        std::unique_ptr<neural::ExitHeads<float, true>> exit_heads = nullptr;
+
+        // top output value that a head needs to stop the forward pass early
+        static constexpr float EARLY_EXIT_THRESHOLD = .9f;
+
+        // fraction of the tests in the last accuracy recalculation that
+        // exited at every layer after the input layer (the last one is the
+        // output layer).
+        std::vector<float> early_exit_fractions;
+        std::mutex early_exit_mutex;
+
+        // threads shared by parallel training and evaluation, with
+        // val_n_worker_threads workers. this is created in
+        // prepare_for_training() and must outlive the training thread.
+        std::unique_ptr<tasks::Pool> task_pool = nullptr;
+
+        // networks used by a worker of task_pool for evaluating the accuracy
+        struct EvalNetworks
+        {
+            // loaded from the latest snapshot
+            std::unique_ptr<neural::Network<float, false>> net = nullptr;
+            uint64_t net_version = 0;
+
+            // 16-bit copy of net, only used if val_inference_precision isn't
+            // FP32.
+            std::unique_ptr<neural::HalfNetwork<float>> half_net = nullptr;
+
+            // copy of exit_heads, only used with FP32 inference
+            std::unique_ptr<neural::ExitHeads<float, false>> exit_heads =
+                nullptr;
+        };
+
+        // counters shared by the workers when evaluating with exit heads
+        struct EarlyExitCounts
+        {
+            // number of tests that exited at every layer
+            std::vector<std::atomic_size_t> n_exits;
+
+            // number of correct predictions with early exits
+            std::atomic_size_t n_correct = 0;
+        };
+
+        // networks for evaluating the accuracy on every worker of task_pool.
+        // each worker only uses its own.
+        std::vector<EvalNetworks> eval_nets;
+
         std::unique_ptr<std::jthread> training_thread = nullptr;
         std::atomic_uint64_t n_training_steps = 0;
 
-        // accuracy of the network over time
-        std::vector<float> accuracy_history;
+        // whether the training thread is using a StaticDigitNetwork
+        std::atomic_bool training_with_static_network = false;
+
+        // number of NUMA nodes the parallel training workers are spread over,
+        // or 0 if training isn't parallel.
+        std::atomic_size_t n_training_numa_nodes = 0;
+
+        // accuracy and other training metrics over time. this is written by
+        // the training thread and can be read from any thread. the training
+        // cost and accuracy are collected from the same forward passes used
+        // for training, so they don't cost any extra computation. they're
+        // only recorded when val_record_training_metrics is true.
+        metrics::History metrics_history;
+
+        // copy of metrics_history made by the UI thread in every frame
+        std::vector<metrics::Sample> ui_metrics;
+
+        // accuracy values to plot, evenly spaced along val_plot_axis
+        PlotAxis val_plot_axis = PlotAxis::Evaluation;
+        std::vector<float> ui_accuracy_plot;
+
+        // live training speed measured by the UI thread from
+        // n_training_steps, updated every THROUGHPUT_INTERVAL_MS.
+        float ui_steps_per_second = 0.f;
+        uint64_t ui_throughput_last_step = 0;
+        std::chrono::steady_clock::time_point ui_throughput_last_time;
 
         // the last time we recalculated the accuracy
         std::chrono::steady_clock::time_point last_accuracy_calc_time;
 
+        // time spent training before the training thread was last started,
+        // and the time it was started.
+        std::chrono::steady_clock::duration training_time_before_start{};
+        std::chrono::steady_clock::time_point training_start_time;
+
+        // the step count and time of the last sample in metrics_history
+        // (only used by the training thread).
+        uint64_t last_metrics_step = 0;
+        std::chrono::steady_clock::time_point last_metrics_time;
+
         // pseudo-random number generators for training
         std::mt19937 rng_train_pick_sample{ 0 };
         std::mt19937 rng_train_random_transforms{ 0 };
 
+        // pseudo-random number generators for every parallel training worker
+        // (see val_n_worker_threads). each worker only uses its own.
+        struct WorkerRngs
+        {
+            std::mt19937 pick_sample;
+            std::mt19937 random_transforms;
+        };
+        std::vector<WorkerRngs> training_worker_rngs;
+
+        // copy of train_samples on every NUMA node, made by the parallel
+        // training workers so that they only read node-local memory. this is
+        // empty on machines with a single node, where the workers read
+        // train_samples directly.
+        std::vector<std::vector<DigitSample>> node_train_samples;
+
         void init_ui();
         void draw_ui();
 
         void layout_settings();
         void layout_training();
+        void update_live_throughput();
+        void update_accuracy_plot();
+        void layout_profiler_breakdown();
         void layout_drawboard();
 
-        void load_digit_samples(
-            std::string_view images_path,
-            std::string_view labels_path,
-            std::vector<DigitSample>& out_samples
-        );
-
         // returns std::nullopt on success, and an error message on failure.
         std::optional<std::string> prepare_for_training();
 
@@ -167,7 +691,67 @@ namespace digit_rec
         void start_training_thread(bool recalculate_accuracy_at_beginning);
         void stop_training_thread();
 
-        void recalculate_accuracy_and_add_to_history();
+        // run the training loop on the training thread with one of the given
+        // StaticDigitNetwork types if one of them matches net and the
+        // settings. returns false if none of them match.
+        template<typename... StaticNetTypes>
+        bool run_static_training_loop(
+            std::stop_token stoken,
+            bool recalculate_accuracy_at_beginning
+        );
+
+        // run the training loop on the training thread with a
+        // neural::ParallelTrainer on every worker of task_pool.
+        void run_parallel_training_loop(
+            std::stop_token stoken,
+            bool recalculate_accuracy_at_beginning
+        );
+
+        // run the training loop on the training thread until a stop is
+        // requested. train_net is either net itself, a StaticNetwork with
+        // the same topology, or a ParallelTrainer, which are copied into net
+        // when needed.
+        template<typename NetType>
+        void run_training_loop(
+            std::stop_token stoken,
+            NetType& train_net,
+            bool recalculate_accuracy_at_beginning
+        );
+
+        // recalculate the accuracy and add it to metrics_history along with
+        // the training metrics collected since the last call.
+        void recalculate_accuracy_and_add_to_history(
+            const neural::BatchStats<float>& training_stats
+        );
+
+        // evaluate the tests in [begin, end) out of the ones done in
+        // recalculate_accuracy_and_add_to_history() on the current worker of
+        // task_pool, and return the number of correct predictions. if
+        // early_exit_counts isn't null, the tests are also predicted with
+        // early exits using a copy of exit_heads.
+        size_t evaluate_tests(
+            size_t begin,
+            size_t end,
+            EarlyExitCounts* early_exit_counts
+        );
+
+        // copy the weights and biases from the latest snapshot into target if
+        // target doesn't have them already (target_version keeps track of
+        // this). target will be (re)created if needed. returns true if target
+        // was updated.
+        bool load_latest_snapshot(
+            std::unique_ptr<neural::Network<float, false>>& target,
+            uint64_t& target_version
+        );
+
+        // keep target in sync with source if val_inference_precision isn't
+        // FP32, or reset it otherwise. source_updated tells whether source
+        // got new weights and biases since the last call.
+        void load_half_network(
+            std::unique_ptr<neural::Network<float, false>>& source,
+            bool source_updated,
+            std::unique_ptr<neural::HalfNetwork<float>>& target
+        );
 
         // display a tooltip on the current UI item containing information about
         // the neural network (if mouse is hovering over the current item).
@@ -182,12 +766,113 @@ namespace digit_rec
 
     private:
         std::array<float, N_DIGIT_VALUES> drawboard_image{ 0.f };
+
+        // network used for evaluating the drawboard, loaded from the latest
+        // snapshot.
+        std::unique_ptr<neural::Network<float, false>> drawboard_net = nullptr;
+        uint64_t drawboard_net_version = 0;
+
+        // 16-bit copy of drawboard_net, only used if val_inference_precision
+        // isn't FP32.
+        std::unique_ptr<neural::HalfNetwork<float>> drawboard_half_net =
+            nullptr;
+
+        // copy of exit_heads used for the drawboard with FP32 inference if
+        // there's no ensemble, and the layer where the last prediction was
+        // made (0 if early exits weren't used). drawboard_exit_heads_version
+        // is the version of drawboard_net it was copied for.
+        std::unique_ptr<neural::ExitHeads<float, false>> drawboard_exit_heads =
+            nullptr;
+        uint64_t drawboard_exit_heads_version = 0;
+        size_t drawboard_exit_layer = 0;
+
+        // forward passes of drawboard_net with FP32 inference, which only
+        // feed the pixels that changed since the last evaluation to the first
+        // layer. drawboard_incremental_version is the version of drawboard_net
+        // it was created for.
+        std::unique_ptr<neural::IncrementalForwardPass<float, false>>
+            drawboard_incremental = nullptr;
+        uint64_t drawboard_incremental_version = 0;
+
+        // pixels of the drawboard that changed since it was last evaluated
+        PixelRect drawboard_inference_dirty_rect = DIGIT_RECT;
+
+        // networks added to the ensemble in the drawboard view, which are
+        // evaluated together with drawboard_net. resetting doesn't remove
+        // them, so networks trained with different settings (like the seed)
+        // can be combined, but they must all have the same layer sizes and
+        // activation functions.
+        std::vector<std::unique_ptr<neural::Network<float, false>>>
+            ensemble_members;
+        ActivationFunc ensemble_hidden_activation = ActivationFunc::LeakyRelu;
+        ActivationFunc ensemble_output_activation = ActivationFunc::Tanh;
+
+        // whether drawboard_net was added to ensemble_members and hasn't
+        // trained since
+        bool drawboard_net_in_ensemble = false;
+
+        // ensemble_members and drawboard_net (the last model, unless it's
+        // already a member), used for the drawboard instead of drawboard_net
+        // if the members match it. drawboard_ensemble_version is the version
+        // of drawboard_net it was last loaded with.
+        std::unique_ptr<neural::Ensemble<float>> drawboard_ensemble = nullptr;
+        uint64_t drawboard_ensemble_version = 0;
+
+        // accuracy of drawboard_ensemble on the whole test dataset. it's
+        // only up to date if ensemble_accuracy_ready is true.
+        float ensemble_accuracy = 0.f;
+        bool ensemble_accuracy_ready = false;
+
+        // evaluation of the ensemble's accuracy running in the background on
+        // task_pool, so that the UI doesn't have to wait for it. the job has
+        // its own copies of the models. it's nullptr if nothing is running,
+        // and ensemble_accuracy_restart is true if the ensemble changed
+        // while it was running.
+        struct EnsembleAccuracyJob
+        {
+            std::vector<std::unique_ptr<neural::Network<float, false>>> models;
+            EnsembleMode mode = EnsembleMode::Average;
+
+            std::function<void()> fn;
+            float accuracy = 0.f;
+            std::atomic_bool done = false;
+
+            // destroyed first, which waits for fn to return
+            std::unique_ptr<tasks::TaskGroup> group = nullptr;
+        };
+        std::unique_ptr<EnsembleAccuracyJob> ensemble_accuracy_job = nullptr;
+        bool ensemble_accuracy_restart = false;
+
+        // number of test samples evaluated together by every model in an
+        // ensemble
+        static constexpr size_t ENSEMBLE_BATCH_SIZE = 50;
+
         GLuint drawboard_texture = 0;
 
+        // sRGB-encoded pixels of drawboard_texture. the texture has a single
+        // channel that's swizzled into gray if the GPU supports it, otherwise
+        // every pixel is stored as RGB.
+        std::array<uint8_t, 3u * N_DIGIT_VALUES> drawboard_texture_pixels{};
+        size_t drawboard_texture_channels = 1;
+
+        // 8-bit OETF (so-called gamma correction) of every 12-bit luminance
+        // value
+        static constexpr size_t GAMMA_LUT_SIZE = 4096;
+        std::array<uint8_t, GAMMA_LUT_SIZE> drawboard_gamma_lut{};
+
         bool drawboard_last_mouse_down = false;
         float drawboard_last_cursor_x = 0.f;
         float drawboard_last_cursor_y = 0.f;
 
+        // cursor positions reported by GLFW since the last frame. the mouse
+        // can move a lot in one frame, and the stroke should follow its path
+        // instead of taking a shortcut.
+        std::vector<ImVec2> drawboard_cursor_path;
+        static constexpr size_t MAX_CURSOR_PATH_SIZE = 256;
+
+        // chained before ImGui's cursor position callback
+        static void cursor_pos_callback(GLFWwindow* window, double x, double y);
+
         enum class NetworkGuessType
         {
             Unknown,
@@ -213,13 +898,48 @@ namespace digit_rec
 
         void reset_drawboard();
         void init_drawboard_texture();
-        void update_drawboard_texture();
+        // update the pixels of the texture in rect
+        void update_drawboard_texture(const PixelRect& rect = DIGIT_RECT);
         void cleanup_drawboard();
 
         // MUST be called right after the ImGui::Image() call for the drawboard.
-        void handle_drawboard_drawing(bool& out_actually_drew_something);
+        // out_dirty_rect will contain the pixels that changed (if any).
+        void handle_drawboard_drawing(PixelRect& out_dirty_rect);
 
         void network_evaluate_drawboard();
+
+        // feed the changed pixels of the drawboard to drawboard_incremental
+        // and evaluate its first layer. drawboard_net must not be null.
+        void drawboard_update_first_layer();
+
+        // output values of the network (or ensemble) that last evaluated the
+        // drawboard. drawboard_net must not be null.
+        std::span<float> drawboard_output_values();
+
+        // add a copy of drawboard_net to ensemble_members. the old members
+        // are removed if they don't match it.
+        void add_drawboard_net_to_ensemble();
+
+        // keep drawboard_ensemble in sync with ensemble_members and
+        // drawboard_net, or reset it if they don't match.
+        void update_drawboard_ensemble();
+
+        // number of models in drawboard_ensemble, and copy them into an
+        // ensemble with that many models
+        size_t n_ensemble_models() const;
+        void load_ensemble_models(neural::Ensemble<float>& ensemble);
+
+        // start evaluating the accuracy of drawboard_ensemble in the
+        // background, or restart when the running evaluation is done.
+        void start_ensemble_accuracy_job();
+
+        // pick up the result of ensemble_accuracy_job if it's done
+        void update_ensemble_accuracy();
+
+        // fraction of the test dataset that the models of a job predict
+        // correctly, evaluated in batches on task_pool.
+        float evaluate_ensemble_accuracy(const EnsembleAccuracyJob& job);
+
         void update_network_guess_text(int32_t correct_label = -1);
 
         void drawboard_load_random_test_sample();
@@ -0,0 +1,565 @@
+#include "app_sweep.hpp"
+
+namespace sweep
+{
+
+    using digit_rec::N_DIGIT_VALUES;
+
+    App::App(const Options& options)
+        : options(options)
+    {
+        const std::string input_size = std::to_string(N_DIGIT_VALUES);
+        space.layer_sizes = {
+            input_size + ", 16, 10",
+            input_size + ", 32, 10",
+            input_size + ", 64, 10",
+            input_size + ", 24, 16, 10",
+            input_size + ", 32, 32, 10",
+            input_size + ", 64, 64, 10"
+        };
+        space.hidden_activations = {
+            ActivationFunc::LeakyRelu,
+            ActivationFunc::Relu,
+            ActivationFunc::Tanh
+        };
+        space.output_activations = { ActivationFunc::Tanh };
+        space.learning_rates = { .003f, .01f, .03f };
+        space.batch_sizes = { 1, 8, 32 };
+        space.seeds = { 12345678 };
+        space.random_transforms = { true, false };
+    }
+
+    void App::run()
+    {
+        load_dataset();
+
+        const uint32_t n_threads = options.n_threads > 0
+            ? options.n_threads
+            : std::max(std::thread::hardware_concurrency(), 1u);
+        pool = std::make_unique<tasks::Pool>(n_threads);
+
+        create_trials();
+        create_cohorts();
+
+        std::cout << std::format(
+            "{} search over {} trials in {} cohorts on {} thread(s) ({} "
+            "training samples, {} validation samples)\n",
+            SearchMode_str[(size_t)options.mode],
+            trials.size(),
+            cohorts.size(),
+            pool->n_workers(),
+            train_samples.size(),
+            validation_samples.size()
+        );
+
+        std::vector<Trial*> remaining;
+        for (auto& trial : trials)
+        {
+            remaining.push_back(&trial);
+        }
+
+        uint64_t rung_samples = FIRST_RUNG_SAMPLES;
+        uint64_t total_samples = 0;
+        for (size_t rung = 0; rung < MAX_RUNGS; rung++)
+        {
+            const auto start_time = std::chrono::steady_clock::now();
+            total_samples += rung_samples;
+
+            for (auto& cohort : cohorts)
+            {
+                cohort.trials.clear();
+            }
+            for (Trial* trial : remaining)
+            {
+                cohorts[trial->cohort_idx].trials.push_back(trial);
+            }
+
+            // one task per cohort, the workers steal the rest when they're
+            // done with the small networks.
+            tasks::parallel_for(
+                *pool,
+                0,
+                cohorts.size(),
+                1,
+                [&](size_t begin, size_t end)
+                {
+                    for (size_t i = begin; i < end; i++)
+                    {
+                        run_cohort(cohorts[i], total_samples);
+                    }
+                }
+            );
+
+            std::erase_if(
+                remaining,
+                [](const Trial* trial) { return trial->diverged; }
+            );
+            std::stable_sort(
+                remaining.begin(),
+                remaining.end(),
+                [](const Trial* a, const Trial* b)
+                {
+                    return a->accuracy > b->accuracy;
+                }
+            );
+
+            std::cout << std::format(
+                "rung {}: {} trial(s) trained on {} samples in {:.1f} s, "
+                "best validation accuracy: {:.2f}%\n",
+                rung + 1u,
+                remaining.size(),
+                total_samples,
+                std::chrono::duration<float>(
+                    std::chrono::steady_clock::now() - start_time
+                ).count(),
+                remaining.empty() ? 0.f : 100.f * remaining[0]->accuracy
+            );
+
+            // stop when the next rung would only have a single trial left
+            if (remaining.size() <= REDUCTION_FACTOR)
+            {
+                break;
+            }
+
+            remaining.resize(
+                (remaining.size() + REDUCTION_FACTOR - 1u) / REDUCTION_FACTOR
+            );
+            rung_samples *= REDUCTION_FACTOR;
+        }
+
+        // evaluate the trials that made it to the end on the test dataset
+        tasks::parallel_for(
+            *pool,
+            0,
+            remaining.size(),
+            1,
+            [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                {
+                    remaining[i]->test_accuracy =
+                        evaluate(*remaining[i], test_samples);
+                }
+            }
+        );
+
+        // the trials that trained the longest first, then the most accurate
+        std::vector<const Trial*> ranking;
+        for (const auto& trial : trials)
+        {
+            ranking.push_back(&trial);
+        }
+        std::stable_sort(
+            ranking.begin(),
+            ranking.end(),
+            [](const Trial* a, const Trial* b)
+            {
+                if (a->diverged != b->diverged)
+                    return b->diverged;
+                if (a->n_rungs != b->n_rungs)
+                    return a->n_rungs > b->n_rungs;
+                return a->accuracy > b->accuracy;
+            }
+        );
+
+        print_results(ranking);
+        save_results(ranking);
+    }
+
+    void App::load_dataset()
+    {
+        digit_rec::load_digit_samples(
+            digit_rec::TRAIN_IMAGES_PATH,
+            digit_rec::TRAIN_LABELS_PATH,
+            train_samples
+        );
+        digit_rec::load_digit_samples(
+            digit_rec::TEST_IMAGES_PATH,
+            digit_rec::TEST_LABELS_PATH,
+            test_samples
+        );
+        if (train_samples.size() < N_VALIDATION_SAMPLES + 100u
+            || test_samples.size() < 100u)
+        {
+            throw std::runtime_error(std::format(
+                "the number of training or test samples is extremely low "
+                "(training samples: {}, test samples: {})",
+                train_samples.size(),
+                test_samples.size()
+            ));
+        }
+
+        // hold out the last training samples for validation, so that the
+        // test dataset isn't used for picking the hyperparameters.
+        validation_samples.assign(
+            train_samples.end() - N_VALIDATION_SAMPLES,
+            train_samples.end()
+        );
+        train_samples.resize(train_samples.size() - N_VALIDATION_SAMPLES);
+    }
+
+    void App::create_trials()
+    {
+        const size_t n_combinations = space.layer_sizes.size()
+            * space.hidden_activations.size()
+            * space.output_activations.size()
+            * space.learning_rates.size()
+            * space.batch_sizes.size()
+            * space.seeds.size()
+            * space.random_transforms.size();
+
+        const bool grid = options.mode == SearchMode::Grid;
+        const size_t n_trials = grid ? n_combinations : options.n_random_trials;
+
+        std::mt19937 rng(SEED);
+
+        trials.clear();
+        trials.resize(n_trials);
+        for (size_t i = 0; i < n_trials; i++)
+        {
+            // pick a value for every hyperparameter, either from the digits of
+            // i in a mixed radix number system (grid search) or at random.
+            size_t digits = i;
+            auto pick = [&](const auto& values)
+                {
+                    size_t idx;
+                    if (grid)
+                    {
+                        idx = digits % values.size();
+                        digits /= values.size();
+                    }
+                    else
+                    {
+                        std::uniform_int_distribution<size_t> dist(
+                            0,
+                            values.size() - 1u
+                        );
+                        idx = dist(rng);
+                    }
+                    return values[idx];
+                };
+
+            Config& config = trials[i].config;
+            config.random_transform = pick(space.random_transforms);
+            config.seed = pick(space.seeds);
+            config.batch_size = pick(space.batch_sizes);
+            config.learning_rate = pick(space.learning_rates);
+            config.output_activation = pick(space.output_activations);
+            config.hidden_activation = pick(space.hidden_activations);
+            config.layer_sizes = pick(space.layer_sizes);
+        }
+    }
+
+    void App::create_cohorts()
+    {
+        cohorts.clear();
+        for (auto& trial : trials)
+        {
+            const Config& config = trial.config;
+
+            std::vector<size_t> layer_sizes;
+            if (auto error = digit_rec::parse_layer_sizes(
+                config.layer_sizes,
+                layer_sizes
+            ))
+            {
+                throw std::runtime_error(std::format(
+                    "invalid layer sizes \"{}\": {}",
+                    config.layer_sizes,
+                    error.value()
+                ));
+            }
+
+            // join the cohort of an earlier trial that only differs in the
+            // learning rate or seed
+            auto it = std::find_if(
+                cohorts.begin(),
+                cohorts.end(),
+                [&](const Cohort& cohort)
+                {
+                    const Config& first = cohort.trials[0]->config;
+                    return first.layer_sizes == config.layer_sizes
+                        && first.hidden_activation == config.hidden_activation
+                        && first.output_activation == config.output_activation
+                        && first.batch_size == config.batch_size
+                        && first.random_transform == config.random_transform;
+                }
+            );
+            if (it != cohorts.end())
+            {
+                trial.cohort_idx = (size_t)(it - cohorts.begin());
+                it->trials.push_back(&trial);
+                continue;
+            }
+
+            trial.cohort_idx = cohorts.size();
+            Cohort& cohort = cohorts.emplace_back();
+            cohort.trials.push_back(&trial);
+
+            cohort.layer_sizes = layer_sizes;
+            digit_rec::make_activation_fns(
+                layer_sizes.size(),
+                config.hidden_activation,
+                config.output_activation,
+                cohort.activation_fns,
+                cohort.activation_derivs
+            );
+            cohort.batch_size = config.batch_size;
+            cohort.random_transform = config.random_transform;
+
+            // same as digit_rec::App::prepare_for_training()
+            cohort.rng_pick_sample.seed(config.seed);
+            cohort.rng_random_transforms.seed(config.seed);
+
+            cohort.inputs.resize((size_t)config.batch_size * N_DIGIT_VALUES);
+            cohort.batch.resize(config.batch_size);
+            for (size_t i = 0; i < config.batch_size; i++)
+            {
+                cohort.batch[i].input =
+                    cohort.inputs.data() + (i * N_DIGIT_VALUES);
+            }
+        }
+    }
+
+    void App::run_cohort(Cohort& cohort, uint64_t total_samples)
+    {
+        if (cohort.trials.empty())
+        {
+            return;
+        }
+
+        const auto start_time = std::chrono::steady_clock::now();
+        const size_t n_trials = cohort.trials.size();
+
+        // the population is created on the worker that trains it, and only
+        // holds the trials that are still in the running.
+        neural::PopulationNetwork<float> population(
+            cohort.layer_sizes,
+            cohort.activation_fns,
+            cohort.activation_derivs,
+            n_trials,
+            cohort.batch_size
+        );
+
+        std::vector<float> learning_rates(n_trials);
+        for (size_t i = 0; i < n_trials; i++)
+        {
+            Trial& trial = *cohort.trials[i];
+            learning_rates[i] = trial.config.learning_rate;
+
+            // create the network the first time
+            if (!trial.net)
+            {
+                trial.net = std::make_unique<neural::Network<float, false>>(
+                    cohort.layer_sizes,
+                    cohort.activation_fns,
+                    cohort.activation_derivs
+                );
+
+                // same as digit_rec::App::prepare_for_training()
+                std::mt19937 rng_initialization(trial.config.seed);
+                trial.net->randomize_xavier_normal(
+                    rng_initialization,
+                    -.01f,
+                    .01f
+                );
+            }
+            population.copy_parameters_from(i, *trial.net);
+        }
+
+        std::vector<neural::BatchStats<float>> stats(n_trials);
+        std::vector<neural::BatchStats<float>> batch_stats(n_trials);
+        size_t n_diverged = 0;
+        while (cohort.samples_seen < total_samples && n_diverged < n_trials)
+        {
+            digit_rec::load_training_batch(
+                train_samples,
+                cohort.rng_pick_sample,
+                cohort.rng_random_transforms,
+                cohort.random_transform ? &random_transforms : nullptr,
+                cohort.inputs.data(),
+                cohort.batch
+            );
+
+            population.train(cohort.batch, learning_rates, batch_stats);
+            cohort.samples_seen += cohort.batch_size;
+
+            for (size_t i = 0; i < n_trials; i++)
+            {
+                stats[i].add(batch_stats[i]);
+
+                // early stopping, there's no coming back from this. the
+                // trial still trains with the others until the end of the
+                // rung, but nothing is left to learn.
+                Trial& trial = *cohort.trials[i];
+                if (!trial.diverged && !std::isfinite(stats[i].total_cost))
+                {
+                    trial.diverged = true;
+                    n_diverged++;
+                }
+            }
+        }
+
+        const float training_seconds = std::chrono::duration<float>(
+            std::chrono::steady_clock::now() - start_time
+        ).count();
+
+        for (size_t i = 0; i < n_trials; i++)
+        {
+            const auto eval_start_time = std::chrono::steady_clock::now();
+
+            Trial& trial = *cohort.trials[i];
+            population.copy_parameters_to(i, *trial.net);
+
+            trial.samples_seen = cohort.samples_seen;
+            trial.training_cost = stats[i].average_cost();
+            if (!trial.diverged)
+            {
+                trial.accuracy = evaluate(trial, validation_samples);
+            }
+            trial.n_rungs++;
+
+            trial.seconds += training_seconds / (float)n_trials
+                + std::chrono::duration<float>(
+                    std::chrono::steady_clock::now() - eval_start_time
+                ).count();
+        }
+    }
+
+    float App::evaluate(Trial& trial, const std::vector<DigitSample>& samples)
+    {
+        auto net_input = trial.net->input_values();
+        auto net_output = trial.net->output_values();
+
+        size_t n_correct = 0;
+        for (const auto& samp : samples)
+        {
+            for (size_t i = 0; i < N_DIGIT_VALUES; i++)
+            {
+                net_input[i] = (float)samp.values[i] / 255.f;
+            }
+            trial.net->forward_pass();
+
+            const size_t predicted_label = (size_t)(std::max_element(
+                net_output.begin(),
+                net_output.end()
+            ) - net_output.begin());
+            if (predicted_label == samp.label)
+            {
+                n_correct++;
+            }
+        }
+
+        return (float)n_correct / (float)samples.size();
+    }
+
+    void App::print_results(const std::vector<const Trial*>& ranking)
+    {
+        std::cout << std::format(
+            "\n{:<5}{:<22}{:<12}{:<12}{:>8}{:>7}{:>6}{:>6}{:>11}{:>10}{:>10}"
+            "{:>10}{:>9}\n",
+            "rank",
+            "layer sizes",
+            "hidden",
+            "output",
+            "lr",
+            "batch",
+            "aug",
+            "rung",
+            "samples",
+            "cost",
+            "val acc",
+            "test acc",
+            "time"
+        );
+
+        for (size_t i = 0; i < ranking.size(); i++)
+        {
+            const Trial& trial = *ranking[i];
+            const Config& config = trial.config;
+
+            std::cout << std::format(
+                "{:<5}{:<22}{:<12}{:<12}{:>8}{:>7}{:>6}{:>6}{:>11}{:>10.5f}",
+                i + 1u,
+                config.layer_sizes,
+                digit_rec::ActivationFunc_str[(size_t)config.hidden_activation],
+                digit_rec::ActivationFunc_str[(size_t)config.output_activation],
+                config.learning_rate,
+                config.batch_size,
+                config.random_transform ? "yes" : "no",
+                trial.n_rungs,
+                trial.samples_seen,
+                trial.training_cost
+            );
+
+            if (trial.diverged)
+            {
+                std::cout << std::format("{:>10}", "diverged");
+            }
+            else
+            {
+                std::cout << std::format("{:>9.2f}%", 100.f * trial.accuracy);
+            }
+
+            if (std::isnan(trial.test_accuracy))
+            {
+                std::cout << std::format("{:>10}", "-");
+            }
+            else
+            {
+                std::cout << std::format(
+                    "{:>9.2f}%",
+                    100.f * trial.test_accuracy
+                );
+            }
+
+            std::cout << std::format("{:>8.1f}s\n", trial.seconds);
+        }
+    }
+
+    void App::save_results(const std::vector<const Trial*>& ranking)
+    {
+        std::ofstream f(RESULTS_PATH, std::ios::out | std::ios::trunc);
+        if (!f)
+        {
+            std::cout << std::format(
+                "couldn't write the results to \"{}\"\n",
+                RESULTS_PATH
+            );
+            return;
+        }
+
+        f << "rank,layer_sizes,hidden_activation,output_activation,"
+            "learning_rate,batch_size,random_transform,seed,rungs,"
+            "samples_seen,training_cost,validation_accuracy,test_accuracy,"
+            "seconds,diverged\n";
+
+        for (size_t i = 0; i < ranking.size(); i++)
+        {
+            const Trial& trial = *ranking[i];
+            const Config& config = trial.config;
+
+            f << std::format(
+                "{},\"{}\",{},{},{},{},{},{},{},{},{},{},{},{},{}\n",
+                i + 1u,
+                config.layer_sizes,
+                digit_rec::ActivationFunc_str[(size_t)config.hidden_activation],
+                digit_rec::ActivationFunc_str[(size_t)config.output_activation],
+                config.learning_rate,
+                config.batch_size,
+                config.random_transform ? 1 : 0,
+                config.seed,
+                trial.n_rungs,
+                trial.samples_seen,
+                trial.training_cost,
+                trial.diverged ? 0.f : trial.accuracy,
+                trial.test_accuracy,
+                trial.seconds,
+                trial.diverged ? 1 : 0
+            );
+        }
+
+        std::cout << std::format("\nresults saved to \"{}\"\n", RESULTS_PATH);
+    }
+
+}
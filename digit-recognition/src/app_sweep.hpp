@@ -0,0 +1,191 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <format>
+#include <vector>
+#include <span>
+#include <memory>
+#include <thread>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+
+#include "neural.hpp"
+#include "population_network.hpp"
+#include "task_pool.hpp"
+#include "app_digit_rec.hpp"
+
+// hyperparameter search that trains many small networks at the same time on
+// the workers of a tasks::Pool, all reading the same (read-only) dataset.
+// every trial trains one configuration picked from a grid or at random. the
+// trials are trained with successive halving: every trial trains on the same
+// number of samples (a rung) and is evaluated on validation samples held out
+// of the training dataset, then only the best 1 / REDUCTION_FACTOR of the
+// trials train on REDUCTION_FACTOR times as many samples in the next rung, and
+// so on. trials whose cost stops being finite are stopped.
+// trials that only differ in their learning rate and seed form a cohort that
+// trains as one neural::PopulationNetwork on the same batches, so the samples
+// are only loaded and augmented once per cohort.
+// the results are printed as a table and saved to RESULTS_PATH as CSV.
+namespace sweep
+{
+
+    using digit_rec::ActivationFunc;
+    using digit_rec::DigitSample;
+
+    // hyperparameters of a trial (the same ones as in the settings)
+    struct Config
+    {
+        std::string layer_sizes;
+        ActivationFunc hidden_activation = ActivationFunc::LeakyRelu;
+        ActivationFunc output_activation = ActivationFunc::Tanh;
+        float learning_rate = .01f;
+        uint32_t batch_size = 1;
+        uint32_t seed = 12345678;
+        bool random_transform = true;
+    };
+
+    // candidate values for every hyperparameter. a grid search tries every
+    // combination, a random search picks every value at random.
+    struct SearchSpace
+    {
+        std::vector<std::string> layer_sizes;
+        std::vector<ActivationFunc> hidden_activations;
+        std::vector<ActivationFunc> output_activations;
+        std::vector<float> learning_rates;
+        std::vector<uint32_t> batch_sizes;
+        std::vector<uint32_t> seeds;
+        std::vector<bool> random_transforms;
+    };
+
+    enum class SearchMode : int
+    {
+        Grid,
+        Random
+    };
+    static constexpr const char* SearchMode_str[] = {
+        "grid",
+        "random"
+    };
+
+    struct Options
+    {
+        SearchMode mode = SearchMode::Grid;
+
+        // number of configurations to try with SearchMode::Random
+        size_t n_random_trials = 64;
+
+        // number of worker threads, or 0 for one per CPU
+        uint32_t n_threads = 0;
+    };
+
+    class App
+    {
+    public:
+        App(const Options& options);
+
+        void run();
+
+    private:
+        static constexpr uint32_t SEED = 24681357u;
+
+        // number of training samples every trial sees in the first rung.
+        // every rung after that is REDUCTION_FACTOR times longer.
+        static constexpr uint64_t FIRST_RUNG_SAMPLES = 25000;
+        static constexpr size_t REDUCTION_FACTOR = 2;
+        static constexpr size_t MAX_RUNGS = 6;
+
+        // number of training samples held out for validation
+        static constexpr size_t N_VALIDATION_SAMPLES = 5000;
+
+        static constexpr auto RESULTS_PATH = "./sweep.csv";
+
+        struct Trial
+        {
+            Config config;
+            size_t cohort_idx = 0;
+
+            // the trial's weights and biases between the rungs
+            std::unique_ptr<neural::Network<float, false>> net;
+
+            // number of rungs finished and training samples seen so far
+            size_t n_rungs = 0;
+            uint64_t samples_seen = 0;
+
+            // accuracy on the validation samples and average training cost
+            // in the last rung, and accuracy on the test dataset if the trial
+            // made it to the end.
+            float accuracy = 0.f;
+            float training_cost = std::numeric_limits<float>::quiet_NaN();
+            float test_accuracy = std::numeric_limits<float>::quiet_NaN();
+
+            // time spent training and evaluating (in seconds). the training
+            // time of a cohort is split evenly between its trials.
+            float seconds = 0.f;
+
+            // whether the cost stopped being finite
+            bool diverged = false;
+        };
+
+        // trials with the same layer sizes, activation functions, batch
+        // size, and augmentation, which see the exact same batches. the
+        // sample order comes from the seed of the cohort's first trial.
+        struct Cohort
+        {
+            // trials of the cohort that take part in the current rung
+            std::vector<Trial*> trials;
+
+            std::vector<size_t> layer_sizes;
+            std::vector<std::function<float(float)>> activation_fns;
+            std::vector<std::function<float(float)>> activation_derivs;
+            uint32_t batch_size = 1;
+            bool random_transform = true;
+
+            std::mt19937 rng_pick_sample;
+            std::mt19937 rng_random_transforms;
+
+            // inputs and labels of a batch
+            std::vector<float> inputs;
+            std::vector<neural::LabeledInput<float>> batch;
+
+            uint64_t samples_seen = 0;
+        };
+
+        Options options;
+        SearchSpace space;
+
+        std::vector<DigitSample> train_samples;
+        std::vector<DigitSample> validation_samples;
+        std::vector<DigitSample> test_samples;
+
+        // used by cohorts with random transformations on
+        digit_rec::RandomTransforms random_transforms;
+
+        std::unique_ptr<tasks::Pool> pool;
+        std::vector<Trial> trials;
+        std::vector<Cohort> cohorts;
+
+        void load_dataset();
+        void create_trials();
+        void create_cohorts();
+
+        // train the trials of a cohort until they've seen total_samples
+        // training samples, then evaluate them on the validation samples.
+        void run_cohort(Cohort& cohort, uint64_t total_samples);
+
+        // fraction of samples that the trial's network classifies correctly
+        float evaluate(Trial& trial, const std::vector<DigitSample>& samples);
+
+        void print_results(const std::vector<const Trial*>& ranking);
+        void save_results(const std::vector<const Trial*>& ranking);
+
+    };
+
+}
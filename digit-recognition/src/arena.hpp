@@ -0,0 +1,272 @@
+#pragma once
+
+#include <vector>
+#include <new>
+#include <limits>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "alloc_counter.hpp"
+
+// cache line aligned memory for network parameters, gradients, and scratch
+// buffers. memory is either allocated individually from the heap or carved
+// out of an Arena, which can also ask for huge pages and a specific NUMA node
+// (Linux only, these are hints and are silently ignored elsewhere).
+// * without a NUMA node, memory is placed by the OS's first-touch policy, so
+//   it ends up on the node of the thread that first writes to it (usually the
+//   one that constructs the network).
+namespace arena
+{
+
+    // alignment of every allocation. kernels can assume that the start of
+    // every buffer is on a cache line.
+    static constexpr size_t ALIGNMENT = 64;
+
+    static constexpr size_t BASE_PAGE_SIZE = 4096;
+    static constexpr size_t HUGE_PAGE_SIZE = 2u * 1024u * 1024u;
+
+    constexpr size_t align_up(size_t n, size_t alignment)
+    {
+        return (n + alignment - 1u) / alignment * alignment;
+    }
+
+    // allocate size bytes from the heap aligned to alignment (a power of 2)
+    inline void* aligned_alloc(size_t size, size_t alignment)
+    {
+#ifdef DIGIT_REC_COUNT_ALLOCATIONS
+        alloc_counter::n_allocations++;
+#endif
+
+        size = align_up(std::max(size, (size_t)1u), alignment);
+#ifdef _WIN32
+        void* ptr = _aligned_malloc(size, alignment);
+#else
+        void* ptr = std::aligned_alloc(alignment, size);
+#endif
+        if (!ptr)
+        {
+            throw std::bad_alloc();
+        }
+        return ptr;
+    }
+
+    inline void aligned_free(void* ptr)
+    {
+#ifdef _WIN32
+        _aligned_free(ptr);
+#else
+        std::free(ptr);
+#endif
+    }
+
+    struct Options
+    {
+        // minimum size of the blocks the arena gets from the heap. bigger
+        // allocations get a block of their own.
+        size_t block_size = HUGE_PAGE_SIZE;
+
+        // ask the kernel to back the blocks with transparent huge pages, which
+        // saves TLB misses on large networks.
+        bool huge_pages = false;
+
+        // NUMA node to place the blocks on, or -1 to leave it to first-touch.
+        int numa_node = -1;
+    };
+
+    // bump allocator that hands out aligned chunks from a list of big blocks.
+    // individual chunks can't be freed, everything is freed at once in
+    // release() or when the arena is destroyed, so the arena must outlive
+    // everything allocated from it.
+    class Arena
+    {
+    public:
+        Arena(const Options& options = {})
+            : options(options)
+        {}
+
+        ~Arena()
+        {
+            release();
+        }
+
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        const Options& get_options() const
+        {
+            return options;
+        }
+
+        void* allocate(size_t size)
+        {
+            size = align_up(std::max(size, (size_t)1u), ALIGNMENT);
+
+            if (blocks.empty()
+                || blocks.back().used + size > blocks.back().size)
+            {
+                add_block(size);
+            }
+
+            Block& block = blocks.back();
+            void* ptr = block.ptr + block.used;
+            block.used += size;
+            _bytes_used += size;
+            return ptr;
+        }
+
+        // free all blocks. everything allocated from the arena becomes
+        // invalid.
+        void release()
+        {
+            for (const Block& block : blocks)
+            {
+                aligned_free(block.ptr);
+            }
+            blocks.clear();
+            _bytes_used = 0;
+        }
+
+        // total size of the allocations (including alignment padding)
+        size_t bytes_used() const
+        {
+            return _bytes_used;
+        }
+
+        // total size of the blocks taken from the heap
+        size_t bytes_reserved() const
+        {
+            size_t n = 0;
+            for (const Block& block : blocks)
+            {
+                n += block.size;
+            }
+            return n;
+        }
+
+    private:
+        struct Block
+        {
+            std::byte* ptr;
+            size_t size;
+            size_t used;
+        };
+
+        Options options;
+        std::vector<Block> blocks;
+        size_t _bytes_used = 0;
+
+        void add_block(size_t min_size)
+        {
+            // madvise() and mbind() need whole pages
+            const size_t alignment =
+                options.huge_pages ? HUGE_PAGE_SIZE : BASE_PAGE_SIZE;
+            const size_t size = align_up(
+                std::max(min_size, options.block_size),
+                alignment
+            );
+
+            std::byte* ptr = (std::byte*)aligned_alloc(size, alignment);
+
+#ifdef __linux__
+            // these are only hints, so failures are ignored. they have to be
+            // done before anything touches the block.
+            if (options.huge_pages)
+            {
+                madvise(ptr, size, MADV_HUGEPAGE);
+            }
+
+            if (options.numa_node >= 0
+                && options.numa_node < (int)(8u * sizeof(unsigned long)))
+            {
+                const unsigned long node_mask = 1ul << options.numa_node;
+                syscall(
+                    SYS_mbind,
+                    ptr,
+                    size,
+                    MPOL_PREFERRED,
+                    &node_mask,
+                    8u * sizeof(unsigned long),
+                    0u
+                );
+            }
+#endif
+
+            blocks.push_back({ ptr, size, 0u });
+        }
+
+    };
+
+    // standard allocator that hands out ALIGNMENT aligned memory from an
+    // Arena, or from the heap if there's no arena. deallocate() does nothing
+    // for arena memory.
+    template<typename T>
+    class Allocator
+    {
+    public:
+        using value_type = T;
+
+        Allocator(Arena* arena = nullptr) noexcept
+            : _arena(arena)
+        {}
+
+        template<typename U>
+        Allocator(const Allocator<U>& other) noexcept
+            : _arena(other.arena())
+        {}
+
+        T* allocate(size_t n)
+        {
+            if (n > std::numeric_limits<size_t>::max() / sizeof(T))
+            {
+                throw std::bad_array_new_length();
+            }
+
+            if (_arena)
+            {
+                return (T*)_arena->allocate(n * sizeof(T));
+            }
+            return (T*)aligned_alloc(n * sizeof(T), ALIGNMENT);
+        }
+
+        void deallocate(T* ptr, size_t /*n*/) noexcept
+        {
+            if (!_arena)
+            {
+                aligned_free(ptr);
+            }
+        }
+
+        Arena* arena() const noexcept
+        {
+            return _arena;
+        }
+
+        template<typename U>
+        bool operator==(const Allocator<U>& other) const noexcept
+        {
+            return _arena == other.arena();
+        }
+
+    private:
+        Arena* _arena;
+
+    };
+
+    // vector with aligned storage, optionally from an Arena
+    template<typename T>
+    using Vector = std::vector<T, Allocator<T>>;
+
+}
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <vector>
+#include <span>
+#include <memory>
+#include <functional>
+#include <stdexcept>
+#include <cstdint>
+
+#include "neural.hpp"
+
+namespace neural
+{
+
+    // extra classifiers ("exit heads") attached to the hidden layers of a
+    // Network, so that inference can stop at the first hidden layer where the
+    // prediction is already confident enough, skipping the rest of the layers.
+    // every head is a single layer that maps the values of its hidden layer to
+    // the output layer, using the network's output activation function so that
+    // the scores of all the heads and the network are comparable.
+    // * the heads are trained on the same forward passes as the network, but
+    //   their gradients don't flow back into the network (the hidden layers
+    //   are treated as fixed inputs), so training the heads doesn't change
+    //   what the network learns.
+    template<typename T, bool store_gradients>
+    class ExitHeads
+    {
+    public:
+        // one head for every hidden layer of net. the heads only depend on
+        // the layer sizes and the output activation of net, so the same heads
+        // can be used with any network with the same topology.
+        template<bool net_store_gradients>
+        ExitHeads(const Network<T, net_store_gradients>& net)
+            : _layer_sizes(net.layer_sizes())
+        {
+            const size_t n_layers = _layer_sizes.size();
+            if (n_layers < 3u)
+            {
+                throw std::invalid_argument(
+                    "early exits need at least one hidden layer"
+                );
+            }
+
+            const std::vector<std::function<T(T)>> fns{
+                net.activation_fns().back()
+            };
+            const std::vector<std::function<T(T)>> derivs{
+                net.activation_derivs().back()
+            };
+            for (size_t l = 1u; l < n_layers - 1u; l++)
+            {
+                heads.push_back(std::make_unique<Network<T, store_gradients>>(
+                    std::vector<size_t>{ _layer_sizes[l], net.output_size() },
+                    fns,
+                    derivs
+                ));
+            }
+
+            // multiply-adds needed to predict at every exit layer, including
+            // the heads evaluated before the exit
+            _exit_cost.resize(n_layers, 0u);
+            uint64_t cost = 0;
+            for (size_t l = 1u; l < n_layers; l++)
+            {
+                cost += (uint64_t)_layer_sizes[l - 1u] * _layer_sizes[l];
+                if (l < n_layers - 1u)
+                {
+                    cost += (uint64_t)_layer_sizes[l] * net.output_size();
+                }
+                _exit_cost[l] = cost;
+            }
+        }
+
+        ExitHeads(const ExitHeads&) = delete;
+        ExitHeads& operator=(const ExitHeads&) = delete;
+
+        constexpr const std::vector<size_t>& layer_sizes() const
+        {
+            return _layer_sizes;
+        }
+
+        constexpr size_t n_heads() const
+        {
+            return heads.size();
+        }
+
+        // the head attached to a hidden layer (1 to n_layers - 2)
+        Network<T, store_gradients>& head(size_t layer_idx)
+        {
+            if (layer_idx < 1u || layer_idx > heads.size())
+            {
+                throw std::invalid_argument("invalid layer index");
+            }
+            return *heads[layer_idx - 1u];
+        }
+
+        const Network<T, store_gradients>& head(size_t layer_idx) const
+        {
+            if (layer_idx < 1u || layer_idx > heads.size())
+            {
+                throw std::invalid_argument("invalid layer index");
+            }
+            return *heads[layer_idx - 1u];
+        }
+
+        // number of multiply-adds needed for a prediction that exits at a
+        // layer (1 to n_layers - 1), including the heads evaluated on the way.
+        // the cost of exiting at the output layer is higher than that of a
+        // plain forward pass, see forward_pass_cost().
+        uint64_t exit_cost(size_t layer_idx) const
+        {
+            if (layer_idx < 1u || layer_idx >= _exit_cost.size())
+            {
+                throw std::invalid_argument("invalid layer index");
+            }
+            return _exit_cost[layer_idx];
+        }
+
+        // number of multiply-adds in a forward pass of the network alone
+        uint64_t forward_pass_cost() const
+        {
+            uint64_t cost = 0;
+            for (size_t l = 1u; l < _layer_sizes.size(); l++)
+            {
+                cost += (uint64_t)_layer_sizes[l - 1u] * _layer_sizes[l];
+            }
+            return cost;
+        }
+
+        template<typename RandomEngine>
+        void randomize(RandomEngine& engine)
+        {
+            for (auto& head : heads)
+            {
+                head->randomize_xavier_normal(engine, (T)(-.01), (T).01);
+            }
+        }
+
+        template<bool other_store_gradients>
+        void copy_parameters_from(
+            const ExitHeads<T, other_store_gradients>& other
+        )
+        {
+            if (other.layer_sizes() != layer_sizes())
+            {
+                throw std::invalid_argument(
+                    "can't copy exit heads with different layer sizes"
+                );
+            }
+
+            for (size_t l = 1u; l <= heads.size(); l++)
+            {
+                heads[l - 1u]->copy_parameters_from(other.head(l));
+            }
+        }
+
+        void zero_gradients()
+        {
+            for (auto& head : heads)
+            {
+                head->zero_gradients();
+            }
+        }
+
+        // add the gradients of every head for the sample whose forward pass
+        // was last done in net (see Network::accumulated_backward_pass()).
+        template<bool net_store_gradients>
+        void accumulate_gradients(
+            Network<T, net_store_gradients>& net,
+            size_t expected_label
+        )
+        {
+            for (size_t l = 1u; l <= heads.size(); l++)
+            {
+                heads[l - 1u]->template forward_backward<true, false>(
+                    net.values(l),
+                    expected_label
+                );
+            }
+        }
+
+        void gradient_descent_step(size_t n_data_points, T learning_rate)
+        {
+            for (auto& head : heads)
+            {
+                head->gradient_descent_step(n_data_points, learning_rate);
+            }
+        }
+
+        // do one training step of net and the heads on the same samples. the
+        // returned cost and accuracy are those of net alone (see
+        // Network::train()).
+        BatchStats<T> train(
+            Network<T, true>& net,
+            std::span<const LabeledInput<T>> samples,
+            T learning_rate
+        )
+        {
+            zero_gradients();
+            BatchStats<T> stats = net.accumulated_backward_pass(
+                samples,
+                [this, &net](const LabeledInput<T>& sample)
+                {
+                    accumulate_gradients(net, sample.label);
+                }
+            );
+
+            net.gradient_descent_step(samples.size(), learning_rate);
+            gradient_descent_step(samples.size(), learning_rate);
+            return stats;
+        }
+
+        // evaluate net layer by layer on the values already in its input
+        // layer, and stop at the first hidden layer whose head has an output
+        // value above threshold. returns the index of the layer where the
+        // prediction was made (n_layers - 1 if none of the heads were
+        // confident enough), and output_values() will contain the prediction.
+        // the layers before first_layer are assumed to be evaluated already
+        // (see IncrementalForwardPass).
+        template<bool net_store_gradients>
+        size_t forward_pass(
+            Network<T, net_store_gradients>& net,
+            T threshold,
+            size_t first_layer = 1u
+        )
+        {
+            if (net.layer_sizes() != layer_sizes())
+            {
+                throw std::invalid_argument(
+                    "the network doesn't match the exit heads"
+                );
+            }
+
+            const size_t n_layers = _layer_sizes.size();
+            for (size_t l = 1u; l < n_layers; l++)
+            {
+                if (l >= first_layer)
+                {
+                    net.forward_layer(l);
+                }
+                if (l == n_layers - 1u)
+                {
+                    break;
+                }
+
+                auto& head = *heads[l - 1u];
+                copy_span<T>(net.values(l), head.input_values());
+                head.forward_pass();
+
+                for (const T v : head.output_values())
+                {
+                    if (v > threshold)
+                    {
+                        exit_outputs = head.output_values();
+                        return l;
+                    }
+                }
+            }
+
+            exit_outputs = net.output_values();
+            return n_layers - 1u;
+        }
+
+        // output values of the head (or the network) that made the last
+        // prediction in forward_pass()
+        std::span<T> output_values()
+        {
+            return exit_outputs;
+        }
+
+    private:
+        std::vector<size_t> _layer_sizes;
+        std::vector<std::unique_ptr<Network<T, store_gradients>>> heads;
+        std::vector<uint64_t> _exit_cost;
+
+        std::span<T> exit_outputs;
+
+    };
+
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <vector>
+#include <span>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+
+#include "neural.hpp"
+#include "population_network.hpp"
+
+namespace neural
+{
+
+    // how the outputs of the models in an Ensemble are combined
+    enum class EnsembleMode : int
+    {
+        // the average of the output values of all the models
+        Average,
+
+        // the fraction of the models that predict each label (the output node
+        // with the highest value)
+        Vote
+    };
+
+    // inference for a group of networks with the same layer sizes and
+    // activation functions (for example trained with different seeds) on the
+    // same inputs, combining their outputs into one prediction. the models
+    // are evaluated together in an inference only PopulationNetwork, so every
+    // input is only copied and searched for nonzero values once instead of
+    // once per model. that's the only saving though: the multiply-adds are
+    // the same as a separate forward pass per model, so with a single input
+    // this costs about as much as evaluating the networks one by one.
+    template<typename T>
+    class Ensemble
+    {
+    public:
+        // see PopulationNetwork::PopulationNetwork(). the population is
+        // inference only.
+        Ensemble(
+            const std::vector<size_t>& layer_sizes,
+            const std::vector<std::function<T(T)>>& activation_fns,
+            const std::vector<std::function<T(T)>>& activation_derivs,
+            size_t n_models,
+            size_t max_batch_size,
+            EnsembleMode mode = EnsembleMode::Average
+        )
+            : population(
+                layer_sizes,
+                activation_fns,
+                activation_derivs,
+                n_models,
+                max_batch_size,
+                true
+            ),
+            _mode(mode),
+            outputs(max_batch_size * population.output_size(), (T)0),
+            batch(max_batch_size)
+        {}
+
+        constexpr const std::vector<size_t>& layer_sizes() const
+        {
+            return population.layer_sizes();
+        }
+
+        constexpr size_t n_models() const
+        {
+            return population.n_models();
+        }
+
+        constexpr size_t max_batch_size() const
+        {
+            return population.max_batch_size();
+        }
+
+        constexpr EnsembleMode mode() const
+        {
+            return _mode;
+        }
+
+        void set_mode(EnsembleMode mode)
+        {
+            _mode = mode;
+        }
+
+        // copy the weights and biases of a network with the same layer sizes
+        // into a model of the ensemble
+        template<bool store_gradients>
+        void set_model(size_t model_idx, Network<T, store_gradients>& net)
+        {
+            population.copy_parameters_from(model_idx, net);
+        }
+
+        // evaluate every model on a batch of at most max_batch_size inputs
+        // (input_size() values each) and combine their outputs. see
+        // output_values() and predicted_label().
+        void forward_pass(std::span<const T* const> inputs)
+        {
+            if (inputs.size() > max_batch_size())
+            {
+                throw std::invalid_argument("too many inputs in the batch");
+            }
+
+            for (size_t s = 0u; s < inputs.size(); s++)
+            {
+                batch[s] = LabeledInput<T>{ inputs[s], 0u };
+            }
+            population.forward_pass(
+                std::span<const LabeledInput<T>>(batch.data(), inputs.size())
+            );
+
+            const size_t n_outputs = population.output_size();
+            const T inv_n_models = (T)1 / (T)n_models();
+            for (size_t s = 0u; s < inputs.size(); s++)
+            {
+                std::span<T> combined(
+                    outputs.data() + s * n_outputs,
+                    n_outputs
+                );
+                std::fill(combined.begin(), combined.end(), (T)0);
+
+                for (size_t m = 0u; m < n_models(); m++)
+                {
+                    auto model_output = population.output_values(s, m);
+                    if (_mode == EnsembleMode::Average)
+                    {
+                        for (size_t i = 0u; i < n_outputs; i++)
+                        {
+                            combined[i] += model_output[i];
+                        }
+                    }
+                    else
+                    {
+                        combined[argmax(model_output)] += (T)1;
+                    }
+                }
+
+                for (auto& v : combined)
+                {
+                    v *= inv_n_models;
+                }
+            }
+        }
+
+        // same as above, but for a single input
+        void forward_pass(const T* input)
+        {
+            forward_pass(std::span<const T* const>(&input, 1u));
+        }
+
+        // combined output values for an input of the last batch
+        std::span<T> output_values(size_t sample_idx)
+        {
+            const size_t n_outputs = population.output_size();
+            return std::span<T>(
+                outputs.data() + sample_idx * n_outputs,
+                n_outputs
+            );
+        }
+
+        // output values of a single model for an input of the last batch
+        std::span<T> model_output_values(size_t sample_idx, size_t model_idx)
+        {
+            return population.output_values(sample_idx, model_idx);
+        }
+
+        // index of the highest combined output value for an input of the last
+        // batch. ties go to the lowest index.
+        size_t predicted_label(size_t sample_idx)
+        {
+            return argmax(output_values(sample_idx));
+        }
+
+    private:
+        PopulationNetwork<T> population;
+        EnsembleMode _mode;
+
+        // combined outputs of every input in the last batch
+        std::vector<T> outputs;
+
+        std::vector<LabeledInput<T>> batch;
+
+        static size_t argmax(std::span<const T> values)
+        {
+            size_t idx = 0;
+            for (size_t i = 1u; i < values.size(); i++)
+            {
+                if (values[i] > values[idx])
+                {
+                    idx = i;
+                }
+            }
+            return idx;
+        }
+
+    };
+
+}
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstddef>
+
+// GCC and Clang define __F16C__ when F16C is enabled (-mf16c or -march),
+// -mavx2 alone doesn't enable it. MSVC never defines __F16C__, but every CPU
+// with AVX2 has F16C.
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define HALF_F16C
+#endif
+
+#if defined(HALF_F16C) || defined(__AVX512BF16__)
+#include <immintrin.h>
+#endif
+
+// 16-bit floating-point formats stored as uint16_t, with conversions to and
+// from 32-bit floats. conversions use F16C (fp16) and AVX512-BF16 (bf16)
+// instructions if the compiler is allowed to use them, and portable code
+// otherwise. both round to the nearest even value.
+// * bf16 has the same range as float but only 8 bits of precision.
+// * fp16 has 11 bits of precision but can only represent values up to 65504.
+namespace half
+{
+
+    enum class Format : int
+    {
+        Bf16,
+        Fp16
+    };
+    static constexpr const char* Format_str[] = {
+        "BF16",
+        "FP16"
+    };
+
+    inline float bf16_to_float(uint16_t h)
+    {
+        return std::bit_cast<float>((uint32_t)h << 16u);
+    }
+
+    inline uint16_t float_to_bf16(float f)
+    {
+        uint32_t bits = std::bit_cast<uint32_t>(f);
+
+        // keep NaNs quiet instead of letting the rounding turn them into inf
+        if ((bits & 0x7fffffffu) > 0x7f800000u)
+        {
+            return (uint16_t)((bits >> 16u) | 0x40u);
+        }
+
+        bits += 0x7fffu + ((bits >> 16u) & 1u);
+        return (uint16_t)(bits >> 16u);
+    }
+
+    inline float fp16_to_float(uint16_t h)
+    {
+#ifdef HALF_F16C
+        return _cvtsh_ss(h);
+#else
+        // https://gist.github.com/rygorous/2144712 (half_to_float)
+        static constexpr uint32_t shifted_exp = 0x7c00u << 13u;
+        static constexpr float magic = std::bit_cast<float>(113u << 23u);
+
+        uint32_t bits = ((uint32_t)h & 0x7fffu) << 13u;
+        const uint32_t exp = shifted_exp & bits;
+        bits += (127u - 15u) << 23u;
+
+        if (exp == shifted_exp)
+        {
+            // inf or NaN
+            bits += (128u - 16u) << 23u;
+        }
+        else if (exp == 0)
+        {
+            // zero or subnormal
+            bits += 1u << 23u;
+            bits = std::bit_cast<uint32_t>(std::bit_cast<float>(bits) - magic);
+        }
+
+        bits |= ((uint32_t)h & 0x8000u) << 16u;
+        return std::bit_cast<float>(bits);
+#endif
+    }
+
+    inline uint16_t float_to_fp16(float f)
+    {
+#ifdef HALF_F16C
+        return (uint16_t)_cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT);
+#else
+        // https://gist.github.com/rygorous/2156668 (float_to_half_fast3_rtne)
+        static constexpr uint32_t f32_inf = 255u << 23u;
+        static constexpr uint32_t f16_max = (127u + 16u) << 23u;
+        static constexpr uint32_t denorm_magic =
+            ((127u - 15u) + (23u - 10u) + 1u) << 23u;
+
+        uint32_t bits = std::bit_cast<uint32_t>(f);
+        const uint32_t sign = bits & 0x80000000u;
+        bits ^= sign;
+
+        uint16_t result;
+        if (bits >= f16_max)
+        {
+            // overflow (inf) or NaN
+            result = (bits > f32_inf) ? 0x7e00u : 0x7c00u;
+        }
+        else if (bits < (113u << 23u))
+        {
+            // subnormal or zero, let the FPU do the rounding
+            const float v = std::bit_cast<float>(bits)
+                + std::bit_cast<float>(denorm_magic);
+            result = (uint16_t)(std::bit_cast<uint32_t>(v) - denorm_magic);
+        }
+        else
+        {
+            const uint32_t mant_odd = (bits >> 13u) & 1u;
+            bits += ((uint32_t)(15 - 127) << 23u) + 0xfffu;
+            bits += mant_odd;
+            result = (uint16_t)(bits >> 13u);
+        }
+
+        return (uint16_t)(result | (sign >> 16u));
+#endif
+    }
+
+    // convert n floats to a 16-bit format
+    inline void from_float(
+        Format format,
+        const float* src,
+        uint16_t* dst,
+        size_t n
+    )
+    {
+        size_t i = 0;
+
+        if (format == Format::Bf16)
+        {
+#if defined(__AVX512BF16__)
+            // note that this treats subnormal inputs as 0
+            for (; i + 16u <= n; i += 16u)
+            {
+                __m256bh v = _mm512_cvtneps_pbh(_mm512_loadu_ps(src + i));
+                _mm256_storeu_si256(
+                    (__m256i*)(dst + i),
+                    std::bit_cast<__m256i>(v)
+                );
+            }
+#endif
+            for (; i < n; i++)
+            {
+                dst[i] = float_to_bf16(src[i]);
+            }
+        }
+        else
+        {
+#ifdef HALF_F16C
+            for (; i + 8u <= n; i += 8u)
+            {
+                _mm_storeu_si128(
+                    (__m128i*)(dst + i),
+                    _mm256_cvtps_ph(
+                        _mm256_loadu_ps(src + i),
+                        _MM_FROUND_TO_NEAREST_INT
+                    )
+                );
+            }
+#endif
+            for (; i < n; i++)
+            {
+                dst[i] = float_to_fp16(src[i]);
+            }
+        }
+    }
+
+    // convert n values in a 16-bit format to floats
+    inline void to_float(
+        Format format,
+        const uint16_t* src,
+        float* dst,
+        size_t n
+    )
+    {
+        size_t i = 0;
+
+        if (format == Format::Bf16)
+        {
+            for (; i < n; i++)
+            {
+                dst[i] = bf16_to_float(src[i]);
+            }
+        }
+        else
+        {
+#ifdef HALF_F16C
+            for (; i + 8u <= n; i += 8u)
+            {
+                _mm256_storeu_ps(
+                    dst + i,
+                    _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(src + i)))
+                );
+            }
+#endif
+            for (; i < n; i++)
+            {
+                dst[i] = fp16_to_float(src[i]);
+            }
+        }
+    }
+
+}
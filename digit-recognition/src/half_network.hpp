@@ -0,0 +1,245 @@
+#pragma once
+
+#include <vector>
+#include <span>
+#include <functional>
+#include <algorithm>
+#include <type_traits>
+#include <stdexcept>
+#include <cstdint>
+
+#include "neural.hpp"
+#include "half.hpp"
+#include "profiler.hpp"
+
+namespace neural
+{
+
+    // inference-only copy of a Network that stores its weights and biases in
+    // a 16-bit floating-point format (bf16 or fp16), which halves the memory
+    // (and bandwidth) needed for the parameters. the values (activations) and
+    // the weighted sums are still calculated with T (usually float).
+    // this is meant to be loaded from a full precision network that does the
+    // actual training (the master weights, see copy_parameters_from()), so the
+    // rounding errors never accumulate across training steps.
+    // * the weights of every layer are stored transposed (the weights from
+    //   every input to all the nodes next to each other), so the forward pass
+    //   converts a whole row to T at once and adds it to all the weighted
+    //   sums, skipping the inputs that are 0. every weighted sum is still
+    //   added up in the same order as in Network.
+    template<typename T>
+    class HalfNetwork
+    {
+    public:
+        HalfNetwork(
+            const std::vector<size_t>& layer_sizes,
+            const std::vector<std::function<T(T)>>& activation_fns,
+            half::Format format
+        )
+            : _n_layers(layer_sizes.size()),
+            _layer_sizes(layer_sizes),
+            _activation_fns(activation_fns),
+            _format(format)
+        {
+            if (_n_layers < 2u)
+            {
+                throw std::invalid_argument(
+                    "there should be at least 2 layers to represent an input "
+                    "and an output layer."
+                );
+            }
+
+            if (_activation_fns.size() != _n_layers - 1u)
+            {
+                throw std::invalid_argument(
+                    "the number of activation functions must be one less than "
+                    "the number of layers."
+                );
+            }
+
+            // the parameters of every layer are stored as biases followed by
+            // the weights of every input (contiguous per input).
+            _value_offsets.resize(_n_layers, 0u);
+            _param_offsets.resize(_n_layers, 0u);
+
+            size_t n_values = _layer_sizes[0];
+            size_t n_params = 0;
+            for (size_t l = 1u; l < _n_layers; l++)
+            {
+                _value_offsets[l] = n_values;
+                _param_offsets[l] = n_params;
+
+                n_values += _layer_sizes[l];
+                n_params += _layer_sizes[l] // biases
+                    + _layer_sizes[l] * _layer_sizes[l - 1u]; // weights
+            }
+
+            values.resize(n_values, (T)0);
+            params.resize(n_params, 0);
+            row.resize(*std::max_element(
+                _layer_sizes.begin(),
+                _layer_sizes.end()
+            ));
+        }
+
+        constexpr const std::vector<size_t>& layer_sizes() const
+        {
+            return _layer_sizes;
+        }
+
+        constexpr half::Format format() const
+        {
+            return _format;
+        }
+
+        // size of the weights and biases in bytes
+        size_t parameter_bytes() const
+        {
+            return params.size() * sizeof(uint16_t);
+        }
+
+        constexpr std::span<T> input_values()
+        {
+            return std::span<T>(values.data(), _layer_sizes[0]);
+        }
+
+        constexpr std::span<T> output_values()
+        {
+            return std::span<T>(
+                values.data() + _value_offsets[_n_layers - 1u],
+                _layer_sizes[_n_layers - 1u]
+            );
+        }
+
+        // round the weights and biases of a network with the same layer sizes
+        // to the 16-bit format and store them.
+        template<bool store_gradients>
+        void copy_parameters_from(Network<T, store_gradients>& net)
+        {
+            if (net.layer_sizes() != _layer_sizes)
+            {
+                throw std::invalid_argument("layer sizes don't match");
+            }
+
+            // skip the interleaved gradients if there are any
+            constexpr size_t stride = store_gradients ? 2u : 1u;
+
+            for (size_t l = 1u; l < _n_layers; l++)
+            {
+                const size_t n_nodes = _layer_sizes[l];
+                const size_t n_prev_nodes = _layer_sizes[l - 1u];
+                uint16_t* p = params.data() + _param_offsets[l];
+
+                auto b = net.biases(l);
+                for (size_t n = 0u; n < n_nodes; n++)
+                {
+                    row[n] = (float)b[n * stride];
+                }
+                half::from_float(_format, row.data(), p, n_nodes);
+
+                // transpose the weights one input at a time
+                for (size_t i = 0u; i < n_prev_nodes; i++)
+                {
+                    for (size_t n = 0u; n < n_nodes; n++)
+                    {
+                        row[n] = (float)net.weights(l, n)[i * stride];
+                    }
+                    half::from_float(
+                        _format,
+                        row.data(),
+                        p + n_nodes + i * n_nodes,
+                        n_nodes
+                    );
+                }
+            }
+        }
+
+        // evaluate the model. this will modify every value in every layer
+        // except the input layer.
+        void forward_pass()
+        {
+            PROFILE_SCOPE(ForwardPass);
+
+            if (_format == half::Format::Bf16)
+                forward_pass_impl<half::Format::Bf16>();
+            else
+                forward_pass_impl<half::Format::Fp16>();
+        }
+
+    private:
+        template<half::Format format>
+        void forward_pass_impl()
+        {
+            for (size_t l = 1u; l < _n_layers; l++)
+            {
+                const size_t n_nodes = _layer_sizes[l];
+                const size_t n_prev_nodes = _layer_sizes[l - 1u];
+
+                const T* prev_values = values.data() + _value_offsets[l - 1u];
+                T* this_values = values.data() + _value_offsets[l];
+                const uint16_t* b = params.data() + _param_offsets[l];
+                const uint16_t* w = b + n_nodes;
+                const auto& activ = _activation_fns[l - 1u];
+
+                for (size_t n = 0u; n < n_nodes; n++)
+                {
+                    this_values[n] = (T)0;
+                }
+
+                for (size_t i = 0u; i < n_prev_nodes; i++)
+                {
+                    const T v = prev_values[i];
+                    if (v == (T)0)
+                    {
+                        continue;
+                    }
+
+                    // bf16 only needs a shift, so it's converted on the fly.
+                    // fp16 is converted in bulk (with F16C if available).
+                    const uint16_t* w_i = w + i * n_nodes;
+                    if constexpr (format == half::Format::Bf16)
+                    {
+                        for (size_t n = 0u; n < n_nodes; n++)
+                        {
+                            this_values[n] +=
+                                (T)half::bf16_to_float(w_i[n]) * v;
+                        }
+                    }
+                    else
+                    {
+                        half::to_float(format, w_i, row.data(), n_nodes);
+                        for (size_t n = 0u; n < n_nodes; n++)
+                        {
+                            this_values[n] += (T)row[n] * v;
+                        }
+                    }
+                }
+
+                half::to_float(_format, b, row.data(), n_nodes);
+                for (size_t n = 0u; n < n_nodes; n++)
+                {
+                    this_values[n] = activ(this_values[n] + (T)row[n]);
+                }
+            }
+        }
+
+    private:
+        size_t _n_layers;
+        std::vector<size_t> _layer_sizes;
+        std::vector<std::function<T(T)>> _activation_fns;
+        half::Format _format;
+
+        // index of the first value of each layer in values, and the first
+        // parameter (bias) of each layer in params.
+        std::vector<size_t> _value_offsets;
+        std::vector<size_t> _param_offsets;
+
+        std::vector<T> values;
+        std::vector<uint16_t> params;
+
+        // a row of parameters converted from or to the 16-bit format
+        std::vector<float> row;
+
+    };
+
+}
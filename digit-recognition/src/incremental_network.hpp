@@ -0,0 +1,188 @@
+#pragma once
+
+#include <vector>
+#include <span>
+#include <stdexcept>
+#include <cstdint>
+
+#include "neural.hpp"
+
+namespace neural
+{
+
+    // forward passes of a Network whose inputs change only a few at a time,
+    // like a drawing or a stream of sensor readings. the pre-activation values
+    // of the first hidden layer are kept between the passes, and a changed
+    // input only adds its weight times the change in its value to them
+    // (z += W[:, i] * (new - old)) instead of redoing the whole first layer,
+    // which is usually by far the biggest one. the rest of the layers are
+    // evaluated as usual.
+    // * the network must outlive this, and load_weights() must be called
+    //   whenever its weights or biases change.
+    // * the inputs must only be changed through set_input() or followed by
+    //   invalidate().
+    template<typename T, bool store_gradients>
+    class IncrementalForwardPass
+    {
+    public:
+        IncrementalForwardPass(Network<T, store_gradients>& net)
+            : net(net),
+            n_inputs(net.input_size()),
+            n_nodes(net.layer_sizes()[1]),
+            weights_t(n_inputs * n_nodes, (T)0),
+            pre_activ(n_nodes, (T)0)
+        {
+            load_weights();
+        }
+
+        IncrementalForwardPass(const IncrementalForwardPass&) = delete;
+        IncrementalForwardPass& operator=(
+            const IncrementalForwardPass&
+        ) = delete;
+
+        Network<T, store_gradients>& network()
+        {
+            return net;
+        }
+
+        // copy the first layer's weights from the network, transposed so
+        // that the weights of every input are next to each other. this also
+        // invalidates the pre-activation values.
+        void load_weights()
+        {
+            static constexpr size_t stride = store_gradients ? 2u : 1u;
+
+            for (size_t n = 0u; n < n_nodes; n++)
+            {
+                auto w = net.weights(1u, n);
+                for (size_t i = 0u; i < n_inputs; i++)
+                {
+                    weights_t[i * n_nodes + n] = w[i * stride];
+                }
+            }
+            invalidate();
+        }
+
+        // change the value of an input, updating the first layer's
+        // pre-activation values by the difference
+        void set_input(size_t input_idx, T value)
+        {
+            if (input_idx >= n_inputs)
+            {
+                throw std::invalid_argument("invalid input index");
+            }
+
+            T& input = net.input_values()[input_idx];
+            const T delta = value - input;
+            input = value;
+            if (!valid || delta == (T)0)
+            {
+                return;
+            }
+
+            const T* w = weights_t.data() + input_idx * n_nodes;
+            for (size_t n = 0u; n < n_nodes; n++)
+            {
+                pre_activ[n] += w[n] * delta;
+            }
+
+            // every update adds a little rounding error, so start over once
+            // the updates have cost as much as recalculating
+            n_updates++;
+            if (n_updates >= n_inputs)
+            {
+                valid = false;
+            }
+        }
+
+        // recalculate the first layer from all of the inputs in the next
+        // forward pass, for example after writing to the network's input
+        // values directly.
+        void invalidate()
+        {
+            valid = false;
+        }
+
+        // evaluate the first hidden layer from the pre-activation values.
+        // the other layers can then be evaluated with
+        // Network::forward_layer() (or ExitHeads::forward_pass()).
+        void update_first_layer()
+        {
+            if (!valid)
+            {
+                recalculate_pre_activ();
+            }
+
+            const auto& activ = net.activation_fn(1u);
+            auto values = net.values(1u);
+            for (size_t n = 0u; n < n_nodes; n++)
+            {
+                values[n] = activ(pre_activ[n]);
+            }
+
+            if constexpr (store_gradients)
+            {
+                copy_span<T>(pre_activ, net.pre_activ(1u));
+            }
+        }
+
+        // same as Network::forward_pass()
+        void forward_pass()
+        {
+            PROFILE_SCOPE(ForwardPass);
+
+            update_first_layer();
+            for (size_t l = 2u; l < net.n_layers(); l++)
+            {
+                net.forward_layer(l);
+            }
+        }
+
+    private:
+        Network<T, store_gradients>& net;
+        size_t n_inputs;
+        size_t n_nodes;
+
+        // first layer's weights in [input][node] order
+        std::vector<T> weights_t;
+
+        // first layer's pre-activation values for the current inputs
+        std::vector<T> pre_activ;
+
+        // whether pre_activ matches the inputs, and the number of inputs
+        // changed since it was last recalculated
+        bool valid = false;
+        size_t n_updates = 0;
+
+        void recalculate_pre_activ()
+        {
+            static constexpr size_t stride = store_gradients ? 2u : 1u;
+
+            auto biases = net.biases(1u);
+            for (size_t n = 0u; n < n_nodes; n++)
+            {
+                pre_activ[n] = biases[n * stride];
+            }
+
+            auto inputs = net.input_values();
+            for (size_t i = 0u; i < n_inputs; i++)
+            {
+                if (inputs[i] == (T)0)
+                {
+                    continue;
+                }
+
+                const T* w = weights_t.data() + i * n_nodes;
+                for (size_t n = 0u; n < n_nodes; n++)
+                {
+                    pre_activ[n] += w[n] * inputs[i];
+                }
+            }
+
+            valid = true;
+            n_updates = 0;
+        }
+
+    };
+
+}
@@ -1,12 +1,131 @@
 #include <iostream>
+#include <string>
+#include <string_view>
+#include <new>
+#include <stdexcept>
+#include <cstdlib>
 
 #include "app_curve_fitting.hpp"
+#include "app_benchmark.hpp"
+#include "app_sweep.hpp"
 #include "app_digit_rec.hpp"
+#include "alloc_counter.hpp"
 
-int main()
+#ifdef DIGIT_REC_COUNT_ALLOCATIONS
+
+// replace the global operator new to count heap allocations per thread. other
+// forms of operator new (arrays, nothrow) call this one by default.
+void* operator new(size_t size)
+{
+    alloc_counter::n_allocations++;
+    if (void* ptr = std::malloc(size == 0 ? 1 : size))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+#endif
+
+int main(int argc, char** argv)
 {
     try
     {
+        // --headless [seconds [threads]]: train without a window and print the
+        // training metrics, for the given number of seconds or until
+        // interrupted, optionally on several threads.
+        if (argc > 1 && std::string_view(argv[1]) == "--headless")
+        {
+            uint64_t duration_seconds = 0;
+            if (argc > 2)
+            {
+                duration_seconds = std::stoull(argv[2]);
+            }
+
+            uint32_t n_threads = 1;
+            if (argc > 3)
+            {
+                n_threads = (uint32_t)std::stoul(argv[3]);
+            }
+
+            digit_rec::App app;
+            app.run_headless(duration_seconds, n_threads);
+            return 0;
+        }
+
+        // --synthesize [count [threads]]: draw synthetic digits without a
+        // window, optionally on several threads, print how fast they were
+        // drawn, and save them in the MNIST format.
+        if (argc > 1 && std::string_view(argv[1]) == "--synthesize")
+        {
+            uint64_t n_samples = 60000;
+            if (argc > 2)
+            {
+                n_samples = std::stoull(argv[2]);
+            }
+
+            uint32_t n_threads = 1;
+            if (argc > 3)
+            {
+                n_threads = (uint32_t)std::stoul(argv[3]);
+            }
+
+            digit_rec::App app;
+            app.run_synthesize(n_samples, n_threads);
+            return 0;
+        }
+
+        // --benchmark [--perf]: run the kernel benchmarks and print the
+        // results, optionally with hardware performance counters.
+        if (argc > 1 && std::string_view(argv[1]) == "--benchmark")
+        {
+            bool use_perf_counters =
+                argc > 2 && std::string_view(argv[2]) == "--perf";
+
+            benchmark::App app(use_perf_counters);
+            app.run();
+            return 0;
+        }
+
+        // --sweep [grid [threads] | random [trials [threads]]]: search for
+        // good hyperparameters by training many networks at the same time,
+        // optionally on a given number of threads (one per CPU by default),
+        // and print and save the results.
+        if (argc > 1 && std::string_view(argv[1]) == "--sweep")
+        {
+            sweep::Options options;
+            int threads_arg = 3;
+            if (argc > 2 && std::string_view(argv[2]) == "random")
+            {
+                options.mode = sweep::SearchMode::Random;
+                if (argc > 3)
+                {
+                    options.n_random_trials = std::stoull(argv[3]);
+                }
+                threads_arg = 4;
+            }
+            else if (argc > 2 && std::string_view(argv[2]) != "grid")
+            {
+                throw std::invalid_argument(
+                    "the search mode must be grid or random"
+                );
+            }
+
+            if (argc > threads_arg)
+            {
+                options.n_threads = (uint32_t)std::stoul(argv[threads_arg]);
+            }
+
+            sweep::App app(options);
+            app.run();
+            return 0;
+        }
+
         digit_rec::App app;
         app.run();
     }
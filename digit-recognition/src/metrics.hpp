@@ -0,0 +1,306 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <limits>
+#include <stdexcept>
+#include <cstdint>
+
+namespace metrics
+{
+
+    // a single point in the training metrics history
+    struct Sample
+    {
+        // number of training steps done so far
+        uint64_t step = 0;
+
+        // number of training examples processed so far
+        uint64_t samples_seen = 0;
+
+        // time spent training so far (in seconds)
+        float wall_time = 0.f;
+
+        // accuracy on the test dataset
+        float accuracy = 0.f;
+
+        // average accuracy and cost on the training examples since the
+        // previous sample. these are NaN if they weren't recorded.
+        float training_accuracy = std::numeric_limits<float>::quiet_NaN();
+        float training_cost = std::numeric_limits<float>::quiet_NaN();
+
+        // training speed since the previous sample
+        float steps_per_second = 0.f;
+        float samples_per_second = 0.f;
+        float gflops = 0.f;
+
+        // time it took to calculate the accuracy (in seconds)
+        float eval_seconds = 0.f;
+
+        // accuracy on the same tests when predicting with early exits (see
+        // neural::ExitHeads), and the average fraction of the multiply-adds of
+        // a forward pass that it took. these are NaN without exit heads.
+        float early_exit_accuracy = std::numeric_limits<float>::quiet_NaN();
+        float early_exit_compute = std::numeric_limits<float>::quiet_NaN();
+    };
+
+    // time series of training metrics with a fixed capacity, written by a
+    // single thread (producer) and read by any number of threads (consumers)
+    // without locks.
+    // when the history is full, every other sample is dropped to make room,
+    // and from then on only every other sample that's pushed will be stored
+    // (and so on), so the history always covers the whole run with evenly
+    // spaced samples while using a bounded amount of memory. the most recent
+    // sample is always available through latest() regardless.
+    // * push() and clear() must only be called from one thread at a time.
+    // * readers never see a partially written sample. readers may need to
+    //   retry internally if the producer drops samples in the meantime, but
+    //   the producer never waits for readers.
+    class History
+    {
+    public:
+        // capacity must be an even number and at least 2
+        History(size_t capacity = 1024)
+            : _capacity(capacity),
+            slots(std::make_unique<Slot[]>(capacity))
+        {
+            if (capacity < 2 || capacity % 2 != 0)
+            {
+                throw std::invalid_argument(
+                    "capacity must be an even number and at least 2"
+                );
+            }
+        }
+
+        size_t capacity() const
+        {
+            return _capacity;
+        }
+
+        // add a sample to the end of the history (producer only)
+        void push(const Sample& sample)
+        {
+            // always keep the most recent sample
+            latest_seq.fetch_add(1u, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            latest_slot.store(sample);
+            has_latest.store(true, std::memory_order_relaxed);
+            latest_seq.fetch_add(1u, std::memory_order_release);
+
+            // only store every stride-th sample
+            n_pending++;
+            if (n_pending < stride)
+            {
+                return;
+            }
+            n_pending = 0;
+
+            const size_t n = _size.load(std::memory_order_relaxed);
+            if (n == _capacity)
+            {
+                // drop every other sample. readers might be in the middle of
+                // reading the samples we're moving, so we'll let them know
+                // that they need to retry (sequence lock).
+                seq.fetch_add(1u, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+
+                for (size_t i = 0; i < _capacity / 2u; i++)
+                {
+                    slots[i].store(slots[i * 2u + 1u].load());
+                }
+                _size.store(_capacity / 2u, std::memory_order_relaxed);
+
+                seq.fetch_add(1u, std::memory_order_release);
+
+                // the last sample we kept was pushed stride samples ago, but
+                // now samples need to be 2 * stride apart, so we'll skip this
+                // one and store the one that's pushed stride samples later.
+                n_pending = stride;
+                stride *= 2u;
+                return;
+            }
+
+            // readers never look past size(), so there's no need to bump the
+            // sequence number when appending.
+            slots[n].store(sample);
+            _size.store(n + 1u, std::memory_order_release);
+        }
+
+        // remove all samples (producer only)
+        void clear()
+        {
+            seq.fetch_add(1u, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            _size.store(0, std::memory_order_relaxed);
+            stride = 1;
+            n_pending = 0;
+
+            seq.fetch_add(1u, std::memory_order_release);
+
+            latest_seq.fetch_add(1u, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            has_latest.store(false, std::memory_order_relaxed);
+            latest_seq.fetch_add(1u, std::memory_order_release);
+        }
+
+        // number of samples currently stored
+        size_t size() const
+        {
+            return _size.load(std::memory_order_acquire);
+        }
+
+        // copy all samples into out. this reuses the memory in out, so it
+        // usually won't allocate if the same vector is used every time.
+        void read(std::vector<Sample>& out) const
+        {
+            while (true)
+            {
+                const uint64_t seq_before =
+                    seq.load(std::memory_order_acquire);
+                if (seq_before % 2u != 0)
+                {
+                    // samples are being dropped right now
+                    continue;
+                }
+
+                const size_t n = _size.load(std::memory_order_acquire);
+                out.resize(n);
+                for (size_t i = 0; i < n; i++)
+                {
+                    out[i] = slots[i].load();
+                }
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (seq.load(std::memory_order_relaxed) == seq_before)
+                {
+                    return;
+                }
+            }
+        }
+
+        // copy the most recently pushed sample into out (even if it wasn't
+        // stored in the history). returns false if nothing was pushed since
+        // creation or the last clear().
+        bool latest(Sample& out) const
+        {
+            while (true)
+            {
+                const uint64_t seq_before =
+                    latest_seq.load(std::memory_order_acquire);
+                if (seq_before % 2u != 0)
+                {
+                    continue;
+                }
+
+                const bool has_sample =
+                    has_latest.load(std::memory_order_relaxed);
+                if (has_sample)
+                {
+                    out = latest_slot.load();
+                }
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (latest_seq.load(std::memory_order_relaxed) == seq_before)
+                {
+                    return has_sample;
+                }
+            }
+        }
+
+    private:
+        // a sample stored as individual atomics so that a reader racing with
+        // the producer reads stale or torn values (which it will discard)
+        // instead of causing undefined behavior.
+        struct Slot
+        {
+            std::atomic_uint64_t step = 0;
+            std::atomic_uint64_t samples_seen = 0;
+            std::atomic<float> wall_time = 0.f;
+            std::atomic<float> accuracy = 0.f;
+            std::atomic<float> training_accuracy = 0.f;
+            std::atomic<float> training_cost = 0.f;
+            std::atomic<float> steps_per_second = 0.f;
+            std::atomic<float> samples_per_second = 0.f;
+            std::atomic<float> gflops = 0.f;
+            std::atomic<float> eval_seconds = 0.f;
+            std::atomic<float> early_exit_accuracy = 0.f;
+            std::atomic<float> early_exit_compute = 0.f;
+
+            void store(const Sample& s)
+            {
+                step.store(s.step, std::memory_order_relaxed);
+                samples_seen.store(s.samples_seen, std::memory_order_relaxed);
+                wall_time.store(s.wall_time, std::memory_order_relaxed);
+                accuracy.store(s.accuracy, std::memory_order_relaxed);
+                training_accuracy.store(
+                    s.training_accuracy,
+                    std::memory_order_relaxed
+                );
+                training_cost.store(
+                    s.training_cost,
+                    std::memory_order_relaxed
+                );
+                steps_per_second.store(
+                    s.steps_per_second,
+                    std::memory_order_relaxed
+                );
+                samples_per_second.store(
+                    s.samples_per_second,
+                    std::memory_order_relaxed
+                );
+                gflops.store(s.gflops, std::memory_order_relaxed);
+                eval_seconds.store(s.eval_seconds, std::memory_order_relaxed);
+                early_exit_accuracy.store(
+                    s.early_exit_accuracy,
+                    std::memory_order_relaxed
+                );
+                early_exit_compute.store(
+                    s.early_exit_compute,
+                    std::memory_order_relaxed
+                );
+            }
+
+            Sample load() const
+            {
+                return Sample{
+                    step.load(std::memory_order_relaxed),
+                    samples_seen.load(std::memory_order_relaxed),
+                    wall_time.load(std::memory_order_relaxed),
+                    accuracy.load(std::memory_order_relaxed),
+                    training_accuracy.load(std::memory_order_relaxed),
+                    training_cost.load(std::memory_order_relaxed),
+                    steps_per_second.load(std::memory_order_relaxed),
+                    samples_per_second.load(std::memory_order_relaxed),
+                    gflops.load(std::memory_order_relaxed),
+                    eval_seconds.load(std::memory_order_relaxed),
+                    early_exit_accuracy.load(std::memory_order_relaxed),
+                    early_exit_compute.load(std::memory_order_relaxed)
+                };
+            }
+        };
+
+        size_t _capacity;
+        std::unique_ptr<Slot[]> slots;
+
+        // number of samples currently stored
+        std::atomic_size_t _size = 0;
+
+        // sequence number, odd while samples are being dropped
+        std::atomic_uint64_t seq = 0;
+
+        // most recently pushed sample and its own sequence number, odd while
+        // it's being written.
+        Slot latest_slot;
+        std::atomic_bool has_latest = false;
+        std::atomic_uint64_t latest_seq = 0;
+
+        // producer-only state: only every stride-th pushed sample is stored,
+        // and n_pending counts the samples pushed since the last stored one.
+        size_t stride = 1;
+        size_t n_pending = 0;
+
+    };
+
+}
@@ -2,13 +2,19 @@
 
 #include <array>
 #include <vector>
+#include <algorithm>
 #include <span>
+#include <memory>
+#include <atomic>
 #include <functional>
 #include <random>
 #include <stdexcept>
 #include <cmath>
 #include <cstdint>
 
+#include "arena.hpp"
+#include "profiler.hpp"
+
 namespace neural
 {
 
@@ -99,6 +105,69 @@ namespace neural
         return a / (b * b);
     }
 
+    // the first layer only looks at the nonzero input values if at most this
+    // fraction of them are nonzero (most pixels in MNIST digits are exactly
+    // 0). denser inputs use the regular dense loops since going through an
+    // index list is slower than just multiplying by the zeros at that point.
+    static constexpr float SPARSE_INPUT_MAX_DENSITY = .5f;
+
+    // a single training example for classification problems. instead of
+    // storing a full expected output vector, we only store the index of the
+    // expected output node (class). the expected output is implicitly a one-hot
+    // vector that contains 1 for the expected node and 0 for the others.
+    // * input must point to at least input_size() values which must stay
+    //   valid while the network is using them.
+    template<typename T>
+    struct LabeledInput
+    {
+        const T* input;
+        size_t label;
+    };
+
+    // result of a combined forward and backward pass for a single
+    // classification example (see Network::forward_backward()).
+    template<typename T>
+    struct PassResult
+    {
+        // cost (squared error loss) for the example
+        T cost;
+
+        // index of the output node with the highest activation
+        size_t predicted_label;
+    };
+
+    // cost and accuracy for a batch of classification examples, collected for
+    // free during training (see Network::train()).
+    template<typename T>
+    struct BatchStats
+    {
+        // sum of the costs for all examples
+        T total_cost = (T)0;
+
+        // number of examples that were predicted correctly
+        size_t n_correct = 0;
+
+        // number of examples
+        size_t n_samples = 0;
+
+        void add(const BatchStats& other)
+        {
+            total_cost += other.total_cost;
+            n_correct += other.n_correct;
+            n_samples += other.n_samples;
+        }
+
+        T average_cost() const
+        {
+            return n_samples > 0 ? total_cost / (T)n_samples : (T)0;
+        }
+
+        T accuracy() const
+        {
+            return n_samples > 0 ? (T)n_correct / (T)n_samples : (T)0;
+        }
+    };
+
     // T is the type used to store numerical values. A typical value may
     // be `float`.
     // if store_gradients is false, then the network can only be used for
@@ -122,15 +191,24 @@ namespace neural
         // of layer_sizes.
         //
         // activation_derivs provides derivaties of the activation functions.
+        //
+        // all the parameters, gradients, and scratch memory are taken from
+        // arena if it's not nullptr (the arena must outlive the network), or
+        // from the heap otherwise. either way, they're aligned to
+        // arena::ALIGNMENT.
         Network(
             const std::vector<size_t>& layer_sizes,
             const std::vector<std::function<T(T)>>& activation_fns,
-            const std::vector<std::function<T(T)>>& activation_derivs
+            const std::vector<std::function<T(T)>>& activation_derivs,
+            arena::Arena* arena = nullptr
         )
             : _n_layers(layer_sizes.size()),
             _layer_sizes(layer_sizes),
             _activation_fns(activation_fns),
-            _activation_derivs(activation_derivs)
+            _activation_derivs(activation_derivs),
+            data(arena::Allocator<T>(arena)),
+            dcost_dz_scratch(arena::Allocator<T>(arena)),
+            nonzero_inputs(arena::Allocator<uint32_t>(arena))
         {
             if (_n_layers < 2u)
             {
@@ -171,11 +249,20 @@ namespace neural
             // example, the bias gradient of some node will be stored sizeof(T)
             // bytes after the bias of that node.
 
+            // we'll also cache the index of the first value of each layer
+            // (except the input layer) in data, which is where the layer's
+            // values are stored, followed by the rest of its data. every
+            // layer starts on a new cache line.
+            _layer_offsets.resize(_n_layers, 0u);
+
             size_t n_data = _layer_sizes[0];
             if constexpr (store_gradients)
             {
                 for (size_t l = 1u; l < _n_layers; l++)
                 {
+                    n_data = arena::align_up(n_data, LAYER_ALIGNMENT);
+                    _layer_offsets[l] = n_data;
+
                     size_t n_nodes = _layer_sizes[l];
                     n_data += n_nodes // values
                         + n_nodes // pre-activation values
@@ -188,6 +275,9 @@ namespace neural
             {
                 for (size_t l = 1u; l < _n_layers; l++)
                 {
+                    n_data = arena::align_up(n_data, LAYER_ALIGNMENT);
+                    _layer_offsets[l] = n_data;
+
                     size_t n_nodes = _layer_sizes[l];
                     n_data += n_nodes // values
                         + n_nodes // biases
@@ -195,6 +285,22 @@ namespace neural
                 }
             }
             data.resize(n_data, (T)0);
+
+            // scratch memory for backpropagation (see backpropagate()). this
+            // is allocated once here so that training steps don't need to
+            // allocate anything.
+            if constexpr (store_gradients)
+            {
+                size_t max_layer_size = 1u;
+                for (size_t l = 1u; l < _n_layers; l++)
+                {
+                    max_layer_size = std::max(max_layer_size, _layer_sizes[l]);
+                }
+                dcost_dz_scratch.resize(max_layer_size * 2u, (T)0);
+            }
+
+            // indices of the nonzero input values (see forward_pass())
+            nonzero_inputs.resize(_layer_sizes[0]);
         }
 
         constexpr size_t n_layers() const
@@ -217,6 +323,53 @@ namespace neural
             return layer_sizes()[_n_layers - 1u];
         }
 
+        // total number of weights in all layers
+        constexpr size_t n_weights() const
+        {
+            size_t n = 0;
+            for (size_t l = 1u; l < _n_layers; l++)
+            {
+                n += _layer_sizes[l - 1u] * _layer_sizes[l];
+            }
+            return n;
+        }
+
+        // total number of weights and biases in all layers
+        constexpr size_t n_parameters() const
+        {
+            size_t n = n_weights();
+            for (size_t l = 1u; l < _n_layers; l++)
+            {
+                n += _layer_sizes[l];
+            }
+            return n;
+        }
+
+        // approximate number of floating-point operations needed to train on
+        // a single example. this counts a multiply and an add for every weight
+        // in the forward pass, and twice that in backpropagation (for the
+        // weight gradients and for the gradients of the previous layer). the
+        // activation functions, biases, and gradient descent steps are
+        // ignored since they're small in comparison.
+        constexpr uint64_t training_flops_per_sample() const
+        {
+            return 6u * (uint64_t)n_weights();
+        }
+
+        // activation functions for all layers except the input layer
+        constexpr const std::vector<std::function<T(T)>>& activation_fns() const
+        {
+            return _activation_fns;
+        }
+
+        // derivatives of the activation functions for all layers except the
+        // input layer.
+        constexpr const std::vector<std::function<T(T)>>&
+            activation_derivs() const
+        {
+            return _activation_derivs;
+        }
+
         // activation function for a hidden layer or the output layer
         constexpr const std::function<T(T)>& activation_fn(
             size_t layer_idx
@@ -250,37 +403,8 @@ namespace neural
                 throw std::invalid_argument("invalid layer index");
             }
 
-            if (layer_idx == 0)
-            {
-                return std::span<T>(data.data(), input_size());
-            }
-
-            size_t data_idx = input_size();
-            if constexpr (store_gradients)
-            {
-                for (size_t l = 1u; l < layer_idx; l++)
-                {
-                    size_t n_nodes = layer_sizes()[l];
-                    size_t n_prev_nodes = layer_sizes()[l - 1u];
-                    data_idx += n_nodes // values
-                        + n_nodes // pre-activation values
-                        + n_nodes * 2u // biases + gradients
-                        + n_nodes * n_prev_nodes * 2u; // weights + gradients
-                }
-            }
-            else
-            {
-                for (size_t l = 1u; l < layer_idx; l++)
-                {
-                    size_t n_nodes = layer_sizes()[l];
-                    data_idx += n_nodes // values
-                        + n_nodes // biases
-                        + n_nodes * layer_sizes()[l - 1u]; // weights
-                }
-            }
-
             return std::span<T>(
-                data.data() + data_idx,
+                data.data() + _layer_offsets[layer_idx],
                 layer_sizes()[layer_idx]
             );
         }
@@ -303,20 +427,11 @@ namespace neural
                 throw std::invalid_argument("invalid layer index");
             }
 
-            size_t data_idx = input_size();
-            for (size_t l = 1u; l < layer_idx; l++)
-            {
-                size_t n_nodes = layer_sizes()[l];
-                size_t n_prev_nodes = layer_sizes()[l - 1u];
-                data_idx += n_nodes // values
-                    + n_nodes // pre-activation values
-                    + n_nodes * 2u // biases + gradients
-                    + n_nodes * n_prev_nodes * 2u; // weights + gradients
-            }
-            data_idx += layer_sizes()[layer_idx]; // this layer's values
-
+            // skip this layer's values
             return std::span<T>(
-                data.data() + data_idx,
+                data.data()
+                + _layer_offsets[layer_idx]
+                + layer_sizes()[layer_idx],
                 layer_sizes()[layer_idx]
             );
         }
@@ -342,43 +457,10 @@ namespace neural
                 throw std::invalid_argument("invalid layer index");
             }
 
-            size_t data_idx = input_size();
-            if constexpr (store_gradients)
-            {
-                for (size_t l = 1u; l < layer_idx; l++)
-                {
-                    size_t n_nodes = layer_sizes()[l];
-                    size_t n_prev_nodes = layer_sizes()[l - 1u];
-                    data_idx += n_nodes // values
-                        + n_nodes // pre-activation values
-                        + n_nodes * 2u // biases + gradients
-                        + n_nodes * n_prev_nodes * 2u; // weights + gradients
-                }
-
-                // this layer's values and pre-activation values
-                data_idx += layer_sizes()[layer_idx] * 2u;
-
-                return std::span<T>(
-                    data.data() + data_idx,
-                    layer_sizes()[layer_idx] * 2u
-                );
-            }
-            else
-            {
-                for (size_t l = 1u; l < layer_idx; l++)
-                {
-                    size_t n_nodes = layer_sizes()[l];
-                    data_idx += n_nodes // node values
-                        + n_nodes // biases
-                        + (n_nodes * layer_sizes()[l - 1u]); // weights
-                }
-                data_idx += layer_sizes()[layer_idx]; // this layer's values
-
-                return std::span<T>(
-                    data.data() + data_idx,
-                    layer_sizes()[layer_idx]
-                );
-            }
+            return std::span<T>(
+                data.data() + biases_offset(layer_idx),
+                layer_sizes()[layer_idx] * (store_gradients ? 2u : 1u)
+            );
         }
 
         // weights for a specific node in a layer. if store_gradients is true,
@@ -395,56 +477,78 @@ namespace neural
                 throw std::invalid_argument("invalid node index");
             }
 
-            size_t data_idx = input_size();
-            if constexpr (store_gradients)
-            {
-                for (size_t l = 1u; l < layer_idx; l++)
-                {
-                    size_t n_nodes = layer_sizes()[l];
-                    size_t n_prev_nodes = layer_sizes()[l - 1u];
-                    data_idx += n_nodes // values
-                        + n_nodes // pre-activation values
-                        + n_nodes * 2u // biases + gradients
-                        + n_nodes * n_prev_nodes * 2u; // weights + gradients
-                }
-
-                size_t n_nodes = layer_sizes()[layer_idx];
-                size_t n_prev_nodes = layer_sizes()[layer_idx - 1u];
-
-                // this layer's values and pre-activation values
-                data_idx += layer_sizes()[layer_idx] * 2u;
+            return std::span<T>(
+                data.data() + weights_offset(layer_idx, node_idx),
+                layer_sizes()[layer_idx - 1u] * (store_gradients ? 2u : 1u)
+            );
+        }
 
-                // biases + gradients
-                data_idx += n_nodes * 2u;
+        // biases of a layer followed by the weights of all its nodes, which
+        // are stored contiguously. if store_gradients is true, then every
+        // value will be immediately followed by its gradient.
+        constexpr std::span<T> parameters(size_t layer_idx)
+        {
+            if (layer_idx < 1u || layer_idx >= _n_layers)
+            {
+                throw std::invalid_argument("invalid layer index");
+            }
 
-                // weights + gradients for nodes up to node_idx
-                data_idx += node_idx * n_prev_nodes * 2u;
+            return std::span<T>(
+                data.data() + biases_offset(layer_idx),
+                layer_sizes()[layer_idx]
+                * (1u + layer_sizes()[layer_idx - 1u])
+                * (store_gradients ? 2u : 1u)
+            );
+        }
 
-                return std::span<T>(
-                    data.data() + data_idx,
-                    n_prev_nodes * 2u
+        // copy the weights and biases of another network with the exact same
+        // layer sizes into this network. the other network may or may not
+        // store gradients. gradients, values, and pre-activation values won't
+        // be copied.
+        template<bool other_store_gradients>
+        void copy_parameters_from(
+            const Network<T, other_store_gradients>& other
+        )
+        {
+            if (other.layer_sizes() != layer_sizes())
+            {
+                throw std::invalid_argument(
+                    "can't copy weights and biases from a network with "
+                    "different layer sizes"
                 );
             }
-            else
+
+            // step between two consecutive weights or biases in data
+            static constexpr size_t stride = store_gradients ? 2u : 1u;
+            static constexpr size_t other_stride =
+                other_store_gradients ? 2u : 1u;
+
+            for (size_t l = 1u; l < _n_layers; l++)
             {
-                for (size_t l = 1u; l < layer_idx; l++)
+                const size_t n_nodes = layer_sizes()[l];
+                const size_t n_prev_nodes = layer_sizes()[l - 1u];
+
+                // biases
                 {
-                    size_t n_nodes = layer_sizes()[l];
-                    data_idx += n_nodes // node values
-                        + n_nodes // biases
-                        + (n_nodes * layer_sizes()[l - 1u]); // weights
+                    T* dst = data.data() + biases_offset(l);
+                    const T* src = other.data.data() + other.biases_offset(l);
+                    for (size_t n = 0u; n < n_nodes; n++)
+                    {
+                        dst[n * stride] = src[n * other_stride];
+                    }
                 }
 
-                size_t n_nodes = layer_sizes()[layer_idx];
-                size_t n_prev_nodes = layer_sizes()[layer_idx - 1u];
-
-                data_idx += n_nodes * 2u; // this layer's values & biases
-                data_idx += node_idx * n_prev_nodes; // weights
-
-                return std::span<T>(
-                    data.data() + data_idx,
-                    n_prev_nodes
-                );
+                // weights. the weights of all nodes in a layer are stored
+                // contiguously, so we can copy them in one go.
+                {
+                    T* dst = data.data() + weights_offset(l, 0u);
+                    const T* src =
+                        other.data.data() + other.weights_offset(l, 0u);
+                    for (size_t i = 0u; i < n_nodes * n_prev_nodes; i++)
+                    {
+                        dst[i * stride] = src[i * other_stride];
+                    }
+                }
             }
         }
 
@@ -610,6 +714,8 @@ namespace neural
                 );
             }
 
+            PROFILE_SCOPE(ZeroGradients);
+
             for (size_t l = 1u; l < _n_layers; l++)
             {
                 auto b = biases(l);
@@ -634,54 +740,94 @@ namespace neural
         // all pre-activation values as well.
         void forward_pass()
         {
+            PROFILE_SCOPE(ForwardPass);
+
             for (size_t layer_idx = 1u; layer_idx < _n_layers; layer_idx++)
             {
-                auto prev_layer_values = values(layer_idx - 1u);
-                auto this_layer_values = values(layer_idx);
-                auto this_layer_biases = biases(layer_idx);
-                const auto& activ = activation_fn(layer_idx);
+                forward_layer(layer_idx);
+            }
+        }
 
-                std::span<T> this_layer_pre_activ;
-                if constexpr (store_gradients)
-                {
-                    this_layer_pre_activ = pre_activ(layer_idx);
-                }
+        // evaluate a single layer (except the input layer) from the values in
+        // the previous layer. calling this for every layer in order is the
+        // same as forward_pass(), but it can be stopped early (see
+        // ExitHeads).
+        void forward_layer(size_t layer_idx)
+        {
+            auto prev_layer_values = values(layer_idx - 1u);
+            auto this_layer_values = values(layer_idx);
+            auto this_layer_biases = biases(layer_idx);
+            const auto& activ = activation_fn(layer_idx);
+
+            std::span<T> this_layer_pre_activ;
+            if constexpr (store_gradients)
+            {
+                this_layer_pre_activ = pre_activ(layer_idx);
+            }
 
-                const size_t n_nodes = layer_sizes()[layer_idx];
-                const size_t n_prev_nodes = layer_sizes()[layer_idx - 1];
+            const size_t n_nodes = layer_sizes()[layer_idx];
+            const size_t n_prev_nodes = layer_sizes()[layer_idx - 1];
 
-                if constexpr (store_gradients)
+            // the first layer skips the zeros in the input if there are
+            // enough of them. the weighted sums are still added up in the
+            // same order, so the results don't change.
+            const bool sparse = layer_idx == 1u && find_nonzero_inputs();
+
+            if constexpr (store_gradients)
+            {
+                for (size_t node_idx = 0u; node_idx < n_nodes; node_idx++)
                 {
-                    for (size_t node_idx = 0u; node_idx < n_nodes; node_idx++)
-                    {
-                        auto w = weights(layer_idx, node_idx);
+                    auto w = weights(layer_idx, node_idx);
 
-                        T weighted_sum = (T)0;
+                    T weighted_sum = (T)0;
+                    if (sparse)
+                    {
+                        for (size_t k = 0u; k < n_nonzero_inputs; k++)
+                        {
+                            const size_t i = nonzero_inputs[k];
+                            weighted_sum +=
+                                w[i * 2u] * prev_layer_values[i];
+                        }
+                    }
+                    else
+                    {
                         for (size_t i = 0u; i < n_prev_nodes; i++)
                         {
-                            weighted_sum += w[i * 2u] * prev_layer_values[i];
+                            weighted_sum +=
+                                w[i * 2u] * prev_layer_values[i];
                         }
-                        weighted_sum += this_layer_biases[node_idx * 2u];
-
-                        this_layer_pre_activ[node_idx] = weighted_sum;
-                        this_layer_values[node_idx] = activ(weighted_sum);
                     }
+                    weighted_sum += this_layer_biases[node_idx * 2u];
+
+                    this_layer_pre_activ[node_idx] = weighted_sum;
+                    this_layer_values[node_idx] = activ(weighted_sum);
                 }
-                else
+            }
+            else
+            {
+                for (size_t node_idx = 0u; node_idx < n_nodes; node_idx++)
                 {
-                    for (size_t node_idx = 0u; node_idx < n_nodes; node_idx++)
-                    {
-                        auto w = weights(layer_idx, node_idx);
+                    auto w = weights(layer_idx, node_idx);
 
-                        T weighted_sum = (T)0;
+                    T weighted_sum = (T)0;
+                    if (sparse)
+                    {
+                        for (size_t k = 0u; k < n_nonzero_inputs; k++)
+                        {
+                            const size_t i = nonzero_inputs[k];
+                            weighted_sum += w[i] * prev_layer_values[i];
+                        }
+                    }
+                    else
+                    {
                         for (size_t i = 0u; i < n_prev_nodes; i++)
                         {
                             weighted_sum += w[i] * prev_layer_values[i];
                         }
-                        weighted_sum += this_layer_biases[node_idx];
-
-                        this_layer_values[node_idx] = activ(weighted_sum);
                     }
+                    weighted_sum += this_layer_biases[node_idx];
+
+                    this_layer_values[node_idx] = activ(weighted_sum);
                 }
             }
         }
@@ -697,35 +843,6 @@ namespace neural
         template<bool accumulate_gradients, bool sanity_checks = true>
         void backward_pass(std::span<T> input, std::span<T> expected_output)
         {
-            // Note to others and future self:
-            // First of all, I highly suggest checking out the helpful links
-            // provided in README.md.
-            // I know the maths might be confusing at first. It took me nearly 3
-            // days of watching videos, reading articles, and asking fellow NN
-            // enthusiasts on the internet for help before I finally had an idea
-            // of how to implement backpropagation.
-            // The basic idea is that, if you know how the activations in a
-            // layer affect the cost function (dcost_dact), then you can
-            // calculate all the weight and bias gradients in that layer
-            // (gradient of the cost function with respect to those weights or
-            // biases).
-            // Now, calculating this dcost_dact vector for the output layer is
-            // straightforward, because you only need your predicted output
-            // values and the expected output values to calculate it (and, of
-            // course, the cost function itself). However, for other layers, we
-            // don't know how their activations affect the cost function. In
-            // other words, we don't know their dcost_dact. So once we calculate
-            // the output layer's dcost_dact, we use those and the weights in
-            // the output layer to calculate the second-to-last layer's
-            // dcost_dact. And then the cycles repeats, because now we know
-            // the dcost_dact of the second-to-last layer, so we can calculate
-            // its weight and bias gradients just like before, and then we can
-            // calculate dcost_dact for the layer before that, and then
-            // calculate its gradient, and so on and so forth.
-            // Note that we use the chain rule from calculus to compute said
-            // gradients. Backpropagation is just a way to avoid duplicate
-            // calculations.
-
             if constexpr (!store_gradients)
             {
                 throw std::logic_error(
@@ -752,151 +869,91 @@ namespace neural
             copy_span(input, input_values());
             forward_pass();
 
-            // cache the gradient of the cost function with respect to the
-            // pre-activation values in each node in the current and previous
-            // layers (dcost_dz).
-            // the size of these two vectors will be equal to the maximum layer
-            // size to avoid extra memory (de)allocations. we'll alternate
-            // between the two vectors, so one of them will be treated as the
-            // current layer's dcost_dz and the other will be the previous
-            // layer's, and the order will swap after every iteration.
-            size_t max_layer_size = 1u;
-            for (size_t l = 1u; l < _n_layers; l++)
+            backpropagate<accumulate_gradients>(
+                [&expected_output](size_t n, T predicted)
+                {
+                    return (T)2 * (predicted - expected_output[n]);
+                }
+            );
+        }
+
+        // same as above, but the expected output is a one-hot vector that
+        // contains 1 for the node at expected_label and 0 for the others, so
+        // it doesn't need to be stored anywhere.
+        template<bool accumulate_gradients, bool sanity_checks = true>
+        void backward_pass(std::span<const T> input, size_t expected_label)
+        {
+            forward_backward<accumulate_gradients, sanity_checks>(
+                input,
+                expected_label
+            );
+        }
+
+        // do a single forward pass for a classification example and calculate
+        // the cost (squared error loss) and the predicted label, then reuse
+        // that same forward pass to calculate the weight and bias gradients
+        // using backpropagation. this is equivalent to calling cost() and
+        // backward_pass(), but it only does one forward pass instead of two.
+        // this will modify every value, weight, and bias in every layer, so
+        // output_values() will contain the network's prediction afterwards.
+        // see backward_pass() for the meaning of accumulate_gradients.
+        template<bool accumulate_gradients, bool sanity_checks = true>
+        PassResult<T> forward_backward(
+            std::span<const T> input,
+            size_t expected_label
+        )
+        {
+            if constexpr (!store_gradients)
             {
-                max_layer_size = std::max(max_layer_size, layer_sizes()[l]);
+                throw std::logic_error(
+                    "can't do backward pass when store_gradients is false"
+                );
             }
-            std::vector<T> dcost_dz_0(max_layer_size, (T)0);
-            std::vector<T> dcost_dz_1(max_layer_size, (T)0);
 
-            // iter will increase in the backward layer loop
-            size_t iter = 0;
-            T* this_layer_dcost_dz;
-            T* prev_layer_dcost_dz;
-            if (iter % 2 == 0)
+            if (sanity_checks && input.size() != input_size())
             {
-                this_layer_dcost_dz = dcost_dz_0.data();
-                prev_layer_dcost_dz = dcost_dz_1.data();
+                throw std::invalid_argument(
+                    "invalid input data size"
+                );
             }
-            else
+
+            if (sanity_checks && expected_label >= output_size())
             {
-                this_layer_dcost_dz = dcost_dz_1.data();
-                prev_layer_dcost_dz = dcost_dz_0.data();
+                throw std::invalid_argument(
+                    "invalid expected label"
+                );
             }
 
-            // calculate the gradient of the cost function with respect to the
-            // pre-activation values in the output layer's nodes (dcost_dz).
-            {
-                auto predicted_output = output_values();
-                auto output_layer_pre_activ = pre_activ(_n_layers - 1u);
+            // do a forward pass first to calculate the network's current
+            // prediction and all the pre-activation and activation values.
+            std::copy(input.begin(), input.end(), input_values().begin());
+            forward_pass();
 
-                // gradient of the activation function with respect to the
-                // output layer's pre-activation values. (this is a function
-                // pointer).
-                const auto& dact_dz = activation_deriv(_n_layers - 1u);
+            // calculate the cost and the predicted label while the output
+            // values are still fresh.
+            PassResult<T> result{ (T)0, 0 };
+            auto output = output_values();
+            for (size_t i = 0u; i < output.size(); i++)
+            {
+                T expected = (i == expected_label) ? (T)1 : (T)0;
+                T diff = output[i] - expected;
+                result.cost += (diff * diff);
 
-                for (size_t n = 0u; n < output_size(); n++)
+                if (output[i] > output[result.predicted_label])
                 {
-                    // gradient of the cost function with respect to the node
-                    // activations in the output layer.
-                    T dcost_dact =
-                        (T)2 * (predicted_output[n] - expected_output[n]);
+                    result.predicted_label = i;
+                }
+            }
 
-                    this_layer_dcost_dz[n] =
-                        dcost_dact
-                        * dact_dz(output_layer_pre_activ[n]);
-                }
-            }
-
-            // start from the last layer (output layer) and go backward
-            for (ptrdiff_t l = _n_layers - 1u; l >= 1; l--)
-            {
-                // gradient of the cost function with respect to the
-                // pre-activation values in the current and previous layers
-                // (dcost_dz).
-                if (iter % 2 == 0)
-                {
-                    this_layer_dcost_dz = dcost_dz_0.data();
-                    prev_layer_dcost_dz = dcost_dz_1.data();
-                }
-                else
-                {
-                    this_layer_dcost_dz = dcost_dz_1.data();
-                    prev_layer_dcost_dz = dcost_dz_0.data();
-                }
-
-                auto prev_layer_values = values(l - 1);
-                auto this_layer_biases = biases(l);
-
-                // calculate the gradient of the cost function with respect to
-                // the weights and biases.
-                for (size_t n = 0u; n < layer_sizes()[l]; n++)
-                {
-                    // gradient of the cost function with respect to the current
-                    // node's pre-activation value.
-                    T dcost_dz = this_layer_dcost_dz[n];
-
-                    // bias gradient
-                    if constexpr (accumulate_gradients)
-                    {
-                        this_layer_biases[n * 2u + 1u] += dcost_dz;
-                    }
-                    else
-                    {
-                        this_layer_biases[n * 2u + 1u] = dcost_dz;
-                    }
-
-                    // weight gradients
-                    auto w = weights(l, n);
-                    if constexpr (accumulate_gradients)
-                    {
-                        for (size_t pn = 0u; pn < layer_sizes()[l - 1]; pn++)
-                        {
-                            w[pn * 2u + 1u] += dcost_dz * prev_layer_values[pn];
-                        }
-                    }
-                    else
-                    {
-                        for (size_t pn = 0u; pn < layer_sizes()[l - 1]; pn++)
-                        {
-                            w[pn * 2u + 1u] = dcost_dz * prev_layer_values[pn];
-                        }
-                    }
-                }
-
-                if (l <= 1)
-                {
-                    iter++;
-                    continue;
-                }
-
-                auto prev_layer_pre_activ = pre_activ(l - 1u);
-
-                // gradient of the activation function with respect to the
-                // previous layer's pre-activation values. (this is a function
-                // pointer).
-                const auto& prev_dact_dz = activation_deriv(l - 1u);
-
-                // calculate the gradient of the cost function with respect to
-                // the pre-activation values in the previous layer (dcost_dz).
-                for (size_t pn = 0u; pn < layer_sizes()[l - 1]; pn++)
+            backpropagate<accumulate_gradients>(
+                [expected_label](size_t n, T predicted)
                 {
-                    // this is the gradient of the cost function with respect to
-                    // the activation values in the previous layer (dcost_dact).
-                    T dcost_dact_pn = (T)0;
-                    for (size_t n = 0u; n < layer_sizes()[l]; n++)
-                    {
-                        dcost_dact_pn +=
-                            this_layer_dcost_dz[n] // dcost_dz
-                            * weights(l, n)[pn * 2u]; // dz_dact
-                    }
-
-                    prev_layer_dcost_dz[pn] =
-                        dcost_dact_pn
-                        * prev_dact_dz(prev_layer_pre_activ[pn]);;
+                    T expected = (n == expected_label) ? (T)1 : (T)0;
+                    return (T)2 * (predicted - expected);
                 }
+            );
 
-                iter++;
-            }
+            return result;
         }
 
         // perform accumulated backward pass for more than one training example
@@ -909,7 +966,9 @@ namespace neural
         // * each element in data_points must be of size
         //   (input_size() + output_size()) and contain input data and expected
         //   output data.
-        void accumulated_backward_pass(std::vector<std::span<T>> data_points)
+        void accumulated_backward_pass(
+            const std::vector<std::span<T>>& data_points
+        )
         {
             if constexpr (!store_gradients)
             {
@@ -934,6 +993,64 @@ namespace neural
             }
         }
 
+        // same as above, but for classification examples that only store the
+        // input data and the index of the expected output node. this also
+        // returns the cost and accuracy for the examples, which are calculated
+        // from the same forward passes used for backpropagation.
+        BatchStats<T> accumulated_backward_pass(
+            std::span<const LabeledInput<T>> samples
+        )
+        {
+            return accumulated_backward_pass(
+                samples,
+                [](const LabeledInput<T>&) {}
+            );
+        }
+
+        // same as above, but on_sample(sample) is called right after the
+        // forward and backward pass of every sample, while values() still
+        // contains the sample's activations (for example to train ExitHeads
+        // on them).
+        template<typename SampleFn>
+        BatchStats<T> accumulated_backward_pass(
+            std::span<const LabeledInput<T>> samples,
+            const SampleFn& on_sample
+        )
+        {
+            if constexpr (!store_gradients)
+            {
+                throw std::logic_error(
+                    "can't do averaged backward pass when store_gradients is "
+                    "false"
+                );
+            }
+
+            BatchStats<T> stats;
+            zero_gradients();
+            for (const auto& sample : samples)
+            {
+                if (sample.label >= output_size())
+                {
+                    throw std::invalid_argument("invalid expected label");
+                }
+
+                PassResult<T> result = forward_backward<true, false>(
+                    std::span<const T>(sample.input, input_size()),
+                    sample.label
+                );
+
+                stats.total_cost += result.cost;
+                if (result.predicted_label == sample.label)
+                {
+                    stats.n_correct++;
+                }
+
+                on_sample(sample);
+            }
+            stats.n_samples = samples.size();
+            return stats;
+        }
+
         // perform a single gradient descent step based on given training data
         // and learning rate. ideally, you would call this function many times
         // until a local minimum for the cost is found.
@@ -942,7 +1059,10 @@ namespace neural
         //   (input_size() + output_size()) and contain input data and expected
         //   output data.
         // * a typical value for learning_rate is 0.01.
-        void train(std::vector<std::span<T>> data_points, T learning_rate)
+        void train(
+            const std::vector<std::span<T>>& data_points,
+            T learning_rate
+        )
         {
             if constexpr (!store_gradients)
             {
@@ -955,29 +1075,31 @@ namespace neural
             // (data point).
             accumulated_backward_pass(data_points);
 
-            // constant factor to divide gradients by the number of training
-            // examples
-            const T inv_n_data_points = (T)1 / (T)data_points.size();
+            gradient_descent_step(data_points.size(), learning_rate);
+        }
 
-            for (size_t l = 1u; l < _n_layers; l++)
+        // same as above, but for classification examples that only store the
+        // input data and the index of the expected output node. this doesn't
+        // copy or allocate anything for the training examples. the returned
+        // cost and accuracy are based on the weights and biases before the
+        // gradient descent step.
+        BatchStats<T> train(
+            std::span<const LabeledInput<T>> samples,
+            T learning_rate
+        )
+        {
+            if constexpr (!store_gradients)
             {
-                auto b = biases(l);
-                for (size_t i = 0u; i < b.size(); i += 2u)
-                {
-                    T grad = b[i + 1u] * inv_n_data_points;
-                    b[i] -= grad * learning_rate;
-                }
-
-                for (size_t n = 0u; n < layer_sizes()[l]; n++)
-                {
-                    auto w = weights(l, n);
-                    for (size_t i = 0u; i < w.size(); i += 2u)
-                    {
-                        T grad = w[i + 1u] * inv_n_data_points;
-                        w[i] -= grad * learning_rate;
-                    }
-                }
+                throw std::logic_error(
+                    "can't train when store_gradients is false"
+                );
             }
+
+            // add up the weight and bias gradients for every training example
+            BatchStats<T> stats = accumulated_backward_pass(samples);
+
+            gradient_descent_step(samples.size(), learning_rate);
+            return stats;
         }
 
         // calculate the cost for a given data point using squared error loss
@@ -1017,7 +1139,7 @@ namespace neural
         // * each element in data_points must be of size
         //   (input_size() + output_size()) and contain input data and expected
         //   output data.
-        T average_cost(std::vector<std::span<T>> data_points)
+        T average_cost(const std::vector<std::span<T>>& data_points)
         {
             T c = (T)0;
             for (const auto& data_point : data_points)
@@ -1036,13 +1158,394 @@ namespace neural
             return c;
         }
 
+        // subtract the accumulated weight and bias gradients (averaged over
+        // n_data_points training examples and scaled by the learning rate)
+        // from the weights and biases.
+        void gradient_descent_step(size_t n_data_points, T learning_rate)
+        {
+            if constexpr (!store_gradients)
+            {
+                throw std::logic_error(
+                    "can't do gradient descent when store_gradients is false"
+                );
+            }
+
+            PROFILE_SCOPE(GradientDescent);
+
+            // constant factor to divide gradients by the number of training
+            // examples
+            const T inv_n_data_points = (T)1 / (T)n_data_points;
+
+            for (size_t l = 1u; l < _n_layers; l++)
+            {
+                auto b = biases(l);
+                for (size_t i = 0u; i < b.size(); i += 2u)
+                {
+                    T grad = b[i + 1u] * inv_n_data_points;
+                    b[i] -= grad * learning_rate;
+                }
+
+                for (size_t n = 0u; n < layer_sizes()[l]; n++)
+                {
+                    auto w = weights(l, n);
+                    for (size_t i = 0u; i < w.size(); i += 2u)
+                    {
+                        T grad = w[i + 1u] * inv_n_data_points;
+                        w[i] -= grad * learning_rate;
+                    }
+                }
+            }
+        }
+
+    private:
+        // calculate the weight and bias gradients in every layer using
+        // backpropagation, assuming that a forward pass has already been done
+        // for the current training example.
+        // output_dcost_dact(n, predicted) must return the gradient of the cost
+        // function with respect to the activation of node n in the output
+        // layer, given the predicted (current) activation of that node.
+        template<bool accumulate_gradients, typename DcostDactFn>
+        void backpropagate(const DcostDactFn& output_dcost_dact)
+        {
+            // Note to others and future self:
+            // First of all, I highly suggest checking out the helpful links
+            // provided in README.md.
+            // I know the maths might be confusing at first. It took me nearly 3
+            // days of watching videos, reading articles, and asking fellow NN
+            // enthusiasts on the internet for help before I finally had an idea
+            // of how to implement backpropagation.
+            // The basic idea is that, if you know how the activations in a
+            // layer affect the cost function (dcost_dact), then you can
+            // calculate all the weight and bias gradients in that layer
+            // (gradient of the cost function with respect to those weights or
+            // biases).
+            // Now, calculating this dcost_dact vector for the output layer is
+            // straightforward, because you only need your predicted output
+            // values and the expected output values to calculate it (and, of
+            // course, the cost function itself). However, for other layers, we
+            // don't know how their activations affect the cost function. In
+            // other words, we don't know their dcost_dact. So once we calculate
+            // the output layer's dcost_dact, we use those and the weights in
+            // the output layer to calculate the second-to-last layer's
+            // dcost_dact. And then the cycles repeats, because now we know
+            // the dcost_dact of the second-to-last layer, so we can calculate
+            // its weight and bias gradients just like before, and then we can
+            // calculate dcost_dact for the layer before that, and then
+            // calculate its gradient, and so on and so forth.
+            // Note that we use the chain rule from calculus to compute said
+            // gradients. Backpropagation is just a way to avoid duplicate
+            // calculations.
+
+            PROFILE_SCOPE(Backpropagation);
+
+            // cache the gradient of the cost function with respect to the
+            // pre-activation values in each node in the current and previous
+            // layers (dcost_dz).
+            // the size of these two arrays will be equal to the maximum layer
+            // size and they live in dcost_dz_scratch which is allocated once
+            // in the constructor. we'll alternate between the two arrays, so
+            // one of them will be treated as the current layer's dcost_dz and
+            // the other will be the previous layer's, and the order will swap
+            // after every iteration.
+            const size_t max_layer_size = dcost_dz_scratch.size() / 2u;
+            T* dcost_dz_0 = dcost_dz_scratch.data();
+            T* dcost_dz_1 = dcost_dz_scratch.data() + max_layer_size;
+
+            // iter will increase in the backward layer loop
+            size_t iter = 0;
+            T* this_layer_dcost_dz;
+            T* prev_layer_dcost_dz;
+            if (iter % 2 == 0)
+            {
+                this_layer_dcost_dz = dcost_dz_0;
+                prev_layer_dcost_dz = dcost_dz_1;
+            }
+            else
+            {
+                this_layer_dcost_dz = dcost_dz_1;
+                prev_layer_dcost_dz = dcost_dz_0;
+            }
+
+            // calculate the gradient of the cost function with respect to the
+            // pre-activation values in the output layer's nodes (dcost_dz).
+            {
+                auto predicted_output = output_values();
+                auto output_layer_pre_activ = pre_activ(_n_layers - 1u);
+
+                // gradient of the activation function with respect to the
+                // output layer's pre-activation values. (this is a function
+                // pointer).
+                const auto& dact_dz = activation_deriv(_n_layers - 1u);
+
+                for (size_t n = 0u; n < output_size(); n++)
+                {
+                    // gradient of the cost function with respect to the node
+                    // activations in the output layer.
+                    T dcost_dact = output_dcost_dact(n, predicted_output[n]);
+
+                    this_layer_dcost_dz[n] =
+                        dcost_dact
+                        * dact_dz(output_layer_pre_activ[n]);
+                }
+            }
+
+            // start from the last layer (output layer) and go backward
+            for (ptrdiff_t l = _n_layers - 1u; l >= 1; l--)
+            {
+                // gradient of the cost function with respect to the
+                // pre-activation values in the current and previous layers
+                // (dcost_dz).
+                if (iter % 2 == 0)
+                {
+                    this_layer_dcost_dz = dcost_dz_0;
+                    prev_layer_dcost_dz = dcost_dz_1;
+                }
+                else
+                {
+                    this_layer_dcost_dz = dcost_dz_1;
+                    prev_layer_dcost_dz = dcost_dz_0;
+                }
+
+                auto prev_layer_values = values(l - 1);
+                auto this_layer_biases = biases(l);
+
+                // calculate the gradient of the cost function with respect to
+                // the weights and biases.
+                for (size_t n = 0u; n < layer_sizes()[l]; n++)
+                {
+                    // gradient of the cost function with respect to the current
+                    // node's pre-activation value.
+                    T dcost_dz = this_layer_dcost_dz[n];
+
+                    // bias gradient
+                    if constexpr (accumulate_gradients)
+                    {
+                        this_layer_biases[n * 2u + 1u] += dcost_dz;
+                    }
+                    else
+                    {
+                        this_layer_biases[n * 2u + 1u] = dcost_dz;
+                    }
+
+                    // weight gradients. when accumulating, the zeros in the
+                    // input wouldn't add anything to the first layer's
+                    // gradients, so we can skip them.
+                    auto w = weights(l, n);
+                    if constexpr (accumulate_gradients)
+                    {
+                        if (l == 1 && last_pass_sparse)
+                        {
+                            for (size_t k = 0u; k < n_nonzero_inputs; k++)
+                            {
+                                const size_t pn = nonzero_inputs[k];
+                                w[pn * 2u + 1u] +=
+                                    dcost_dz * prev_layer_values[pn];
+                            }
+                        }
+                        else
+                        {
+                            const size_t n_prev_nodes = layer_sizes()[l - 1];
+                            for (size_t pn = 0u; pn < n_prev_nodes; pn++)
+                            {
+                                w[pn * 2u + 1u] +=
+                                    dcost_dz * prev_layer_values[pn];
+                            }
+                        }
+                    }
+                    else
+                    {
+                        for (size_t pn = 0u; pn < layer_sizes()[l - 1]; pn++)
+                        {
+                            w[pn * 2u + 1u] = dcost_dz * prev_layer_values[pn];
+                        }
+                    }
+                }
+
+                if (l <= 1)
+                {
+                    iter++;
+                    continue;
+                }
+
+                auto prev_layer_pre_activ = pre_activ(l - 1u);
+
+                // gradient of the activation function with respect to the
+                // previous layer's pre-activation values. (this is a function
+                // pointer).
+                const auto& prev_dact_dz = activation_deriv(l - 1u);
+
+                // calculate the gradient of the cost function with respect to
+                // the pre-activation values in the previous layer (dcost_dz).
+                for (size_t pn = 0u; pn < layer_sizes()[l - 1]; pn++)
+                {
+                    // this is the gradient of the cost function with respect to
+                    // the activation values in the previous layer (dcost_dact).
+                    T dcost_dact_pn = (T)0;
+                    for (size_t n = 0u; n < layer_sizes()[l]; n++)
+                    {
+                        dcost_dact_pn +=
+                            this_layer_dcost_dz[n] // dcost_dz
+                            * weights(l, n)[pn * 2u]; // dz_dact
+                    }
+
+                    prev_layer_dcost_dz[pn] =
+                        dcost_dact_pn
+                        * prev_dact_dz(prev_layer_pre_activ[pn]);;
+                }
+
+                iter++;
+            }
+        }
+
+        // fill nonzero_inputs with the indices of the nonzero values in the
+        // input layer and return whether the first layer should use them
+        // (see SPARSE_INPUT_MAX_DENSITY).
+        bool find_nonzero_inputs()
+        {
+            auto input = input_values();
+
+            n_nonzero_inputs = 0;
+            for (size_t i = 0u; i < input.size(); i++)
+            {
+                if (input[i] != (T)0)
+                {
+                    nonzero_inputs[n_nonzero_inputs] = (uint32_t)i;
+                    n_nonzero_inputs++;
+                }
+            }
+
+            last_pass_sparse = (float)n_nonzero_inputs
+                <= SPARSE_INPUT_MAX_DENSITY * (float)input.size();
+            return last_pass_sparse;
+        }
+
+        // index of the first bias in a layer in data
+        constexpr size_t biases_offset(size_t layer_idx) const
+        {
+            // skip this layer's values (and pre-activation values)
+            return _layer_offsets[layer_idx]
+                + layer_sizes()[layer_idx] * (store_gradients ? 2u : 1u);
+        }
+
+        // index of the first weight of a node in a layer in data
+        constexpr size_t weights_offset(size_t layer_idx, size_t node_idx) const
+        {
+            // skip this layer's biases (and their gradients) and the weights
+            // (and gradients) of the nodes before node_idx.
+            constexpr size_t stride = store_gradients ? 2u : 1u;
+            return biases_offset(layer_idx)
+                + layer_sizes()[layer_idx] * stride
+                + node_idx * layer_sizes()[layer_idx - 1u] * stride;
+        }
+
     private:
         size_t _n_layers;
         std::vector<size_t> _layer_sizes;
         std::vector<std::function<T(T)>> _activation_fns;
         std::vector<std::function<T(T)>> _activation_derivs;
 
-        std::vector<T> data;
+        // number of elements of type T in a cache line
+        static constexpr size_t LAYER_ALIGNMENT =
+            std::max(arena::ALIGNMENT / sizeof(T), (size_t)1u);
+
+        // index of the first value of each layer in data
+        std::vector<size_t> _layer_offsets;
+
+        arena::Vector<T> data;
+
+        // networks with different template parameters can access each other's
+        // data for copying weights and biases.
+        template<typename, bool>
+        friend class Network;
+
+        // two arrays of dcost_dz values used in backpropagation. this is only
+        // allocated when store_gradients is true.
+        arena::Vector<T> dcost_dz_scratch;
+
+        // indices of the nonzero input values in the last forward pass, and
+        // whether the first layer only used those.
+        arena::Vector<uint32_t> nonzero_inputs;
+        size_t n_nonzero_inputs = 0;
+        bool last_pass_sparse = false;
+
+    };
+
+    // lets one thread (like a training thread) publish immutable copies
+    // (snapshots) of a network's weights and biases while other threads (like
+    // the UI thread) use the latest snapshot without ever blocking each other.
+    // readers hold on to a snapshot through a shared_ptr, so an old snapshot
+    // is only freed once the last reader is done with it. the publisher keeps
+    // the previously published snapshot around and overwrites it in the next
+    // publish() if no reader is still using it (double buffering), so
+    // publishing usually doesn't allocate.
+    // * publish() and reset() must only be called from one thread at a time.
+    // * snapshots are read-only, so readers should copy the parameters into
+    //   their own network (see Network::copy_parameters_from()) to evaluate
+    //   them.
+    template<typename T>
+    class SnapshotChannel
+    {
+    public:
+        using Snapshot = Network<T, false>;
+
+        // copy the weights and biases of net into a new snapshot and make it
+        // the latest snapshot.
+        template<bool store_gradients>
+        void publish(const Network<T, store_gradients>& net)
+        {
+            if (!spare
+                || spare.use_count() > 1
+                || spare->layer_sizes() != net.layer_sizes())
+            {
+                spare = std::make_shared<Snapshot>(
+                    net.layer_sizes(),
+                    net.activation_fns(),
+                    net.activation_derivs()
+                );
+            }
+            else
+            {
+                // use_count() doesn't synchronize with the readers that just
+                // let go of the spare snapshot, so make sure their reads happen
+                // before we overwrite it.
+                std::atomic_thread_fence(std::memory_order_acquire);
+            }
+            spare->copy_parameters_from(net);
+
+            // swap the latest snapshot with the spare one. the old snapshot
+            // becomes the new spare.
+            spare = std::const_pointer_cast<Snapshot>(
+                latest_snapshot.exchange(std::move(spare))
+            );
+            _version.fetch_add(1u, std::memory_order_release);
+        }
+
+        // latest published snapshot, or nullptr if nothing was published since
+        // creation or the last reset().
+        std::shared_ptr<const Snapshot> latest() const
+        {
+            return latest_snapshot.load();
+        }
+
+        // number of snapshots published so far. readers can use this to see
+        // if there's a newer snapshot without touching the snapshot itself.
+        uint64_t version() const
+        {
+            return _version.load(std::memory_order_acquire);
+        }
+
+        // forget all snapshots (readers may still hold on to theirs)
+        void reset()
+        {
+            latest_snapshot.store(nullptr);
+            spare = nullptr;
+            _version.fetch_add(1u, std::memory_order_release);
+        }
+
+    private:
+        std::atomic<std::shared_ptr<const Snapshot>> latest_snapshot;
+        std::shared_ptr<Snapshot> spare;
+        std::atomic_uint64_t _version = 0;
 
     };
 
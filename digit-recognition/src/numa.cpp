@@ -0,0 +1,198 @@
+#include "numa.hpp"
+
+#include <fstream>
+#include <filesystem>
+#include <string>
+#include <algorithm>
+#include <thread>
+#include <cctype>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+namespace numa
+{
+
+    // every CPU in a single node, used when the real topology is unknown
+    static std::vector<Node> single_node()
+    {
+        Node node;
+        const uint32_t n_cpus =
+            std::max(std::thread::hardware_concurrency(), 1u);
+        for (uint32_t i = 0; i < n_cpus; i++)
+        {
+            node.cpus.push_back(i);
+        }
+        return { node };
+    }
+
+#ifdef __linux__
+
+    // parse a CPU list like "0-3,8-11" from sysfs
+    static std::vector<uint32_t> parse_cpu_list(const std::string& s)
+    {
+        std::vector<uint32_t> cpus;
+
+        size_t pos = 0;
+        while (pos < s.size())
+        {
+            size_t end = s.find(',', pos);
+            if (end == std::string::npos)
+                end = s.size();
+
+            const std::string range = s.substr(pos, end - pos);
+            const size_t dash = range.find('-');
+            try
+            {
+                const uint32_t first = (uint32_t)std::stoul(range);
+                const uint32_t last = dash == std::string::npos
+                    ? first
+                    : (uint32_t)std::stoul(range.substr(dash + 1u));
+                for (uint32_t cpu = first; cpu <= last; cpu++)
+                {
+                    cpus.push_back(cpu);
+                }
+            }
+            catch (const std::exception&)
+            {
+                // skip anything we don't understand (like a trailing newline)
+            }
+
+            pos = end + 1u;
+        }
+
+        return cpus;
+    }
+
+    std::vector<Node> topology()
+    {
+        std::vector<Node> nodes;
+
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(
+            "/sys/devices/system/node",
+            ec
+        ))
+        {
+            const std::string name = entry.path().filename().string();
+            if (!name.starts_with("node")
+                || name.size() < 5u
+                || !std::isdigit((unsigned char)name[4]))
+            {
+                continue;
+            }
+
+            std::ifstream ifs(entry.path() / "cpulist");
+            std::string cpu_list;
+            if (!ifs || !std::getline(ifs, cpu_list))
+            {
+                continue;
+            }
+
+            Node node;
+            node.id = std::stoi(name.substr(4));
+            node.cpus = parse_cpu_list(cpu_list);
+            if (!node.cpus.empty())
+            {
+                nodes.push_back(std::move(node));
+            }
+        }
+
+        if (nodes.empty())
+        {
+            return single_node();
+        }
+
+        std::sort(
+            nodes.begin(),
+            nodes.end(),
+            [](const Node& a, const Node& b) { return a.id < b.id; }
+        );
+        return nodes;
+    }
+
+    bool pin_current_thread(uint32_t cpu)
+    {
+        if (cpu >= CPU_SETSIZE)
+        {
+            return false;
+        }
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return sched_setaffinity(0, sizeof(set), &set) == 0;
+    }
+
+#elif defined(_WIN32)
+
+    std::vector<Node> topology()
+    {
+        std::vector<Node> nodes;
+
+        ULONG highest_node = 0;
+        if (GetNumaHighestNodeNumber(&highest_node))
+        {
+            for (ULONG i = 0; i <= highest_node; i++)
+            {
+                GROUP_AFFINITY affinity{};
+                if (!GetNumaNodeProcessorMaskEx((USHORT)i, &affinity))
+                {
+                    continue;
+                }
+
+                Node node;
+                node.id = (int)i;
+                for (uint32_t bit = 0; bit < 64u; bit++)
+                {
+                    if (affinity.Mask & ((KAFFINITY)1 << bit))
+                    {
+                        node.cpus.push_back(affinity.Group * 64u + bit);
+                    }
+                }
+
+                if (!node.cpus.empty())
+                {
+                    nodes.push_back(std::move(node));
+                }
+            }
+        }
+
+        if (nodes.empty())
+        {
+            return single_node();
+        }
+        return nodes;
+    }
+
+    bool pin_current_thread(uint32_t cpu)
+    {
+        GROUP_AFFINITY affinity{};
+        affinity.Group = (WORD)(cpu / 64u);
+        affinity.Mask = (KAFFINITY)1 << (cpu % 64u);
+        return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr)
+            != 0;
+    }
+
+#else
+
+    std::vector<Node> topology()
+    {
+        return single_node();
+    }
+
+    bool pin_current_thread(uint32_t cpu)
+    {
+        return false;
+    }
+
+#endif
+
+}
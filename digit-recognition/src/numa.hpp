@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// NUMA topology of the machine and pinning threads to CPUs. memory isn't
+// placed explicitly here, threads that are pinned to a node get node-local
+// memory by touching it first (or see arena::Options::numa_node).
+// on machines without NUMA (or if the topology can't be read), everything is
+// reported as a single node containing all CPUs.
+namespace numa
+{
+
+    struct Node
+    {
+        // OS node number
+        int id = 0;
+
+        // logical CPUs in this node. on Windows, these are numbered
+        // (processor group * 64 + processor number).
+        std::vector<uint32_t> cpus;
+    };
+
+    // NUMA nodes that have at least one CPU, sorted by their id
+    std::vector<Node> topology();
+
+    // restrict the current thread to run on a single CPU. returns false if
+    // that's not possible (the thread keeps running wherever it was before).
+    bool pin_current_thread(uint32_t cpu);
+
+    // CPU for a worker, spreading consecutive workers over the nodes (worker
+    // 0 on the first node, worker 1 on the second, and so on) and then over
+    // the CPUs of each node.
+    inline uint32_t worker_cpu(
+        const std::vector<Node>& nodes,
+        size_t worker_idx,
+        size_t& out_node_idx
+    )
+    {
+        out_node_idx = worker_idx % nodes.size();
+        const auto& cpus = nodes[out_node_idx].cpus;
+        return cpus[(worker_idx / nodes.size()) % cpus.size()];
+    }
+
+}
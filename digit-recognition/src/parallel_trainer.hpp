@@ -0,0 +1,410 @@
+#pragma once
+
+#include <vector>
+#include <span>
+#include <memory>
+#include <functional>
+#include <utility>
+#include <stdexcept>
+#include <cstdint>
+
+#include "neural.hpp"
+#include "task_pool.hpp"
+#include "arena.hpp"
+#include "profiler.hpp"
+#include "trace.hpp"
+
+namespace neural
+{
+
+    // data parallel training on the workers of a tasks::Pool, which are
+    // pinned to CPUs spread over the NUMA nodes. every worker has its own
+    // replica of the network allocated on its own node, computes the gradients
+    // for its share of each batch, and then the gradients are added up
+    // hierarchically: first within each node, then across the nodes (only one
+    // replica per node is read from other nodes). finally, every worker
+    // applies the same total gradients to its replica, so all replicas always
+    // hold the same weights and biases.
+    // * every step of the training is a set of tasks bound to the workers, so
+    //   other work on the pool can run in between the steps.
+    // * train() must only be called from one thread at a time, and not from
+    //   one of the pool's workers.
+    template<typename T>
+    class ParallelTrainer
+    {
+    public:
+        // fills a worker's share of a batch. this is called on the worker
+        // thread with the index of its NUMA node. the input pointers of the
+        // samples already point to consecutive parts of inputs, which is owned
+        // by the worker, so only inputs and the labels need to be written.
+        using LoadFn = std::function<void(
+            size_t worker_idx,
+            size_t node_idx,
+            std::span<T> inputs,
+            std::span<LabeledInput<T>> samples
+        )>;
+
+        // called once on a worker of every NUMA node before training starts,
+        // for example to make a node-local copy of the dataset.
+        using NodeInitFn = std::function<void(size_t node_idx)>;
+
+        // train copies of net on every worker of pool with batches of
+        // batch_size examples. this blocks until all replicas are ready.
+        ParallelTrainer(
+            const Network<T, true>& net,
+            size_t batch_size,
+            tasks::Pool& pool,
+            const NodeInitFn& init_node,
+            const LoadFn& load_samples
+        )
+            : pool(pool),
+            batch_size(batch_size),
+            load_samples(load_samples)
+        {
+            if (batch_size < 1u)
+            {
+                throw std::invalid_argument(
+                    "batch size should be at least 1"
+                );
+            }
+
+            const size_t n_workers = pool.n_workers();
+            node_workers.resize(pool.n_nodes());
+
+            workers.resize(n_workers);
+            for (size_t w = 0; w < n_workers; w++)
+            {
+                auto& worker = workers[w];
+                worker = std::make_unique<Worker>();
+                worker->node_idx = pool.worker_node(w);
+                worker->rank_in_node = node_workers[worker->node_idx].size();
+                worker->n_samples = batch_size * (w + 1u) / n_workers
+                    - batch_size * w / n_workers;
+
+                node_workers[worker->node_idx].push_back(w);
+            }
+
+            auto init = [&](size_t w)
+                {
+                    init_worker(w, net, init_node);
+                };
+
+            tasks::TaskGroup group(pool);
+            group.run_on_workers(init);
+            group.wait();
+        }
+
+        ParallelTrainer(const ParallelTrainer&) = delete;
+        ParallelTrainer& operator=(const ParallelTrainer&) = delete;
+
+        size_t n_workers() const
+        {
+            return workers.size();
+        }
+
+        size_t n_nodes() const
+        {
+            return node_workers.size();
+        }
+
+        // do one training step on a batch, loading the samples with
+        // load_samples() on the workers. the returned cost and accuracy are
+        // based on the weights and biases before the gradient descent step.
+        BatchStats<T> train(T learning_rate)
+        {
+            auto compute = [this](size_t w)
+                {
+                    compute_gradients(w);
+                };
+            auto add_node = [this](size_t w)
+                {
+                    add_node_gradients(w);
+                };
+            auto add_leaders = [this](size_t w)
+                {
+                    add_leader_gradients(w);
+                };
+            auto copy_leaders = [this](size_t w)
+                {
+                    copy_to_leaders(w);
+                };
+            auto finish = [this, learning_rate](size_t w)
+                {
+                    finish_step(w, learning_rate);
+                };
+
+            // every phase needs the results of the previous phase from the
+            // other workers
+            tasks::TaskGroup group(pool);
+            group.run_on_workers(compute);
+            group.wait();
+
+            group.run_on_workers(add_node);
+            group.wait();
+
+            if (n_nodes() > 1u)
+            {
+                group.run_on_workers(add_leaders);
+                group.wait();
+
+                group.run_on_workers(copy_leaders);
+                group.wait();
+            }
+
+            group.run_on_workers(finish);
+            group.wait();
+
+            BatchStats<T> stats;
+            for (const auto& worker : workers)
+            {
+                stats.add(worker->stats);
+            }
+            return stats;
+        }
+
+        // copy the weights and biases into net (which must have the same
+        // layer sizes). this must not be called while train() is running.
+        void copy_parameters_to(Network<T, true>& net) const
+        {
+            net.copy_parameters_from(*workers[0]->net);
+        }
+
+    private:
+        struct Worker
+        {
+            size_t node_idx = 0;
+
+            // index of this worker in node_workers[node_idx]
+            size_t rank_in_node = 0;
+
+            // number of samples in every batch that this worker trains on
+            size_t n_samples = 0;
+
+            // these are allocated by the worker itself, so that they're placed
+            // on its NUMA node.
+            std::unique_ptr<arena::Arena> arena;
+            std::unique_ptr<Network<T, true>> net;
+            std::unique_ptr<arena::Vector<T>> inputs;
+            std::unique_ptr<std::vector<LabeledInput<T>>> samples;
+
+            BatchStats<T> stats;
+        };
+
+        tasks::Pool& pool;
+        size_t batch_size;
+        LoadFn load_samples;
+
+        std::vector<std::unique_ptr<Worker>> workers;
+
+        // indices of the workers on each node. the first one is the node's
+        // leader, which holds the sum of the node's gradients while reducing.
+        std::vector<std::vector<size_t>> node_workers;
+
+        void init_worker(
+            size_t worker_idx,
+            const Network<T, true>& net,
+            const NodeInitFn& init_node
+        )
+        {
+            Worker& worker = *workers[worker_idx];
+
+            if (worker.rank_in_node == 0u && init_node)
+            {
+                init_node(worker.node_idx);
+            }
+
+            // first touch all of the worker's memory on this thread
+            worker.arena = std::make_unique<arena::Arena>(
+                arena::Options{ .huge_pages = true }
+            );
+            worker.net = std::make_unique<Network<T, true>>(
+                net.layer_sizes(),
+                net.activation_fns(),
+                net.activation_derivs(),
+                worker.arena.get()
+            );
+            worker.net->copy_parameters_from(net);
+
+            const size_t input_size = net.layer_sizes()[0];
+            worker.inputs = std::make_unique<arena::Vector<T>>(
+                worker.n_samples * input_size,
+                (T)0,
+                arena::Allocator<T>(worker.arena.get())
+            );
+            worker.samples = std::make_unique<std::vector<LabeledInput<T>>>(
+                worker.n_samples
+            );
+            for (size_t i = 0; i < worker.n_samples; i++)
+            {
+                (*worker.samples)[i].input =
+                    worker.inputs->data() + i * input_size;
+            }
+        }
+
+        // gradients for a worker's share of the batch
+        void compute_gradients(size_t worker_idx)
+        {
+            TRACE_SCOPE("Worker Batch");
+
+            Worker& worker = *workers[worker_idx];
+            std::span<LabeledInput<T>> samples(*worker.samples);
+            if (samples.empty())
+            {
+                worker.net->zero_gradients();
+                worker.stats = {};
+                return;
+            }
+
+            load_samples(
+                worker_idx,
+                worker.node_idx,
+                std::span<T>(*worker.inputs),
+                samples
+            );
+            worker.stats = worker.net->accumulated_backward_pass(samples);
+        }
+
+        // range of gradients in [0, n) handled by part out of n_parts
+        static std::pair<size_t, size_t> split(
+            size_t n,
+            size_t part,
+            size_t n_parts
+        )
+        {
+            return { n * part / n_parts, n * (part + 1u) / n_parts };
+        }
+
+        // the steps of adding up the gradients of all replicas and copying
+        // the sum back into every replica. every step is split between the
+        // workers that take part in it, and the gradients are interleaved
+        // with the parameters (every odd element of Network::parameters()).
+
+        // 1. add the gradients of every node's workers into the node's
+        // leader. this only touches node-local memory.
+        void add_node_gradients(size_t worker_idx)
+        {
+            PROFILE_SCOPE(GradientReduction);
+            TRACE_SCOPE("Reduce Gradients");
+
+            Worker& worker = *workers[worker_idx];
+            const auto& members = node_workers[worker.node_idx];
+            if (members.size() < 2u)
+            {
+                return;
+            }
+
+            Network<T, true>& leader = *workers[members[0]]->net;
+            for (size_t l = 1u; l < leader.n_layers(); l++)
+            {
+                auto dst = leader.parameters(l);
+                const auto [begin, end] = split(
+                    dst.size() / 2u,
+                    worker.rank_in_node,
+                    members.size()
+                );
+
+                for (size_t m = 1u; m < members.size(); m++)
+                {
+                    auto src = workers[members[m]]->net->parameters(l);
+                    for (size_t i = begin; i < end; i++)
+                    {
+                        dst[2u * i + 1u] += src[2u * i + 1u];
+                    }
+                }
+            }
+        }
+
+        // 2. add the node leaders' gradients into the first worker
+        void add_leader_gradients(size_t worker_idx)
+        {
+            PROFILE_SCOPE(GradientReduction);
+            TRACE_SCOPE("Reduce Gradients");
+
+            Network<T, true>& global_leader = *workers[0]->net;
+            for (size_t l = 1u; l < global_leader.n_layers(); l++)
+            {
+                auto dst = global_leader.parameters(l);
+                const auto [begin, end] = split(
+                    dst.size() / 2u,
+                    worker_idx,
+                    workers.size()
+                );
+
+                for (size_t n = 1u; n < n_nodes(); n++)
+                {
+                    auto src = workers[node_workers[n][0]]->net->parameters(l);
+                    for (size_t i = begin; i < end; i++)
+                    {
+                        dst[2u * i + 1u] += src[2u * i + 1u];
+                    }
+                }
+            }
+        }
+
+        // 3. copy the sum back to the other node leaders
+        void copy_to_leaders(size_t worker_idx)
+        {
+            PROFILE_SCOPE(GradientReduction);
+            TRACE_SCOPE("Reduce Gradients");
+
+            Worker& worker = *workers[worker_idx];
+            if (worker.node_idx == 0u)
+            {
+                return;
+            }
+
+            const auto& members = node_workers[worker.node_idx];
+            Network<T, true>& leader = *workers[members[0]]->net;
+            Network<T, true>& global_leader = *workers[0]->net;
+            for (size_t l = 1u; l < leader.n_layers(); l++)
+            {
+                auto dst = leader.parameters(l);
+                auto src = global_leader.parameters(l);
+                const auto [begin, end] = split(
+                    dst.size() / 2u,
+                    worker.rank_in_node,
+                    members.size()
+                );
+
+                for (size_t i = begin; i < end; i++)
+                {
+                    dst[2u * i + 1u] = src[2u * i + 1u];
+                }
+            }
+        }
+
+        // 4. copy the sum from the node's leader into the worker's replica
+        // and take the gradient descent step
+        void finish_step(size_t worker_idx, T learning_rate)
+        {
+            Worker& worker = *workers[worker_idx];
+            if (worker.rank_in_node != 0u)
+            {
+                PROFILE_SCOPE(GradientReduction);
+                TRACE_SCOPE("Reduce Gradients");
+
+                const auto& members = node_workers[worker.node_idx];
+                Network<T, true>& leader = *workers[members[0]]->net;
+                for (size_t l = 1u; l < leader.n_layers(); l++)
+                {
+                    auto dst = worker.net->parameters(l);
+                    auto src = leader.parameters(l);
+                    for (size_t i = 1u; i < dst.size(); i += 2u)
+                    {
+                        dst[i] = src[i];
+                    }
+                }
+            }
+
+            worker.net->gradient_descent_step(batch_size, learning_rate);
+
+            // make this worker's timings visible to other threads
+            if constexpr (profiler::ENABLED)
+            {
+                profiler::flush();
+            }
+        }
+
+    };
+
+}
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <array>
+#include <utility>
+#include <cstdint>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// hardware performance counters for the current thread, read with Linux's
+// perf_event_open(). on other platforms (or if the kernel doesn't allow it,
+// see /proc/sys/kernel/perf_event_paranoid) no counters are available and
+// everything here does nothing.
+namespace perf
+{
+
+    enum class Counter : int
+    {
+        Cycles,
+        Instructions,
+        L1dMisses,
+        LlcMisses,
+        BranchMisses,
+        _Count
+    };
+    static constexpr size_t N_COUNTERS = (size_t)Counter::_Count;
+
+    static constexpr const char* Counter_str[] = {
+        "Cycles",
+        "Instructions",
+        "L1D Misses",
+        "LLC Misses",
+        "Branch Misses"
+    };
+
+    struct Readings
+    {
+        std::array<uint64_t, N_COUNTERS> values{};
+
+        // whether each counter could be opened. values for unavailable
+        // counters are always 0.
+        std::array<bool, N_COUNTERS> available{};
+
+        uint64_t operator[](Counter c) const
+        {
+            return values[(size_t)c];
+        }
+
+        bool has(Counter c) const
+        {
+            return available[(size_t)c];
+        }
+    };
+
+    // a set of counters measuring user space code on the thread that created
+    // it. counters are opened individually rather than as a group, so one
+    // unsupported event doesn't disable the others. if the kernel has to
+    // multiplex them, the values are scaled to estimate the full duration.
+    class Counters
+    {
+    public:
+        Counters()
+        {
+            fds.fill(-1);
+
+#ifdef __linux__
+            static constexpr std::array<
+                std::pair<uint32_t, uint64_t>,
+                N_COUNTERS
+            > EVENTS = { {
+                { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+                { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+                {
+                    PERF_TYPE_HW_CACHE,
+                    PERF_COUNT_HW_CACHE_L1D
+                    | (PERF_COUNT_HW_CACHE_OP_READ << 8u)
+                    | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16u)
+                },
+                { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+                { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES }
+            } };
+
+            for (size_t i = 0; i < N_COUNTERS; i++)
+            {
+                perf_event_attr attr{};
+                attr.size = sizeof(attr);
+                attr.type = EVENTS[i].first;
+                attr.config = EVENTS[i].second;
+                attr.disabled = 1;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+                    | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+                fds[i] = (int)syscall(
+                    SYS_perf_event_open,
+                    &attr,
+                    0,  // this thread
+                    -1, // any CPU
+                    -1, // no group
+                    0
+                );
+            }
+#endif
+        }
+
+        ~Counters()
+        {
+#ifdef __linux__
+            for (int fd : fds)
+            {
+                if (fd >= 0)
+                {
+                    close(fd);
+                }
+            }
+#endif
+        }
+
+        Counters(const Counters&) = delete;
+        Counters& operator=(const Counters&) = delete;
+
+        // whether at least one counter is available
+        bool any_available() const
+        {
+            for (int fd : fds)
+            {
+                if (fd >= 0)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // reset and start all counters
+        void start()
+        {
+#ifdef __linux__
+            for (int fd : fds)
+            {
+                if (fd >= 0)
+                {
+                    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+                }
+            }
+#endif
+        }
+
+        // stop all counters and read them
+        Readings stop()
+        {
+            Readings readings;
+#ifdef __linux__
+            for (int fd : fds)
+            {
+                if (fd >= 0)
+                {
+                    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+                }
+            }
+
+            for (size_t i = 0; i < N_COUNTERS; i++)
+            {
+                if (fds[i] < 0)
+                {
+                    continue;
+                }
+
+                // value, time enabled, time running
+                uint64_t data[3]{};
+                if (read(fds[i], data, sizeof(data)) != sizeof(data))
+                {
+                    continue;
+                }
+
+                readings.available[i] = true;
+                if (data[2] > 0 && data[2] < data[1])
+                {
+                    readings.values[i] = (uint64_t)(
+                        (double)data[0] * (double)data[1] / (double)data[2]
+                    );
+                }
+                else
+                {
+                    readings.values[i] = data[0];
+                }
+            }
+#endif
+            return readings;
+        }
+
+    private:
+        // file descriptors for every counter, -1 if unavailable
+        std::array<int, N_COUNTERS> fds;
+
+    };
+
+}
@@ -0,0 +1,827 @@
+#pragma once
+
+#include <vector>
+#include <span>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+
+#include "neural.hpp"
+#include "arena.hpp"
+#include "profiler.hpp"
+
+namespace neural
+{
+
+    // trains a population of n_models networks with the same layer sizes and
+    // activation functions on the same batches at the same time, for example
+    // to compare seeds or learning rates, or to train an ensemble. the weights
+    // of all the models are stored side by side, so every layer of every
+    // model is evaluated with one loop over the batch, and every batch only
+    // has to be loaded (and augmented) once instead of once per model.
+    // * the weights of a layer are stored as one matrix with a row per node
+    //   of every model (the nodes of the first model come first), except for
+    //   the first layer, where every model's weights are transposed (see
+    //   first_layer_weights_offset()). the deeper layers are a plain loop over
+    //   the rows and the samples. in the first layer, every nonzero input of a
+    //   sample adds a contiguous row of weights to all of a model's weighted
+    //   sums at once (like StaticNetwork), so the sums and the weight
+    //   gradients are updated a whole layer at a time instead of one node at
+    //   a time, and the inputs' zeros are skipped for every model.
+    // * the weighted sums and the gradients are added up in the same order as
+    //   in Network, so every model trains exactly like a separate Network<T,
+    //   true> with the same parameters would on the same batches.
+    // * the models are loaded from and stored back into regular networks (see
+    //   copy_parameters_from() and copy_parameters_to()), which is also how
+    //   they're initialized and evaluated.
+    template<typename T>
+    class PopulationNetwork
+    {
+    public:
+        // see Network::Network(). max_batch_size is the maximum number of
+        // samples in a batch passed to forward_pass() or train(). if
+        // inference_only is true, the gradients and the other buffers that
+        // are only needed for training aren't allocated and train() can't be
+        // used. all the memory is taken from arena if it's not nullptr (the
+        // arena must outlive the population), or from the heap otherwise.
+        PopulationNetwork(
+            const std::vector<size_t>& layer_sizes,
+            const std::vector<std::function<T(T)>>& activation_fns,
+            const std::vector<std::function<T(T)>>& activation_derivs,
+            size_t n_models,
+            size_t max_batch_size,
+            bool inference_only = false,
+            arena::Arena* arena = nullptr
+        )
+            : _n_layers(layer_sizes.size()),
+            _layer_sizes(layer_sizes),
+            _activation_fns(activation_fns),
+            _activation_derivs(activation_derivs),
+            _n_models(n_models),
+            _max_batch_size(max_batch_size),
+            _inference_only(inference_only),
+            params(arena::Allocator<T>(arena)),
+            grads(arena::Allocator<T>(arena)),
+            values(arena::Allocator<T>(arena)),
+            pre_activ(arena::Allocator<T>(arena)),
+            dcost_dz_scratch(arena::Allocator<T>(arena)),
+            nonzero_inputs(arena::Allocator<uint32_t>(arena))
+        {
+            if (_n_layers < 2u)
+            {
+                throw std::invalid_argument(
+                    "there should be at least 2 layers to represent an input "
+                    "and an output layer."
+                );
+            }
+
+            for (const size_t layer_size : _layer_sizes)
+            {
+                if (layer_size < 1u)
+                {
+                    throw std::invalid_argument(
+                        "a layer must contain at least 1 node"
+                    );
+                }
+            }
+
+            if (_activation_fns.size() != _n_layers - 1u
+                || _activation_derivs.size() != _n_layers - 1u)
+            {
+                throw std::invalid_argument(
+                    "the number of activation functions and their derivatives "
+                    "must be one less than the number of layers."
+                );
+            }
+
+            if (_n_models < 1u || _max_batch_size < 1u)
+            {
+                throw std::invalid_argument(
+                    "there should be at least 1 model and 1 sample per batch"
+                );
+            }
+
+            // every layer's weights (n_models * n_nodes rows of n_prev_nodes
+            // weights) are followed by its biases (n_models * n_nodes), and
+            // the gradients use the exact same layout in grads.
+            // the values and pre-activation values of every layer are stored
+            // per sample, and then per model. the input layer only has one set
+            // of values per sample.
+            _param_offsets.resize(_n_layers, 0u);
+            _value_offsets.resize(_n_layers, 0u);
+
+            size_t n_params = 0;
+            size_t n_values = _max_batch_size * _layer_sizes[0];
+            size_t max_layer_size = 1u;
+            for (size_t l = 1u; l < _n_layers; l++)
+            {
+                const size_t n_rows = _n_models * _layer_sizes[l];
+
+                n_params = arena::align_up(n_params, LAYER_ALIGNMENT);
+                _param_offsets[l] = n_params;
+                n_params += n_rows * _layer_sizes[l - 1u] + n_rows;
+
+                n_values = arena::align_up(n_values, LAYER_ALIGNMENT);
+                _value_offsets[l] = n_values;
+                n_values += _max_batch_size * n_rows;
+
+                max_layer_size = std::max(max_layer_size, _layer_sizes[l]);
+            }
+
+            params.resize(n_params, (T)0);
+            values.resize(n_values, (T)0);
+
+            if (!_inference_only)
+            {
+                grads.resize(n_params, (T)0);
+                pre_activ.resize(n_values, (T)0);
+
+                // two arrays of dcost_dz values for every sample and model
+                // (see backpropagate())
+                dcost_dz_stride = _max_batch_size * _n_models * max_layer_size;
+                dcost_dz_scratch.resize(dcost_dz_stride * 2u, (T)0);
+            }
+
+            // indices of the nonzero input values of every sample
+            nonzero_inputs.resize(_max_batch_size * _layer_sizes[0]);
+            n_nonzero_inputs.resize(_max_batch_size, 0u);
+            sparse_inputs.resize(_max_batch_size, false);
+        }
+
+        constexpr size_t n_layers() const
+        {
+            return _n_layers;
+        }
+
+        constexpr const std::vector<size_t>& layer_sizes() const
+        {
+            return _layer_sizes;
+        }
+
+        constexpr size_t input_size() const
+        {
+            return _layer_sizes[0];
+        }
+
+        constexpr size_t output_size() const
+        {
+            return _layer_sizes[_n_layers - 1u];
+        }
+
+        constexpr size_t n_models() const
+        {
+            return _n_models;
+        }
+
+        constexpr size_t max_batch_size() const
+        {
+            return _max_batch_size;
+        }
+
+        constexpr bool inference_only() const
+        {
+            return _inference_only;
+        }
+
+        // output values of a model for a sample of the last batch passed to
+        // forward_pass() or train()
+        std::span<T> output_values(
+            size_t sample_idx,
+            size_t model_idx
+        )
+        {
+            return std::span<T>(
+                value_ptr(_n_layers - 1u, sample_idx, model_idx),
+                output_size()
+            );
+        }
+
+        // copy the weights and biases of a network with the same layer sizes
+        // into a model
+        template<bool store_gradients>
+        void copy_parameters_from(
+            size_t model_idx,
+            Network<T, store_gradients>& net
+        )
+        {
+            check_model(model_idx, net.layer_sizes());
+
+            constexpr size_t stride = store_gradients ? 2u : 1u;
+            for (size_t l = 1u; l < _n_layers; l++)
+            {
+                const size_t n_nodes = _layer_sizes[l];
+                const size_t n_prev_nodes = _layer_sizes[l - 1u];
+                const size_t row = model_idx * n_nodes;
+
+                auto b = net.biases(l);
+                T* dst_b = params.data() + biases_offset(l) + row;
+                for (size_t n = 0u; n < n_nodes; n++)
+                {
+                    dst_b[n] = b[n * stride];
+                }
+
+                for (size_t n = 0u; n < n_nodes; n++)
+                {
+                    auto w = net.weights(l, n);
+                    for (size_t i = 0u; i < n_prev_nodes; i++)
+                    {
+                        params[weight_idx(l, model_idx, n, i)] = w[i * stride];
+                    }
+                }
+            }
+        }
+
+        // copy the weights and biases of a model into a network with the same
+        // layer sizes. gradients and values won't be copied.
+        template<bool store_gradients>
+        void copy_parameters_to(
+            size_t model_idx,
+            Network<T, store_gradients>& net
+        ) const
+        {
+            check_model(model_idx, net.layer_sizes());
+
+            constexpr size_t stride = store_gradients ? 2u : 1u;
+            for (size_t l = 1u; l < _n_layers; l++)
+            {
+                const size_t n_nodes = _layer_sizes[l];
+                const size_t n_prev_nodes = _layer_sizes[l - 1u];
+                const size_t row = model_idx * n_nodes;
+
+                auto b = net.biases(l);
+                const T* src_b = params.data() + biases_offset(l) + row;
+                for (size_t n = 0u; n < n_nodes; n++)
+                {
+                    b[n * stride] = src_b[n];
+                }
+
+                for (size_t n = 0u; n < n_nodes; n++)
+                {
+                    auto w = net.weights(l, n);
+                    for (size_t i = 0u; i < n_prev_nodes; i++)
+                    {
+                        w[i * stride] = params[weight_idx(l, model_idx, n, i)];
+                    }
+                }
+            }
+        }
+
+        // evaluate every model on a batch of at most max_batch_size samples
+        // (the labels aren't used). see output_values().
+        void forward_pass(std::span<const LabeledInput<T>> samples)
+        {
+            load_inputs(samples);
+            forward_layers(samples.size());
+        }
+
+        // do one training step for every model on the same batch of at most
+        // max_batch_size samples. learning_rates has one learning rate per
+        // model, and the cost and accuracy of every model (based on the
+        // weights and biases before the step) are written to out_stats.
+        void train(
+            std::span<const LabeledInput<T>> samples,
+            std::span<const T> learning_rates,
+            std::span<BatchStats<T>> out_stats
+        )
+        {
+            if (_inference_only)
+            {
+                throw std::logic_error(
+                    "an inference only population can't be trained"
+                );
+            }
+
+            if (learning_rates.size() != _n_models
+                || out_stats.size() != _n_models)
+            {
+                throw std::invalid_argument(
+                    "there should be one learning rate and one BatchStats per "
+                    "model"
+                );
+            }
+
+            for (const auto& sample : samples)
+            {
+                if (sample.label >= output_size())
+                {
+                    throw std::invalid_argument("invalid expected label");
+                }
+            }
+
+            forward_pass(samples);
+            output_dcost_dz(samples, out_stats);
+            backpropagate(samples.size());
+            gradient_descent_step(samples.size(), learning_rates);
+        }
+
+    private:
+        size_t _n_layers;
+        std::vector<size_t> _layer_sizes;
+        std::vector<std::function<T(T)>> _activation_fns;
+        std::vector<std::function<T(T)>> _activation_derivs;
+        size_t _n_models;
+        size_t _max_batch_size;
+        bool _inference_only;
+
+        // number of elements of type T in a cache line
+        static constexpr size_t LAYER_ALIGNMENT =
+            std::max(arena::ALIGNMENT / sizeof(T), (size_t)1u);
+
+        // index of the first weight of each layer in params (and grads), and
+        // of the first value of each layer in values (and pre_activ)
+        std::vector<size_t> _param_offsets;
+        std::vector<size_t> _value_offsets;
+
+        // grads and pre_activ are empty if _inference_only is true
+        arena::Vector<T> params;
+        arena::Vector<T> grads;
+        arena::Vector<T> values;
+        arena::Vector<T> pre_activ;
+
+        // two arrays of dcost_dz_stride dcost_dz values (empty if
+        // _inference_only is true)
+        arena::Vector<T> dcost_dz_scratch;
+        size_t dcost_dz_stride = 0;
+
+        // indices of the nonzero input values of every sample in the last
+        // batch, and whether the first layer only used those for the sample.
+        arena::Vector<uint32_t> nonzero_inputs;
+        std::vector<size_t> n_nonzero_inputs;
+        std::vector<bool> sparse_inputs;
+
+        void check_model(
+            size_t model_idx,
+            const std::vector<size_t>& layer_sizes
+        ) const
+        {
+            if (model_idx >= _n_models)
+            {
+                throw std::invalid_argument("invalid model index");
+            }
+
+            if (layer_sizes != _layer_sizes)
+            {
+                throw std::invalid_argument("layer sizes don't match");
+            }
+        }
+
+        // index of the first weight of a row (node of a model) in a layer in
+        // params and grads. the first layer doesn't have rows, but a model's
+        // weights still start at the offset of its first row.
+        size_t weights_offset(size_t layer_idx, size_t row) const
+        {
+            return _param_offsets[layer_idx]
+                + row * _layer_sizes[layer_idx - 1u];
+        }
+
+        // index of the first weight of a model in the first layer, in params
+        // and grads. the weights connecting an input to every node of the
+        // model are contiguous.
+        size_t first_layer_weights_offset(size_t model_idx) const
+        {
+            return _param_offsets[1]
+                + model_idx * _layer_sizes[1] * _layer_sizes[0];
+        }
+
+        // index of the weight connecting node i in the previous layer to node
+        // n of a model in a layer, in params and grads
+        size_t weight_idx(
+            size_t layer_idx,
+            size_t model_idx,
+            size_t n,
+            size_t i
+        ) const
+        {
+            if (layer_idx == 1u)
+            {
+                return first_layer_weights_offset(model_idx)
+                    + i * _layer_sizes[1] + n;
+            }
+            const size_t row = model_idx * _layer_sizes[layer_idx] + n;
+            return weights_offset(layer_idx, row) + i;
+        }
+
+        // index of the first bias of a layer in params and grads
+        size_t biases_offset(size_t layer_idx) const
+        {
+            return _param_offsets[layer_idx]
+                + _n_models * _layer_sizes[layer_idx]
+                * _layer_sizes[layer_idx - 1u];
+        }
+
+        // index of the first value of a model in a layer for a sample, in
+        // values and pre_activ. all the models share the input layer.
+        size_t value_idx(
+            size_t layer_idx,
+            size_t sample_idx,
+            size_t model_idx
+        ) const
+        {
+            if (layer_idx == 0u)
+            {
+                return sample_idx * _layer_sizes[0];
+            }
+            return _value_offsets[layer_idx]
+                + (sample_idx * _n_models + model_idx)
+                * _layer_sizes[layer_idx];
+        }
+
+        T* value_ptr(size_t layer_idx, size_t sample_idx, size_t model_idx)
+        {
+            return values.data() + value_idx(layer_idx, sample_idx, model_idx);
+        }
+
+        // copy the inputs of a batch and find their nonzero values (see
+        // Network::find_nonzero_inputs())
+        void load_inputs(std::span<const LabeledInput<T>> samples)
+        {
+            if (samples.size() > _max_batch_size)
+            {
+                throw std::invalid_argument("too many samples in the batch");
+            }
+
+            const size_t n_inputs = input_size();
+            for (size_t s = 0u; s < samples.size(); s++)
+            {
+                T* input = value_ptr(0u, s, 0u);
+                std::copy(
+                    samples[s].input,
+                    samples[s].input + n_inputs,
+                    input
+                );
+
+                uint32_t* nonzero = nonzero_inputs.data() + s * n_inputs;
+                size_t n_nonzero = 0;
+                for (size_t i = 0u; i < n_inputs; i++)
+                {
+                    if (input[i] != (T)0)
+                    {
+                        nonzero[n_nonzero] = (uint32_t)i;
+                        n_nonzero++;
+                    }
+                }
+
+                n_nonzero_inputs[s] = n_nonzero;
+                sparse_inputs[s] = (float)n_nonzero
+                    <= SPARSE_INPUT_MAX_DENSITY * (float)n_inputs;
+            }
+        }
+
+        void forward_layers(size_t n_samples)
+        {
+            PROFILE_SCOPE(ForwardPass);
+
+            forward_first_layer(n_samples);
+
+            for (size_t l = 2u; l < _n_layers; l++)
+            {
+                const size_t n_nodes = _layer_sizes[l];
+                const size_t n_prev_nodes = _layer_sizes[l - 1u];
+                const T* b = params.data() + biases_offset(l);
+                const auto& activ = _activation_fns[l - 1u];
+
+                // one row at a time for the whole batch, so that the row's
+                // weights stay in the cache while the inputs are streamed.
+                for (size_t row = 0u; row < _n_models * n_nodes; row++)
+                {
+                    const size_t m = row / n_nodes;
+                    const size_t n = row % n_nodes;
+                    const T* w = params.data() + weights_offset(l, row);
+
+                    for (size_t s = 0u; s < n_samples; s++)
+                    {
+                        const T* prev_values = value_ptr(l - 1u, s, m);
+
+                        T weighted_sum = (T)0;
+                        for (size_t i = 0u; i < n_prev_nodes; i++)
+                        {
+                            weighted_sum += w[i] * prev_values[i];
+                        }
+                        weighted_sum += b[row];
+
+                        const size_t idx = value_idx(l, s, m) + n;
+                        if (!_inference_only)
+                        {
+                            pre_activ[idx] = weighted_sum;
+                        }
+                        values[idx] = activ(weighted_sum);
+                    }
+                }
+            }
+        }
+
+        // the weighted sums of a model's nodes for a sample are added up in
+        // its values, one input at a time (skipping the zeros if the sample
+        // is sparse), so every sum is still added up in the same order as in
+        // Network.
+        void forward_first_layer(size_t n_samples)
+        {
+            const size_t n_nodes = _layer_sizes[1];
+            const size_t n_inputs = input_size();
+            const T* b = params.data() + biases_offset(1u);
+            const auto& activ = _activation_fns[0];
+
+            // every model's weights are used for the whole batch before
+            // moving on to the next model
+            for (size_t m = 0u; m < _n_models; m++)
+            {
+                const T* w = params.data() + first_layer_weights_offset(m);
+                const T* model_b = b + m * n_nodes;
+
+                for (size_t s = 0u; s < n_samples; s++)
+                {
+                    const T* input = value_ptr(0u, s, 0u);
+                    const size_t idx = value_idx(1u, s, m);
+                    T* sums = values.data() + idx;
+                    std::fill(sums, sums + n_nodes, (T)0);
+
+                    auto add_input = [&](size_t i)
+                        {
+                            const T v = input[i];
+                            const T* w_i = w + i * n_nodes;
+                            for (size_t n = 0u; n < n_nodes; n++)
+                            {
+                                sums[n] += w_i[n] * v;
+                            }
+                        };
+
+                    if (sparse_inputs[s])
+                    {
+                        const uint32_t* nonzero =
+                            nonzero_inputs.data() + s * n_inputs;
+                        for (size_t k = 0u; k < n_nonzero_inputs[s]; k++)
+                        {
+                            add_input(nonzero[k]);
+                        }
+                    }
+                    else
+                    {
+                        for (size_t i = 0u; i < n_inputs; i++)
+                        {
+                            add_input(i);
+                        }
+                    }
+
+                    for (size_t n = 0u; n < n_nodes; n++)
+                    {
+                        const T weighted_sum = sums[n] + model_b[n];
+                        if (!_inference_only)
+                        {
+                            pre_activ[idx + n] = weighted_sum;
+                        }
+                        values[idx + n] = activ(weighted_sum);
+                    }
+                }
+            }
+        }
+
+        // calculate the cost, the predicted label, and the output layer's
+        // dcost_dz for every sample and model (see Network::forward_backward())
+        void output_dcost_dz(
+            std::span<const LabeledInput<T>> samples,
+            std::span<BatchStats<T>> out_stats
+        )
+        {
+            const size_t l = _n_layers - 1u;
+            const size_t n_nodes = output_size();
+            const auto& dact_dz = _activation_derivs[l - 1u];
+
+            for (auto& stats : out_stats)
+            {
+                stats = {};
+                stats.n_samples = samples.size();
+            }
+
+            for (size_t s = 0u; s < samples.size(); s++)
+            {
+                for (size_t m = 0u; m < _n_models; m++)
+                {
+                    const size_t idx = value_idx(l, s, m);
+                    const T* output = values.data() + idx;
+                    T* dcost_dz = dcost_dz_scratch.data()
+                        + (s * _n_models + m) * n_nodes;
+
+                    T cost = (T)0;
+                    size_t predicted_label = 0;
+                    for (size_t n = 0u; n < n_nodes; n++)
+                    {
+                        T expected = (n == samples[s].label) ? (T)1 : (T)0;
+                        T diff = output[n] - expected;
+                        cost += (diff * diff);
+
+                        if (output[n] > output[predicted_label])
+                        {
+                            predicted_label = n;
+                        }
+
+                        dcost_dz[n] =
+                            (T)2 * diff
+                            * dact_dz(pre_activ[idx + n]);
+                    }
+
+                    out_stats[m].total_cost += cost;
+                    if (predicted_label == samples[s].label)
+                    {
+                        out_stats[m].n_correct++;
+                    }
+                }
+            }
+        }
+
+        // calculate the weight and bias gradients of every model, summed over
+        // the batch, from the output layer's dcost_dz (see
+        // Network::backpropagate()). the dcost_dz values of a layer are stored
+        // per sample and then per model, n_nodes values each.
+        void backpropagate(size_t n_samples)
+        {
+            PROFILE_SCOPE(Backpropagation);
+
+            T* this_layer_dcost_dz = dcost_dz_scratch.data();
+            T* prev_layer_dcost_dz = dcost_dz_scratch.data() + dcost_dz_stride;
+
+            for (size_t l = _n_layers - 1u; l >= 1u; l--)
+            {
+                const size_t n_nodes = _layer_sizes[l];
+                const size_t n_prev_nodes = _layer_sizes[l - 1u];
+                T* grad_b = grads.data() + biases_offset(l);
+
+                if (l == 1u)
+                {
+                    first_layer_gradients(n_samples, this_layer_dcost_dz);
+                    break;
+                }
+
+                // weight and bias gradients, one row at a time for the whole
+                // batch. the gradients are added up over the samples in order.
+                for (size_t row = 0u; row < _n_models * n_nodes; row++)
+                {
+                    const size_t m = row / n_nodes;
+                    const size_t n = row % n_nodes;
+                    T* grad_w = grads.data() + weights_offset(l, row);
+
+                    grad_b[row] = (T)0;
+                    std::fill(grad_w, grad_w + n_prev_nodes, (T)0);
+
+                    for (size_t s = 0u; s < n_samples; s++)
+                    {
+                        const T dcost_dz = this_layer_dcost_dz[
+                            (s * _n_models + m) * n_nodes + n
+                        ];
+                        const T* prev_values = value_ptr(l - 1u, s, m);
+
+                        grad_b[row] += dcost_dz;
+                        for (size_t pn = 0u; pn < n_prev_nodes; pn++)
+                        {
+                            grad_w[pn] += dcost_dz * prev_values[pn];
+                        }
+                    }
+                }
+
+                // dcost_dz of the previous layer. every model's weights are
+                // used for the whole batch before moving on to the next model.
+                const auto& prev_dact_dz = _activation_derivs[l - 2u];
+                for (size_t m = 0u; m < _n_models; m++)
+                {
+                    const T* model_weights =
+                        params.data() + weights_offset(l, m * n_nodes);
+
+                    for (size_t s = 0u; s < n_samples; s++)
+                    {
+                        const T* dcost_dz = this_layer_dcost_dz
+                            + (s * _n_models + m) * n_nodes;
+                        T* prev_dcost_dz = prev_layer_dcost_dz
+                            + (s * _n_models + m) * n_prev_nodes;
+
+                        // dcost_dact of the previous layer, added up over the
+                        // nodes in order
+                        std::fill(
+                            prev_dcost_dz,
+                            prev_dcost_dz + n_prev_nodes,
+                            (T)0
+                        );
+                        for (size_t n = 0u; n < n_nodes; n++)
+                        {
+                            const T* w = model_weights + n * n_prev_nodes;
+                            for (size_t pn = 0u; pn < n_prev_nodes; pn++)
+                            {
+                                prev_dcost_dz[pn] += dcost_dz[n] * w[pn];
+                            }
+                        }
+
+                        const T* prev_pre_activ = pre_activ.data()
+                            + value_idx(l - 1u, s, m);
+                        for (size_t pn = 0u; pn < n_prev_nodes; pn++)
+                        {
+                            prev_dcost_dz[pn] *=
+                                prev_dact_dz(prev_pre_activ[pn]);
+                        }
+                    }
+                }
+
+                std::swap(this_layer_dcost_dz, prev_layer_dcost_dz);
+            }
+        }
+
+        // weight and bias gradients of the first layer from its dcost_dz.
+        // every input of a sample adds to a contiguous row of a model's
+        // weight gradients, and the gradients are still added up over the
+        // samples in order.
+        void first_layer_gradients(size_t n_samples, const T* layer_dcost_dz)
+        {
+            const size_t n_nodes = _layer_sizes[1];
+            const size_t n_inputs = input_size();
+
+            for (size_t m = 0u; m < _n_models; m++)
+            {
+                T* grad_w = grads.data() + first_layer_weights_offset(m);
+                T* grad_b = grads.data() + biases_offset(1u) + m * n_nodes;
+                std::fill(grad_w, grad_w + n_inputs * n_nodes, (T)0);
+                std::fill(grad_b, grad_b + n_nodes, (T)0);
+
+                for (size_t s = 0u; s < n_samples; s++)
+                {
+                    const T* dcost_dz =
+                        layer_dcost_dz + (s * _n_models + m) * n_nodes;
+                    const T* input = value_ptr(0u, s, 0u);
+
+                    for (size_t n = 0u; n < n_nodes; n++)
+                    {
+                        grad_b[n] += dcost_dz[n];
+                    }
+
+                    auto add_input = [&](size_t i)
+                        {
+                            const T v = input[i];
+                            T* grad_w_i = grad_w + i * n_nodes;
+                            for (size_t n = 0u; n < n_nodes; n++)
+                            {
+                                grad_w_i[n] += dcost_dz[n] * v;
+                            }
+                        };
+
+                    // the zeros in the input don't add anything to the
+                    // gradients
+                    if (sparse_inputs[s])
+                    {
+                        const uint32_t* nonzero =
+                            nonzero_inputs.data() + s * n_inputs;
+                        for (size_t k = 0u; k < n_nonzero_inputs[s]; k++)
+                        {
+                            add_input(nonzero[k]);
+                        }
+                    }
+                    else
+                    {
+                        for (size_t i = 0u; i < n_inputs; i++)
+                        {
+                            add_input(i);
+                        }
+                    }
+                }
+            }
+        }
+
+        // see Network::gradient_descent_step()
+        void gradient_descent_step(
+            size_t n_samples,
+            std::span<const T> learning_rates
+        )
+        {
+            PROFILE_SCOPE(GradientDescent);
+
+            const T inv_n_samples = (T)1 / (T)n_samples;
+
+            for (size_t l = 1u; l < _n_layers; l++)
+            {
+                const size_t n_nodes = _layer_sizes[l];
+                const size_t n_prev_nodes = _layer_sizes[l - 1u];
+
+                for (size_t m = 0u; m < _n_models; m++)
+                {
+                    const T learning_rate = learning_rates[m];
+
+                    const size_t b_offset = biases_offset(l) + m * n_nodes;
+                    T* b = params.data() + b_offset;
+                    const T* grad_b = grads.data() + b_offset;
+                    for (size_t n = 0u; n < n_nodes; n++)
+                    {
+                        T grad = grad_b[n] * inv_n_samples;
+                        b[n] -= grad * learning_rate;
+                    }
+
+                    const size_t w_offset = weights_offset(l, m * n_nodes);
+                    T* w = params.data() + w_offset;
+                    const T* grad_w = grads.data() + w_offset;
+                    for (size_t i = 0u; i < n_nodes * n_prev_nodes; i++)
+                    {
+                        T grad = grad_w[i] * inv_n_samples;
+                        w[i] -= grad * learning_rate;
+                    }
+                }
+            }
+        }
+
+    };
+
+}
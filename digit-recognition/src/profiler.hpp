@@ -0,0 +1,188 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// low-overhead scoped timers for finding out where the time in a training step
+// goes. timers are compiled out entirely unless DIGIT_REC_PROFILE is defined in
+// the preprocessor definitions.
+// each thread accumulates its timings locally and adds them to the global
+// totals when flush() is called, so timers never touch shared memory.
+// timers don't nest. if a timer starts while another one is running on the
+// same thread, only the outer one counts, so every stage is exclusive and the
+// stages add up to the total time spent in timed code.
+namespace profiler
+{
+
+#ifdef DIGIT_REC_PROFILE
+    static constexpr bool ENABLED = true;
+#else
+    static constexpr bool ENABLED = false;
+#endif
+
+    enum class Stage : int
+    {
+        PickSample,
+        ConvertInput,
+        RandomTransform,
+        SynthesizeDigit,
+        ZeroGradients,
+        ForwardPass,
+        Backpropagation,
+        GradientDescent,
+        GradientReduction,
+        PublishSnapshot,
+        Evaluation,
+        _Count
+    };
+    static constexpr size_t N_STAGES = (size_t)Stage::_Count;
+
+    // display names
+    static constexpr const char* Stage_str[] = {
+        "Pick Sample",
+        "Convert Input",
+        "Random Transform",
+        "Synthesize Digit",
+        "Zero Gradients",
+        "Forward Pass",
+        "Backpropagation",
+        "Gradient Descent",
+        "Gradient Reduction",
+        "Publish Snapshot",
+        "Evaluation"
+    };
+
+    // names used in machine-readable output
+    static constexpr const char* Stage_id[] = {
+        "pick_sample",
+        "convert_input",
+        "random_transform",
+        "synthesize_digit",
+        "zero_gradients",
+        "forward_pass",
+        "backpropagation",
+        "gradient_descent",
+        "gradient_reduction",
+        "publish_snapshot",
+        "evaluation"
+    };
+
+    struct StageTotals
+    {
+        uint64_t nanoseconds = 0;
+        uint64_t n_calls = 0;
+    };
+
+    // timings on the current thread that haven't been flushed yet
+    inline thread_local std::array<StageTotals, N_STAGES> local_totals{};
+
+    // whether a timer is running on the current thread
+    inline thread_local bool timer_running = false;
+
+    // timings flushed from all threads
+    inline std::array<std::atomic_uint64_t, N_STAGES> global_nanoseconds{};
+    inline std::array<std::atomic_uint64_t, N_STAGES> global_n_calls{};
+
+    // measures the time from its creation to its destruction and adds it to
+    // a stage in the current thread's timings. use PROFILE_SCOPE() instead of
+    // using this directly so that it can be compiled out.
+    class ScopedTimer
+    {
+    public:
+        ScopedTimer(Stage stage)
+            : stage(stage)
+        {
+            if (!timer_running)
+            {
+                timer_running = true;
+                active = true;
+                start_time = std::chrono::steady_clock::now();
+            }
+        }
+
+        ~ScopedTimer()
+        {
+            if (!active)
+            {
+                return;
+            }
+
+            auto elapsed = std::chrono::steady_clock::now() - start_time;
+
+            auto& totals = local_totals[(size_t)stage];
+            totals.nanoseconds += (uint64_t)std::chrono::duration_cast<
+                std::chrono::nanoseconds
+            >(elapsed).count();
+            totals.n_calls++;
+
+            timer_running = false;
+        }
+
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    private:
+        Stage stage;
+        bool active = false;
+        std::chrono::steady_clock::time_point start_time;
+
+    };
+
+    // add the current thread's timings to the global totals
+    inline void flush()
+    {
+        for (size_t i = 0; i < N_STAGES; i++)
+        {
+            global_nanoseconds[i].fetch_add(
+                local_totals[i].nanoseconds,
+                std::memory_order_relaxed
+            );
+            global_n_calls[i].fetch_add(
+                local_totals[i].n_calls,
+                std::memory_order_relaxed
+            );
+            local_totals[i] = {};
+        }
+    }
+
+    // global totals for every stage (can be called from any thread)
+    inline std::array<StageTotals, N_STAGES> totals()
+    {
+        std::array<StageTotals, N_STAGES> result{};
+        for (size_t i = 0; i < N_STAGES; i++)
+        {
+            result[i].nanoseconds =
+                global_nanoseconds[i].load(std::memory_order_relaxed);
+            result[i].n_calls =
+                global_n_calls[i].load(std::memory_order_relaxed);
+        }
+        return result;
+    }
+
+    // reset the global totals and the current thread's timings
+    inline void reset()
+    {
+        for (size_t i = 0; i < N_STAGES; i++)
+        {
+            global_nanoseconds[i].store(0, std::memory_order_relaxed);
+            global_n_calls[i].store(0, std::memory_order_relaxed);
+            local_totals[i] = {};
+        }
+    }
+
+}
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+// time the rest of the current scope as a profiler::Stage
+#ifdef DIGIT_REC_PROFILE
+#define PROFILE_SCOPE(stage) \
+    profiler::ScopedTimer PROFILE_CONCAT(profile_timer_, __LINE__)( \
+        profiler::Stage::stage \
+    )
+#else
+#define PROFILE_SCOPE(stage)
+#endif
@@ -0,0 +1,491 @@
+#pragma once
+
+#include <array>
+#include <span>
+#include <memory>
+#include <algorithm>
+#include <utility>
+#include <stdexcept>
+#include <cstdint>
+
+#include "neural.hpp"
+#include "profiler.hpp"
+
+namespace neural
+{
+
+    // a neural network whose layer sizes and activation functions are known
+    // at compile time. it does the same computations as Network<T, true> (in
+    // the same order, so the results match) but every loop bound and
+    // offset is a constant and the activation functions can be inlined, so
+    // the compiler can unroll and vectorize the layer kernels. the forward
+    // pass gains the most from this. training is only about 1.4x to 2x as
+    // fast as Network (measured for 784-64-64-10), since the backward pass
+    // still adds up every dcost_dz sum in order and updates the weight
+    // gradients one sample at a time.
+    // the layout is different from Network as well. weights and their
+    // gradients live in separate arrays (instead of being interleaved), and
+    // the weights of a layer are stored transposed, so the weights connecting
+    // a node in the previous layer to every node in the current layer are
+    // contiguous. this lets the forward pass and the weight gradients update
+    // a whole layer at once with no horizontal sums.
+    // the network is quite large, so it should be allocated on the heap.
+    // * hidden_fn and hidden_deriv are used for all hidden layers, output_fn
+    //   and output_deriv are used for the output layer.
+    template<
+        typename T,
+        T(*hidden_fn)(T),
+        T(*hidden_deriv)(T),
+        T(*output_fn)(T),
+        T(*output_deriv)(T),
+        size_t... layer_sizes_v
+    >
+    class StaticNetwork
+    {
+    public:
+        static constexpr size_t N_LAYERS = sizeof...(layer_sizes_v);
+        static_assert(N_LAYERS >= 2u, "there must be at least 2 layers");
+
+        static constexpr std::array<size_t, N_LAYERS> LAYER_SIZES{
+            layer_sizes_v...
+        };
+
+        static constexpr size_t INPUT_SIZE = LAYER_SIZES[0];
+        static constexpr size_t OUTPUT_SIZE = LAYER_SIZES[N_LAYERS - 1u];
+
+        // offsets of each layer in the values, biases, and weights arrays.
+        // biases and weights for the input layer are empty.
+        static constexpr std::array<size_t, N_LAYERS + 1u> VALUE_OFFSETS =
+            []()
+            {
+                std::array<size_t, N_LAYERS + 1u> offsets{};
+                for (size_t l = 0; l < N_LAYERS; l++)
+                {
+                    offsets[l + 1u] = offsets[l] + LAYER_SIZES[l];
+                }
+                return offsets;
+            }();
+
+        static constexpr std::array<size_t, N_LAYERS + 1u> WEIGHT_OFFSETS =
+            []()
+            {
+                std::array<size_t, N_LAYERS + 1u> offsets{};
+                for (size_t l = 1; l < N_LAYERS; l++)
+                {
+                    offsets[l + 1u] =
+                        offsets[l] + LAYER_SIZES[l - 1u] * LAYER_SIZES[l];
+                }
+                return offsets;
+            }();
+
+        static constexpr size_t N_VALUES = VALUE_OFFSETS[N_LAYERS];
+        static constexpr size_t N_WEIGHTS = WEIGHT_OFFSETS[N_LAYERS];
+
+        // biases use the same offsets as the values, the input layer's biases
+        // are just never used.
+        static constexpr size_t N_BIASES = N_VALUES;
+
+        static constexpr size_t MAX_LAYER_SIZE = std::max({ layer_sizes_v... });
+
+        StaticNetwork() = default;
+
+        // whether net has the same layer sizes as this type
+        template<bool store_gradients>
+        static bool matches(const Network<T, store_gradients>& net)
+        {
+            return std::equal(
+                LAYER_SIZES.begin(),
+                LAYER_SIZES.end(),
+                net.layer_sizes().begin(),
+                net.layer_sizes().end()
+            );
+        }
+
+        constexpr std::span<T, INPUT_SIZE> input_values()
+        {
+            return std::span<T, INPUT_SIZE>(values.data(), INPUT_SIZE);
+        }
+
+        constexpr std::span<T, OUTPUT_SIZE> output_values()
+        {
+            return std::span<T, OUTPUT_SIZE>(
+                values.data() + VALUE_OFFSETS[N_LAYERS - 1u],
+                OUTPUT_SIZE
+            );
+        }
+
+        // copy the weights and biases from a Network with the same layer
+        // sizes.
+        template<bool store_gradients>
+        void copy_parameters_from(Network<T, store_gradients>& net)
+        {
+            if (!matches(net))
+            {
+                throw std::invalid_argument("layer sizes don't match");
+            }
+
+            constexpr size_t stride = store_gradients ? 2u : 1u;
+            for (size_t l = 1; l < N_LAYERS; l++)
+            {
+                const size_t n_nodes = LAYER_SIZES[l];
+                const size_t n_prev_nodes = LAYER_SIZES[l - 1u];
+
+                auto b = net.biases(l);
+                for (size_t n = 0; n < n_nodes; n++)
+                {
+                    biases[VALUE_OFFSETS[l] + n] = b[n * stride];
+
+                    auto w = net.weights(l, n);
+                    for (size_t pn = 0; pn < n_prev_nodes; pn++)
+                    {
+                        weights[weight_index(l, n, pn)] = w[pn * stride];
+                    }
+                }
+            }
+        }
+
+        // copy the weights and biases into a Network with the same layer
+        // sizes. this doesn't touch the gradients in net.
+        template<bool store_gradients>
+        void copy_parameters_to(Network<T, store_gradients>& net) const
+        {
+            if (!matches(net))
+            {
+                throw std::invalid_argument("layer sizes don't match");
+            }
+
+            constexpr size_t stride = store_gradients ? 2u : 1u;
+            for (size_t l = 1; l < N_LAYERS; l++)
+            {
+                const size_t n_nodes = LAYER_SIZES[l];
+                const size_t n_prev_nodes = LAYER_SIZES[l - 1u];
+
+                auto b = net.biases(l);
+                for (size_t n = 0; n < n_nodes; n++)
+                {
+                    b[n * stride] = biases[VALUE_OFFSETS[l] + n];
+
+                    auto w = net.weights(l, n);
+                    for (size_t pn = 0; pn < n_prev_nodes; pn++)
+                    {
+                        w[pn * stride] = weights[weight_index(l, n, pn)];
+                    }
+                }
+            }
+        }
+
+        // evaluate the model (see Network::forward_pass())
+        void forward_pass()
+        {
+            PROFILE_SCOPE(ForwardPass);
+
+            [this]<size_t... l>(std::index_sequence<l...>)
+            {
+                (forward_layer<l + 1u>(), ...);
+            }(std::make_index_sequence<N_LAYERS - 1u>());
+        }
+
+        // same as Network::forward_backward()
+        template<bool accumulate_gradients>
+        PassResult<T> forward_backward(
+            std::span<const T, INPUT_SIZE> input,
+            size_t expected_label
+        )
+        {
+            std::copy(input.begin(), input.end(), values.begin());
+            forward_pass();
+
+            PassResult<T> result{ (T)0, 0 };
+            auto output = output_values();
+            for (size_t i = 0; i < OUTPUT_SIZE; i++)
+            {
+                T expected = (i == expected_label) ? (T)1 : (T)0;
+                T diff = output[i] - expected;
+                result.cost += (diff * diff);
+
+                if (output[i] > output[result.predicted_label])
+                {
+                    result.predicted_label = i;
+                }
+            }
+
+            backpropagate<accumulate_gradients>(expected_label);
+            return result;
+        }
+
+        // same as Network::train() for classification examples
+        BatchStats<T> train(
+            std::span<const LabeledInput<T>> samples,
+            T learning_rate
+        )
+        {
+            BatchStats<T> stats;
+
+            zero_gradients();
+            for (const auto& sample : samples)
+            {
+                if (sample.label >= OUTPUT_SIZE)
+                {
+                    throw std::invalid_argument("invalid expected label");
+                }
+
+                PassResult<T> result = forward_backward<true>(
+                    std::span<const T, INPUT_SIZE>(sample.input, INPUT_SIZE),
+                    sample.label
+                );
+
+                stats.total_cost += result.cost;
+                if (result.predicted_label == sample.label)
+                {
+                    stats.n_correct++;
+                }
+            }
+            stats.n_samples = samples.size();
+
+            gradient_descent_step(samples.size(), learning_rate);
+            return stats;
+        }
+
+    private:
+        // index of the weight connecting node pn in the previous layer to
+        // node n in layer l (transposed, see above)
+        static constexpr size_t weight_index(size_t l, size_t n, size_t pn)
+        {
+            return WEIGHT_OFFSETS[l] + pn * LAYER_SIZES[l] + n;
+        }
+
+        template<size_t l>
+        static constexpr T activ(T v)
+        {
+            if constexpr (l == N_LAYERS - 1u)
+                return output_fn(v);
+            else
+                return hidden_fn(v);
+        }
+
+        template<size_t l>
+        static constexpr T activ_deriv(T v)
+        {
+            if constexpr (l == N_LAYERS - 1u)
+                return output_deriv(v);
+            else
+                return hidden_deriv(v);
+        }
+
+        template<size_t l>
+        void forward_layer()
+        {
+            constexpr size_t n_nodes = LAYER_SIZES[l];
+            constexpr size_t n_prev_nodes = LAYER_SIZES[l - 1u];
+
+            const T* prev_values = values.data() + VALUE_OFFSETS[l - 1u];
+            T* this_values = values.data() + VALUE_OFFSETS[l];
+            T* this_pre_activ = pre_activ.data() + VALUE_OFFSETS[l];
+            const T* this_biases = biases.data() + VALUE_OFFSETS[l];
+            const T* w = weights.data() + WEIGHT_OFFSETS[l];
+
+            // accumulate the weighted sums for the whole layer at once, one
+            // previous node at a time. each sum is still added up in the same
+            // order as in Network::forward_pass().
+            std::array<T, n_nodes> weighted_sums{};
+            auto add_prev_node = [&](size_t pn)
+                {
+                    const T prev_value = prev_values[pn];
+                    const T* w_pn = w + pn * n_nodes;
+                    for (size_t n = 0; n < n_nodes; n++)
+                    {
+                        weighted_sums[n] += w_pn[n] * prev_value;
+                    }
+                };
+
+            // the first layer skips the zeros in the input if there are
+            // enough of them (see Network::forward_pass()).
+            if (l == 1u && find_nonzero_inputs())
+            {
+                for (size_t k = 0; k < n_nonzero_inputs; k++)
+                {
+                    add_prev_node(nonzero_inputs[k]);
+                }
+            }
+            else
+            {
+                for (size_t pn = 0; pn < n_prev_nodes; pn++)
+                {
+                    add_prev_node(pn);
+                }
+            }
+
+            for (size_t n = 0; n < n_nodes; n++)
+            {
+                const T z = weighted_sums[n] + this_biases[n];
+                this_pre_activ[n] = z;
+                this_values[n] = activ<l>(z);
+            }
+        }
+
+        // same as Network::find_nonzero_inputs()
+        bool find_nonzero_inputs()
+        {
+            n_nonzero_inputs = 0;
+            for (size_t i = 0; i < INPUT_SIZE; i++)
+            {
+                if (values[i] != (T)0)
+                {
+                    nonzero_inputs[n_nonzero_inputs] = (uint32_t)i;
+                    n_nonzero_inputs++;
+                }
+            }
+
+            last_pass_sparse = (float)n_nonzero_inputs
+                <= SPARSE_INPUT_MAX_DENSITY * (float)INPUT_SIZE;
+            return last_pass_sparse;
+        }
+
+        void zero_gradients()
+        {
+            PROFILE_SCOPE(ZeroGradients);
+
+            bias_grads.fill((T)0);
+            weight_grads.fill((T)0);
+        }
+
+        template<bool accumulate_gradients>
+        void backpropagate(size_t expected_label)
+        {
+            // see Network::backpropagate() for an explanation
+
+            PROFILE_SCOPE(Backpropagation);
+
+            // dcost_dz for the output layer
+            constexpr size_t l_out = N_LAYERS - 1u;
+            for (size_t n = 0; n < OUTPUT_SIZE; n++)
+            {
+                const T predicted = values[VALUE_OFFSETS[l_out] + n];
+                const T expected = (n == expected_label) ? (T)1 : (T)0;
+                const T dcost_dact = (T)2 * (predicted - expected);
+
+                dcost_dz[l_out % 2u][n] = dcost_dact
+                    * activ_deriv<l_out>(pre_activ[VALUE_OFFSETS[l_out] + n]);
+            }
+
+            [this]<size_t... i>(std::index_sequence<i...>)
+            {
+                (backpropagate_layer<l_out - i, accumulate_gradients>(), ...);
+            }(std::make_index_sequence<N_LAYERS - 1u>());
+        }
+
+        // calculate the weight and bias gradients for layer l from its
+        // dcost_dz, and then the previous layer's dcost_dz if it's not the
+        // input layer.
+        template<size_t l, bool accumulate_gradients>
+        void backpropagate_layer()
+        {
+            constexpr size_t n_nodes = LAYER_SIZES[l];
+            constexpr size_t n_prev_nodes = LAYER_SIZES[l - 1u];
+
+            const T* this_dcost_dz = dcost_dz[l % 2u].data();
+            const T* prev_values = values.data() + VALUE_OFFSETS[l - 1u];
+            const T* w = weights.data() + WEIGHT_OFFSETS[l];
+            T* b_grads = bias_grads.data() + VALUE_OFFSETS[l];
+            T* w_grads = weight_grads.data() + WEIGHT_OFFSETS[l];
+
+            for (size_t n = 0; n < n_nodes; n++)
+            {
+                if constexpr (accumulate_gradients)
+                    b_grads[n] += this_dcost_dz[n];
+                else
+                    b_grads[n] = this_dcost_dz[n];
+            }
+
+            auto update_weight_grads = [&](size_t pn)
+                {
+                    const T prev_value = prev_values[pn];
+                    T* w_grads_pn = w_grads + pn * n_nodes;
+                    for (size_t n = 0; n < n_nodes; n++)
+                    {
+                        if constexpr (accumulate_gradients)
+                            w_grads_pn[n] += this_dcost_dz[n] * prev_value;
+                        else
+                            w_grads_pn[n] = this_dcost_dz[n] * prev_value;
+                    }
+                };
+
+            // zeros in the input don't add anything to the gradients
+            if (accumulate_gradients && l == 1u && last_pass_sparse)
+            {
+                for (size_t k = 0; k < n_nonzero_inputs; k++)
+                {
+                    update_weight_grads(nonzero_inputs[k]);
+                }
+            }
+            else
+            {
+                for (size_t pn = 0; pn < n_prev_nodes; pn++)
+                {
+                    update_weight_grads(pn);
+                }
+            }
+
+            if constexpr (l > 1u)
+            {
+                T* prev_dcost_dz = dcost_dz[(l - 1u) % 2u].data();
+                const T* prev_pre_activ =
+                    pre_activ.data() + VALUE_OFFSETS[l - 1u];
+
+                for (size_t pn = 0; pn < n_prev_nodes; pn++)
+                {
+                    const T* w_pn = w + pn * n_nodes;
+
+                    T dcost_dact_pn = (T)0;
+                    for (size_t n = 0; n < n_nodes; n++)
+                    {
+                        dcost_dact_pn += this_dcost_dz[n] * w_pn[n];
+                    }
+
+                    prev_dcost_dz[pn] = dcost_dact_pn
+                        * activ_deriv<l - 1u>(prev_pre_activ[pn]);
+                }
+            }
+        }
+
+        // same as Network::gradient_descent_step()
+        void gradient_descent_step(size_t n_data_points, T learning_rate)
+        {
+            PROFILE_SCOPE(GradientDescent);
+
+            const T inv_n_data_points = (T)1 / (T)n_data_points;
+
+            for (size_t i = VALUE_OFFSETS[1]; i < N_BIASES; i++)
+            {
+                T grad = bias_grads[i] * inv_n_data_points;
+                biases[i] -= grad * learning_rate;
+            }
+
+            for (size_t i = 0; i < N_WEIGHTS; i++)
+            {
+                T grad = weight_grads[i] * inv_n_data_points;
+                weights[i] -= grad * learning_rate;
+            }
+        }
+
+    private:
+        alignas(64) std::array<T, N_VALUES> values{};
+        alignas(64) std::array<T, N_VALUES> pre_activ{};
+        alignas(64) std::array<T, N_BIASES> biases{};
+        alignas(64) std::array<T, N_BIASES> bias_grads{};
+        alignas(64) std::array<T, N_WEIGHTS> weights{};
+        alignas(64) std::array<T, N_WEIGHTS> weight_grads{};
+
+        // dcost_dz for the current and previous layers in backpropagation,
+        // alternating between layers (indexed by layer index % 2).
+        alignas(64) std::array<std::array<T, MAX_LAYER_SIZE>, 2> dcost_dz{};
+
+        // indices of the nonzero input values in the last forward pass, and
+        // whether the first layer only used those.
+        std::array<uint32_t, INPUT_SIZE> nonzero_inputs{};
+        size_t n_nonzero_inputs = 0;
+        bool last_pass_sparse = false;
+
+    };
+
+}
@@ -90,6 +90,35 @@ namespace stream
         return endian::little2host(read<T, Elem, Traits>(s));
     }
 
+    template <
+        typename T,
+        class Elem = char,
+        class Traits = std::char_traits<char>
+    >
+    void write(
+        std::basic_ostream<Elem, Traits>& s,
+        const T* source,
+        size_t count
+    )
+    {
+        s.write(
+            reinterpret_cast<const Elem*>(source),
+            count * sizeof(T) / sizeof(Elem)
+        );
+        ensure(s);
+    }
+
+    template <
+        typename T,
+        class Elem = char,
+        class Traits = std::char_traits<char>
+    >
+    void write_bigend(std::basic_ostream<Elem, Traits>& s, T value)
+    {
+        value = endian::host2big(value);
+        write<T, Elem, Traits>(s, &value, 1u);
+    }
+
     template <
         typename T,
         class Elem = char,
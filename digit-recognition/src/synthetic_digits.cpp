@@ -0,0 +1,337 @@
+#include "synthetic_digits.hpp"
+
+#include <algorithm>
+#include <numbers>
+#include <stdexcept>
+#include <cmath>
+
+#include "app_digit_rec.hpp"
+
+namespace digit_rec
+{
+
+    using Point = std::array<float, 2>;
+
+    // points on an elliptical arc from angle a0 to a1 (in radians, clockwise
+    // on the screen since v points down), including both ends
+    static std::vector<Point> arc(
+        float center_u,
+        float center_v,
+        float radius_u,
+        float radius_v,
+        float a0,
+        float a1,
+        size_t n_points
+    )
+    {
+        std::vector<Point> points(n_points);
+        for (size_t i = 0; i < n_points; i++)
+        {
+            const float a = a0 + (a1 - a0) * (float)i / (float)(n_points - 1u);
+            points[i] = {
+                center_u + radius_u * std::cos(a),
+                center_v + radius_v * std::sin(a)
+            };
+        }
+        return points;
+    }
+
+    // concatenate parts of a stroke, skipping the first point of a part if
+    // it's the same as the last point of the previous part
+    static std::vector<Point> join(
+        std::initializer_list<std::vector<Point>> parts
+    )
+    {
+        std::vector<Point> points;
+        for (const auto& part : parts)
+        {
+            for (const Point& p : part)
+            {
+                if (!points.empty()
+                    && std::abs(points.back()[0] - p[0]) < 1e-4f
+                    && std::abs(points.back()[1] - p[1]) < 1e-4f)
+                {
+                    continue;
+                }
+                points.push_back(p);
+            }
+        }
+        return points;
+    }
+
+    // point on a Catmull-Rom spline between p1 and p2 (t from 0 to 1)
+    static Point catmull_rom(
+        const Point& p0,
+        const Point& p1,
+        const Point& p2,
+        const Point& p3,
+        float t
+    )
+    {
+        const float t2 = t * t;
+        const float t3 = t2 * t;
+
+        Point p;
+        for (size_t c = 0; c < 2; c++)
+        {
+            p[c] = .5f * (
+                2.f * p1[c]
+                + (p2[c] - p0[c]) * t
+                + (2.f * p0[c] - 5.f * p1[c] + 4.f * p2[c] - p3[c]) * t2
+                + (3.f * p1[c] - p0[c] - 3.f * p2[c] + p3[c]) * t3
+                );
+        }
+        return p;
+    }
+
+    SyntheticDigits::SyntheticDigits()
+    {
+        static constexpr float PI = std::numbers::pi_v<float>;
+
+        // MNIST digits fit in a 20x20 box in the middle of the image, which
+        // is about -.7 to +.7 in UV coordinates.
+
+        // 0
+        shapes[0] = {
+            { arc(0.f, 0.f, .36f, .6f, -.5f * PI, 1.55f * PI, 14) },
+            { arc(0.f, 0.f, .26f, .62f, -.4f * PI, 1.6f * PI, 14) }
+        };
+
+        // 1
+        shapes[1] = {
+            { { { 0.f, -.62f }, { 0.f, .62f } } },
+            { { { -.2f, -.38f }, { .02f, -.62f }, { .02f, .62f } } },
+            {
+                { { -.2f, -.38f }, { .02f, -.62f }, { .02f, .62f } },
+                { { -.2f, .62f }, { .24f, .62f } }
+            }
+        };
+
+        // 2
+        shapes[2] = {
+            {
+                join({
+                    arc(0.f, -.28f, .32f, .32f, -.85f * PI, .15f * PI, 7),
+                    { { -.36f, .6f }, { .38f, .6f } }
+                })
+            },
+            {
+                join({
+                    arc(0.f, -.3f, .3f, .3f, -.9f * PI, .2f * PI, 7),
+                    { { -.34f, .58f }, { -.1f, .52f }, { .38f, .62f } }
+                })
+            }
+        };
+
+        // 3
+        shapes[3] = {
+            {
+                join({
+                    arc(0.f, -.32f, .28f, .28f, -.85f * PI, .5f * PI, 7),
+                    arc(0.f, .3f, .33f, .32f, -.5f * PI, .85f * PI, 8)
+                })
+            },
+            {
+                { { -.3f, -.6f }, { .3f, -.6f }, { -.04f, -.08f } },
+                arc(0.f, .28f, .33f, .33f, -.6f * PI, .85f * PI, 8)
+            }
+        };
+
+        // 4
+        shapes[4] = {
+            {
+                { { -.28f, -.6f }, { -.33f, .12f }, { .38f, .12f } },
+                { { .2f, -.62f }, { .2f, .62f } }
+            },
+            {
+                {
+                    { .18f, .62f },
+                    { .18f, -.62f },
+                    { -.38f, .2f },
+                    { .4f, .2f }
+                }
+            }
+        };
+
+        // 5
+        shapes[5] = {
+            {
+                join({
+                    { { .32f, -.6f }, { -.2f, -.6f }, { -.22f, -.1f } },
+                    arc(0.f, .22f, .34f, .34f, -.68f * PI, .85f * PI, 9)
+                })
+            },
+            {
+                { { -.2f, -.6f }, { .32f, -.6f } },
+                join({
+                    { { -.2f, -.6f }, { -.22f, -.1f } },
+                    arc(0.f, .22f, .34f, .34f, -.68f * PI, .85f * PI, 9)
+                })
+            }
+        };
+
+        // 6
+        shapes[6] = {
+            {
+                join({
+                    { { .22f, -.62f }, { -.1f, -.38f } },
+                    arc(0.f, .3f, .3f, .3f, 1.f * PI, -.95f * PI, 12)
+                })
+            }
+        };
+
+        // 7
+        shapes[7] = {
+            { { { -.36f, -.6f }, { .36f, -.6f }, { -.06f, .62f } } },
+            {
+                { { -.36f, -.6f }, { .36f, -.6f }, { -.06f, .62f } },
+                { { -.16f, .02f }, { .26f, .02f } }
+            }
+        };
+
+        // 8
+        shapes[8] = {
+            {
+                join({
+                    arc(0.f, -.32f, .27f, .28f, -.2f * PI, -1.5f * PI, 8),
+                    arc(0.f, .3f, .33f, .32f, -.5f * PI, 1.5f * PI, 12),
+                    arc(0.f, -.32f, .27f, .28f, .5f * PI, -.2f * PI, 5)
+                })
+            }
+        };
+
+        // 9
+        shapes[9] = {
+            {
+                join({
+                    arc(0.f, -.3f, .3f, .3f, 0.f, -2.f * PI, 12),
+                    { { .28f, .1f }, { .2f, .62f } }
+                })
+            },
+            {
+                arc(0.f, -.3f, .3f, .3f, 0.f, -2.f * PI, 12),
+                { { .3f, -.5f }, { .3f, .62f } }
+            }
+        };
+
+        for (const auto& digit_shapes : shapes)
+        {
+            for (const auto& shape : digit_shapes)
+            {
+                for (const auto& stroke : shape)
+                {
+                    if (stroke.size() < 2u
+                        || stroke.size() > MAX_STROKE_POINTS)
+                    {
+                        throw std::logic_error(
+                            "invalid number of points in a stroke"
+                        );
+                    }
+                }
+            }
+        }
+    }
+
+    uint32_t SyntheticDigits::generate(std::mt19937& rng, float* image) const
+    {
+        std::uniform_int_distribution<uint32_t> label_dist(0, 9);
+        const uint32_t label = label_dist(rng);
+        generate(rng, label, image);
+        return label;
+    }
+
+    void SyntheticDigits::generate(
+        std::mt19937& rng,
+        uint32_t label,
+        float* image
+    ) const
+    {
+        if (label > 9u)
+        {
+            throw std::invalid_argument("invalid digit label");
+        }
+
+        const auto& digit_shapes = shapes[label];
+        std::uniform_int_distribution<size_t> shape_dist(
+            0,
+            digit_shapes.size() - 1u
+        );
+        const Shape& shape = digit_shapes[shape_dist(rng)];
+
+        // random variations of the shape
+        std::uniform_real_distribution<float> scale_dist(.8f, 1.1f);
+        std::uniform_real_distribution<float> aspect_dist(.85f, 1.15f);
+        std::uniform_real_distribution<float> rotation_dist(-.15f, .15f);
+        std::uniform_real_distribution<float> slant_dist(-.1f, .35f);
+        std::uniform_real_distribution<float> offset_dist(-.08f, .08f);
+        std::uniform_real_distribution<float> width_dist(.7f, 1.4f);
+        std::normal_distribution<float> wobble_dist(0.f, .03f);
+
+        const float scale = scale_dist(rng);
+        const float aspect = std::sqrt(aspect_dist(rng));
+        const float scale_u = scale * aspect;
+        const float scale_v = scale / aspect;
+        const float rotation = rotation_dist(rng);
+        const float slant = slant_dist(rng);
+        const float offset_u = offset_dist(rng);
+        const float offset_v = offset_dist(rng);
+        const float width = width_dist(rng);
+
+        const float cos_r = std::cos(rotation);
+        const float sin_r = std::sin(rotation);
+
+        // scale, slant (lean the top to the right), rotate, and move
+        auto transform = [&](const Point& p) -> Point
+            {
+                float u = p[0] * scale_u;
+                float v = p[1] * scale_v;
+                u -= slant * v;
+                return {
+                    cos_r * u - sin_r * v + offset_u,
+                    sin_r * u + cos_r * v + offset_v
+                };
+            };
+
+        std::fill(image, image + N_DIGIT_VALUES, 0.f);
+
+        std::array<Point, MAX_STROKE_POINTS> points;
+        for (const Stroke& stroke : shape)
+        {
+            const size_t n_points = stroke.size();
+            for (size_t i = 0; i < n_points; i++)
+            {
+                points[i] = transform({
+                    stroke[i][0] + wobble_dist(rng),
+                    stroke[i][1] + wobble_dist(rng)
+                });
+            }
+
+            // draw a smooth curve through the points
+            Point prev = points[0];
+            for (size_t i = 0; i + 1u < n_points; i++)
+            {
+                const Point& p0 = points[i > 0u ? i - 1u : 0u];
+                const Point& p1 = points[i];
+                const Point& p2 = points[i + 1u];
+                const Point& p3 = points[std::min(i + 2u, n_points - 1u)];
+
+                for (size_t s = 1; s <= SEGMENTS_PER_POINT; s++)
+                {
+                    const Point p = catmull_rom(
+                        p0, p1, p2, p3,
+                        (float)s / (float)SEGMENTS_PER_POINT
+                    );
+                    draw_stroke_segment(
+                        image,
+                        prev[0], prev[1],
+                        p[0], p[1],
+                        STROKE_INNER_RADIUS * width,
+                        STROKE_OUTER_RADIUS * width
+                    );
+                    prev = p;
+                }
+            }
+        }
+    }
+
+}
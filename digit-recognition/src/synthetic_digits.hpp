@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <random>
+#include <cstdint>
+
+namespace digit_rec
+{
+
+    // draws digits out of brush strokes, with the same rasterizer as the
+    // drawboard (see draw_stroke_segment()), so that the network also learns
+    // what digits drawn on the drawboard look like. every digit has a few
+    // hand-made shapes, and every sample randomly varies the shape's size,
+    // rotation, slant, position, and stroke width, and wobbles its control
+    // points. this doesn't allocate memory or lock anything, so it can be
+    // used from any number of threads at the same time.
+    class SyntheticDigits
+    {
+    public:
+        SyntheticDigits();
+
+        // draw a random digit into image (N_DIGIT_VALUES values, all of them
+        // are overwritten) and return its label
+        uint32_t generate(std::mt19937& rng, float* image) const;
+
+        // same as above, but for a given digit label
+        void generate(std::mt19937& rng, uint32_t label, float* image) const;
+
+    private:
+        // maximum number of control points in a stroke
+        static constexpr size_t MAX_STROKE_POINTS = 40;
+
+        // number of line segments between two control points
+        static constexpr size_t SEGMENTS_PER_POINT = 3;
+
+        // control points of a stroke in UV coordinates (see
+        // draw_stroke_segment()). the stroke is a smooth curve through them.
+        using Point = std::array<float, 2>;
+        using Stroke = std::vector<Point>;
+
+        // the strokes of a way to draw a digit
+        using Shape = std::vector<Stroke>;
+
+        // the shapes of every digit
+        std::array<std::vector<Shape>, 10> shapes;
+
+    };
+
+}
@@ -0,0 +1,249 @@
+#include "task_pool.hpp"
+
+#include "trace.hpp"
+
+namespace tasks
+{
+
+    // the pool and worker index of the current thread, if it's a worker
+    static thread_local const Pool* current_pool = nullptr;
+    static thread_local size_t current_worker_idx = ANY_WORKER;
+
+    Pool::Pool(size_t n_workers)
+        : nodes(numa::topology())
+    {
+        n_workers = std::max(n_workers, (size_t)1u);
+
+        // don't use more nodes than workers
+        if (nodes.size() > n_workers)
+        {
+            nodes.resize(n_workers);
+        }
+
+        workers.resize(n_workers);
+        for (size_t w = 0; w < n_workers; w++)
+        {
+            workers[w] = std::make_unique<Worker>();
+            workers[w]->cpu = numa::worker_cpu(nodes, w, workers[w]->node_idx);
+        }
+
+        // start the threads after every worker exists, they can steal from
+        // each other right away.
+        for (size_t w = 0; w < n_workers; w++)
+        {
+            workers[w]->thread = std::jthread(
+                [this, w]()
+                {
+                    run_worker(w);
+                }
+            );
+        }
+    }
+
+    Pool::~Pool()
+    {
+        {
+            std::lock_guard lock(sleep_mutex);
+            stopping = true;
+        }
+        sleep_cv.notify_all();
+
+        for (auto& worker : workers)
+        {
+            worker->thread.join();
+        }
+    }
+
+    size_t Pool::current_worker() const
+    {
+        return current_pool == this ? current_worker_idx : ANY_WORKER;
+    }
+
+    void Pool::submit(const Task& task, size_t worker_idx)
+    {
+        if (worker_idx != ANY_WORKER)
+        {
+            Worker& worker = *workers[worker_idx % workers.size()];
+            {
+                std::lock_guard lock(worker.mutex);
+                worker.bound_tasks.push_back(task);
+            }
+            {
+                std::lock_guard lock(sleep_mutex);
+                worker.n_bound_tasks++;
+            }
+
+            // we can't wake up a specific worker
+            sleep_cv.notify_all();
+            return;
+        }
+
+        // workers keep their own tasks to themselves unless they're stolen
+        const size_t current = current_worker();
+        if (current != ANY_WORKER)
+        {
+            Worker& worker = *workers[current];
+            std::lock_guard lock(worker.mutex);
+            worker.tasks.push_back(task);
+        }
+        else
+        {
+            std::lock_guard lock(shared_mutex);
+            shared_tasks.push_back(task);
+        }
+        {
+            std::lock_guard lock(sleep_mutex);
+            n_unbound_tasks++;
+        }
+        sleep_cv.notify_one();
+    }
+
+    bool Pool::run_one()
+    {
+        const size_t current = current_worker();
+        if (current == ANY_WORKER)
+        {
+            return false;
+        }
+        return run_one(current);
+    }
+
+    void Pool::run_worker(size_t worker_idx)
+    {
+        TRACE_THREAD_NAME("Pool Worker");
+
+        Worker& worker = *workers[worker_idx];
+        numa::pin_current_thread(worker.cpu);
+
+        current_pool = this;
+        current_worker_idx = worker_idx;
+
+        while (true)
+        {
+            if (run_one(worker_idx))
+            {
+                continue;
+            }
+
+            std::unique_lock lock(sleep_mutex);
+            sleep_cv.wait(
+                lock,
+                [&]()
+                {
+                    return stopping
+                        || n_unbound_tasks > 0
+                        || worker.n_bound_tasks > 0;
+                }
+            );
+
+            // every task group is waited for before the pool goes away, so
+            // nothing is left in the queues at this point.
+            if (stopping)
+            {
+                break;
+            }
+        }
+    }
+
+    bool Pool::run_one(size_t worker_idx)
+    {
+        Worker& worker = *workers[worker_idx];
+        Task task;
+
+        // tasks bound to this worker, oldest first
+        {
+            std::lock_guard lock(worker.mutex);
+            if (worker.bound_tasks.pop_front(task))
+            {
+                worker.n_bound_tasks--;
+            }
+            else if (worker.tasks.pop_back(task))
+            {
+                // this worker's own tasks, newest first (the ones most likely
+                // to still be in the cache)
+                n_unbound_tasks--;
+            }
+        }
+
+        // tasks from outside the pool
+        if (!task.fn)
+        {
+            std::lock_guard lock(shared_mutex);
+            if (shared_tasks.pop_front(task))
+            {
+                n_unbound_tasks--;
+            }
+        }
+
+        // steal the oldest task of another worker, starting with the next one
+        for (size_t i = 1u; !task.fn && i < workers.size(); i++)
+        {
+            Worker& victim = *workers[(worker_idx + i) % workers.size()];
+            std::lock_guard lock(victim.mutex);
+            if (victim.tasks.pop_front(task))
+            {
+                n_unbound_tasks--;
+            }
+        }
+
+        if (!task.fn)
+        {
+            return false;
+        }
+
+        execute(task);
+        return true;
+    }
+
+    void Pool::execute(const Task& task)
+    {
+        std::exception_ptr error = nullptr;
+        try
+        {
+            task.fn(task.ctx, task.idx);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+        task.group->task_done(error);
+    }
+
+    void TaskGroup::wait_for_tasks()
+    {
+        // help out instead of blocking a worker, the tasks we're waiting for
+        // might be queued behind this one.
+        if (pool.current_worker() != ANY_WORKER)
+        {
+            while (n_pending > 0)
+            {
+                if (!pool.run_one())
+                {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        // this also makes sure task_done() is done with the group before it
+        // can be destroyed.
+        std::unique_lock lock(mutex);
+        done_cv.wait(lock, [&]() { return n_pending == 0; });
+    }
+
+    void TaskGroup::task_done(std::exception_ptr error)
+    {
+        std::lock_guard lock(mutex);
+
+        if (error && !exception)
+        {
+            exception = error;
+        }
+
+        n_pending--;
+        if (n_pending == 0)
+        {
+            done_cv.notify_all();
+        }
+    }
+
+}
@@ -0,0 +1,326 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <algorithm>
+#include <limits>
+#include <cstdint>
+#include <cstddef>
+
+#include "numa.hpp"
+
+// work-stealing thread pool shared by everything that runs in parallel
+// (training, evaluation, and so on), so that they don't all create their own
+// threads and fight over the CPUs.
+// every worker has its own queue of tasks. it runs the newest task in its own
+// queue first, and when that's empty, it steals the oldest task from another
+// worker. tasks submitted from threads outside the pool go to a shared queue.
+// the workers are pinned to CPUs spread over the NUMA nodes (see
+// numa::worker_cpu()), and a task can be bound to a specific worker so that
+// it runs next to the memory that worker allocated.
+namespace tasks
+{
+
+    class TaskGroup;
+
+    // worker index for tasks that can run on any worker
+    static constexpr size_t ANY_WORKER = std::numeric_limits<size_t>::max();
+
+    // a task only points to a callable owned by whoever submitted it, so
+    // submitting tasks doesn't allocate memory (unless a queue has to grow).
+    struct Task
+    {
+        void (*fn)(const void* ctx, size_t idx) = nullptr;
+        const void* ctx = nullptr;
+        size_t idx = 0;
+        TaskGroup* group = nullptr;
+    };
+
+    // double-ended queue of tasks in a ring buffer that only ever grows
+    class TaskQueue
+    {
+    public:
+        TaskQueue(size_t capacity = 64)
+            : buffer(std::max(capacity, (size_t)1u))
+        {}
+
+        bool empty() const
+        {
+            return n_tasks == 0;
+        }
+
+        void push_back(const Task& task)
+        {
+            if (n_tasks == buffer.size())
+            {
+                grow();
+            }
+            buffer[(head + n_tasks) % buffer.size()] = task;
+            n_tasks++;
+        }
+
+        bool pop_front(Task& out_task)
+        {
+            if (n_tasks == 0)
+            {
+                return false;
+            }
+            out_task = buffer[head];
+            head = (head + 1u) % buffer.size();
+            n_tasks--;
+            return true;
+        }
+
+        bool pop_back(Task& out_task)
+        {
+            if (n_tasks == 0)
+            {
+                return false;
+            }
+            n_tasks--;
+            out_task = buffer[(head + n_tasks) % buffer.size()];
+            return true;
+        }
+
+    private:
+        std::vector<Task> buffer;
+        size_t head = 0;
+        size_t n_tasks = 0;
+
+        void grow()
+        {
+            std::vector<Task> new_buffer(buffer.size() * 2u);
+            for (size_t i = 0; i < n_tasks; i++)
+            {
+                new_buffer[i] = buffer[(head + i) % buffer.size()];
+            }
+            buffer.swap(new_buffer);
+            head = 0;
+        }
+
+    };
+
+    class Pool
+    {
+    public:
+        // start n_workers worker threads (at least 1)
+        Pool(size_t n_workers);
+        ~Pool();
+
+        Pool(const Pool&) = delete;
+        Pool& operator=(const Pool&) = delete;
+
+        size_t n_workers() const
+        {
+            return workers.size();
+        }
+
+        // number of NUMA nodes the workers are spread over
+        size_t n_nodes() const
+        {
+            return nodes.size();
+        }
+
+        // index of the NUMA node of a worker, in [0, n_nodes())
+        size_t worker_node(size_t worker_idx) const
+        {
+            return workers[worker_idx]->node_idx;
+        }
+
+        // index of the worker running the current thread, or ANY_WORKER if
+        // the current thread isn't one of this pool's workers.
+        size_t current_worker() const;
+
+        // queue a task. tasks bound to a worker are only ever run by that
+        // worker, others can be run (or stolen) by any worker.
+        void submit(const Task& task, size_t worker_idx = ANY_WORKER);
+
+        // run one task that the current worker is allowed to run, if there's
+        // any. returns false if there's nothing to run or if the current
+        // thread isn't one of this pool's workers.
+        bool run_one();
+
+    private:
+        struct Worker
+        {
+            std::jthread thread;
+
+            uint32_t cpu = 0;
+            size_t node_idx = 0;
+
+            // tasks that any worker can run
+            std::mutex mutex;
+            TaskQueue tasks;
+
+            // tasks that only this worker can run (also locked with mutex)
+            TaskQueue bound_tasks;
+            std::atomic_int64_t n_bound_tasks = 0;
+        };
+
+        std::vector<numa::Node> nodes;
+        std::vector<std::unique_ptr<Worker>> workers;
+
+        // tasks submitted from outside the pool
+        std::mutex shared_mutex;
+        TaskQueue shared_tasks;
+
+        // idle workers sleep until a task they can run is queued. the
+        // counters are only increased while holding sleep_mutex so that
+        // wakeups can't get lost.
+        std::mutex sleep_mutex;
+        std::condition_variable sleep_cv;
+        std::atomic_int64_t n_unbound_tasks = 0;
+        bool stopping = false;
+
+        void run_worker(size_t worker_idx);
+        bool run_one(size_t worker_idx);
+        void execute(const Task& task);
+
+    };
+
+    // a set of tasks that can be waited for. the callables passed to run()
+    // and run_for() are referenced, not copied, so they must stay alive until
+    // wait() returns. if a task throws, the first exception is rethrown by
+    // wait().
+    class TaskGroup
+    {
+    public:
+        TaskGroup(Pool& pool)
+            : pool(pool)
+        {}
+
+        // a group must be waited for before it goes away, but a destructor
+        // can't rethrow the exceptions.
+        ~TaskGroup()
+        {
+            wait_for_tasks();
+        }
+
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator=(const TaskGroup&) = delete;
+
+        // run fn() on the pool, optionally bound to a specific worker
+        template<typename F>
+        void run(const F& fn, size_t worker_idx = ANY_WORKER)
+        {
+            Task task;
+            task.fn = [](const void* ctx, size_t /*idx*/)
+                {
+                    (*(const F*)ctx)();
+                };
+            task.ctx = &fn;
+            task.group = this;
+
+            n_pending++;
+            pool.submit(task, worker_idx);
+        }
+
+        // run fn(i) for every i in [0, n) on the pool
+        template<typename F>
+        void run_for(size_t n, const F& fn)
+        {
+            Task task;
+            task.fn = [](const void* ctx, size_t idx)
+                {
+                    (*(const F*)ctx)(idx);
+                };
+            task.ctx = &fn;
+            task.group = this;
+
+            n_pending += n;
+            for (size_t i = 0; i < n; i++)
+            {
+                task.idx = i;
+                pool.submit(task);
+            }
+        }
+
+        // run fn(worker_idx) once on every worker of the pool
+        template<typename F>
+        void run_on_workers(const F& fn)
+        {
+            Task task;
+            task.fn = [](const void* ctx, size_t idx)
+                {
+                    (*(const F*)ctx)(idx);
+                };
+            task.ctx = &fn;
+            task.group = this;
+
+            n_pending += pool.n_workers();
+            for (size_t w = 0; w < pool.n_workers(); w++)
+            {
+                task.idx = w;
+                pool.submit(task, w);
+            }
+        }
+
+        // wait until every task in the group is done. pool workers run other
+        // tasks while waiting, other threads just block.
+        void wait()
+        {
+            wait_for_tasks();
+
+            if (exception)
+            {
+                std::exception_ptr e = exception;
+                exception = nullptr;
+                std::rethrow_exception(e);
+            }
+        }
+
+    private:
+        Pool& pool;
+
+        std::mutex mutex;
+        std::condition_variable done_cv;
+        std::atomic_size_t n_pending = 0;
+        std::exception_ptr exception = nullptr;
+
+        void wait_for_tasks();
+
+        // called by Pool after running one of the group's tasks. error is
+        // the exception it threw, if any.
+        void task_done(std::exception_ptr error);
+
+        friend class Pool;
+
+    };
+
+    // call fn(range_begin, range_end) for consecutive ranges of at most
+    // grain_size indices that cover [begin, end) on the pool, and wait for
+    // all of them. fn is always called on the pool's workers.
+    template<typename F>
+    void parallel_for(
+        Pool& pool,
+        size_t begin,
+        size_t end,
+        size_t grain_size,
+        const F& fn
+    )
+    {
+        if (begin >= end)
+        {
+            return;
+        }
+
+        grain_size = std::max(grain_size, (size_t)1u);
+        const size_t n_ranges = (end - begin + grain_size - 1u) / grain_size;
+
+        auto run_range = [&](size_t range_idx)
+            {
+                const size_t range_begin = begin + range_idx * grain_size;
+                fn(range_begin, std::min(range_begin + grain_size, end));
+            };
+
+        TaskGroup group(pool);
+        group.run_for(n_ranges, run_range);
+        group.wait();
+    }
+
+}
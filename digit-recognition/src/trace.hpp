@@ -0,0 +1,282 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <format>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <cstdint>
+
+// timeline tracing that records when named scopes begin and end on every
+// thread and writes them in the Chrome trace event format, which can be
+// opened in chrome://tracing or https://ui.perfetto.dev.
+// tracing is compiled out entirely unless DIGIT_REC_TRACE is defined in the
+// preprocessor definitions.
+// each thread writes its events into its own ring buffer, so recording an
+// event never takes a lock. only the most recent EVENTS_PER_THREAD events are
+// kept for every thread. write_json() can be called from any thread at any
+// time, even while other threads are recording events.
+namespace trace
+{
+
+#ifdef DIGIT_REC_TRACE
+    static constexpr bool ENABLED = true;
+#else
+    static constexpr bool ENABLED = false;
+#endif
+
+    // number of events kept for every thread (must be a power of 2)
+    static constexpr size_t EVENTS_PER_THREAD = 1u << 16u;
+
+    // time point that all timestamps are relative to
+    inline const std::chrono::steady_clock::time_point epoch =
+        std::chrono::steady_clock::now();
+
+    inline uint64_t now_ns()
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - epoch
+        ).count();
+    }
+
+    // ring buffer of events recorded by a single thread. event fields are
+    // stored as individual atomics so that write_json() reading an event
+    // while it's being overwritten doesn't cause undefined behavior (such
+    // events are discarded anyway).
+    struct ThreadBuffer
+    {
+        struct Event
+        {
+            // must point to a string literal or other static storage
+            std::atomic<const char*> name = nullptr;
+            std::atomic_uint64_t begin_ns = 0;
+            std::atomic_uint64_t end_ns = 0;
+        };
+
+        // thread ID shown in the trace
+        uint32_t tid = 0;
+
+        // whether a live thread owns this buffer
+        std::atomic_bool in_use = false;
+
+        // thread name shown in the trace
+        std::atomic<const char*> name = nullptr;
+
+        // total number of events ever recorded in this buffer
+        std::atomic_uint64_t n_events = 0;
+
+        std::unique_ptr<Event[]> events =
+            std::make_unique<Event[]>(EVENTS_PER_THREAD);
+
+        // add an event (owner thread only)
+        void record(const char* event_name, uint64_t begin, uint64_t end)
+        {
+            const uint64_t idx = n_events.load(std::memory_order_relaxed);
+            auto& ev = events[idx & (EVENTS_PER_THREAD - 1u)];
+            ev.name.store(event_name, std::memory_order_relaxed);
+            ev.begin_ns.store(begin, std::memory_order_relaxed);
+            ev.end_ns.store(end, std::memory_order_relaxed);
+            n_events.store(idx + 1u, std::memory_order_release);
+        }
+    };
+
+    // all buffers ever created. buffers are never destroyed, a buffer whose
+    // thread has exited is handed to the next thread that needs one (threads
+    // that don't overlap in time can safely share a row in the trace).
+    inline std::mutex buffers_mutex;
+    inline std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+    // gives the current thread a buffer on first use and releases it when
+    // the thread exits.
+    class ThreadBufferOwner
+    {
+    public:
+        ThreadBuffer& get()
+        {
+            if (!buffer)
+            {
+                acquire();
+            }
+            return *buffer;
+        }
+
+        ~ThreadBufferOwner()
+        {
+            if (buffer)
+            {
+                buffer->in_use.store(false, std::memory_order_release);
+            }
+        }
+
+    private:
+        ThreadBuffer* buffer = nullptr;
+
+        void acquire()
+        {
+            std::scoped_lock lock(buffers_mutex);
+            for (auto& b : buffers)
+            {
+                if (!b->in_use.load(std::memory_order_acquire))
+                {
+                    buffer = b.get();
+                    buffer->in_use.store(true, std::memory_order_relaxed);
+                    buffer->name.store(nullptr, std::memory_order_relaxed);
+                    return;
+                }
+            }
+
+            buffers.push_back(std::make_unique<ThreadBuffer>());
+            buffer = buffers.back().get();
+            buffer->tid = (uint32_t)buffers.size();
+            buffer->in_use.store(true, std::memory_order_relaxed);
+        }
+
+    };
+
+    inline thread_local ThreadBufferOwner thread_buffer;
+
+    // name the current thread in the trace. name must point to a string
+    // literal or other static storage.
+    inline void set_thread_name(const char* name)
+    {
+        thread_buffer.get().name.store(name, std::memory_order_relaxed);
+    }
+
+    // records an event from its creation to its destruction on the current
+    // thread. use TRACE_SCOPE() instead of using this directly so that it can
+    // be compiled out.
+    class ScopedEvent
+    {
+    public:
+        ScopedEvent(const char* name)
+            : name(name), begin(now_ns())
+        {}
+
+        ~ScopedEvent()
+        {
+            thread_buffer.get().record(name, begin, now_ns());
+        }
+
+        ScopedEvent(const ScopedEvent&) = delete;
+        ScopedEvent& operator=(const ScopedEvent&) = delete;
+
+    private:
+        const char* name;
+        uint64_t begin;
+
+    };
+
+    // write the events recorded so far by all threads to a JSON file in the
+    // Chrome trace event format. throws if the file can't be written.
+    inline void write_json(std::string_view path)
+    {
+        std::ofstream f(std::string(path), std::ios::out | std::ios::trunc);
+        if (!f)
+        {
+            throw std::runtime_error(std::format(
+                "couldn't open \"{}\" for writing",
+                path
+            ));
+        }
+
+        std::scoped_lock lock(buffers_mutex);
+
+        f << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+        bool first = true;
+        auto separate = [&]()
+            {
+                if (!first)
+                    f << ",\n";
+                first = false;
+            };
+
+        for (const auto& b : buffers)
+        {
+            if (const char* thread_name =
+                b->name.load(std::memory_order_relaxed))
+            {
+                separate();
+                f << std::format(
+                    "{{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,"
+                    "\"tid\":{},\"args\":{{\"name\":\"{}\"}}}}",
+                    b->tid,
+                    thread_name
+                );
+            }
+
+            const uint64_t n_before =
+                b->n_events.load(std::memory_order_acquire);
+            const uint64_t first_idx = n_before > EVENTS_PER_THREAD
+                ? n_before - EVENTS_PER_THREAD
+                : 0;
+
+            std::vector<std::string> lines;
+            for (uint64_t i = first_idx; i < n_before; i++)
+            {
+                const auto& ev = b->events[i & (EVENTS_PER_THREAD - 1u)];
+                const char* name = ev.name.load(std::memory_order_relaxed);
+                const uint64_t begin =
+                    ev.begin_ns.load(std::memory_order_relaxed);
+                const uint64_t end = ev.end_ns.load(std::memory_order_relaxed);
+
+                lines.push_back(std::format(
+                    "{{\"ph\":\"X\",\"name\":\"{}\",\"pid\":1,\"tid\":{},"
+                    "\"ts\":{:.3f},\"dur\":{:.3f}}}",
+                    name ? name : "",
+                    b->tid,
+                    (double)begin * 1e-3,
+                    (double)(end - begin) * 1e-3
+                ));
+            }
+
+            // the owner thread might have overwritten some of the oldest
+            // events while we were reading them, skip those. the event at
+            // index n_after - EVENTS_PER_THREAD might be getting overwritten
+            // right now as well.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            const uint64_t n_after =
+                b->n_events.load(std::memory_order_relaxed);
+            const uint64_t first_valid_idx = n_after >= EVENTS_PER_THREAD
+                ? n_after - EVENTS_PER_THREAD + 1u
+                : 0;
+
+            for (uint64_t i = first_idx; i < n_before; i++)
+            {
+                if (i < first_valid_idx)
+                {
+                    continue;
+                }
+                separate();
+                f << lines[i - first_idx];
+            }
+        }
+
+        f << "]}\n";
+    }
+
+}
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+// record the rest of the current scope as an event with a given name (must be
+// a string literal).
+#ifdef DIGIT_REC_TRACE
+#define TRACE_SCOPE(name) \
+    trace::ScopedEvent TRACE_CONCAT(trace_event_, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name)
+#endif
+
+// name the current thread in the trace (must be a string literal)
+#ifdef DIGIT_REC_TRACE
+#define TRACE_THREAD_NAME(name) trace::set_thread_name(name)
+#else
+#define TRACE_THREAD_NAME(name)
+#endif